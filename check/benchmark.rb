@@ -0,0 +1,417 @@
+#!/bin/sh
+# See bbatsov/rubocop#3326
+# rubocop:disable all
+exec ruby "-S" "-x" "$0" "$@"
+#! ruby
+# rubocop:enable all
+
+# The benchmark runner. It runs a fixed set of FORM programs with one or more
+# executables, for several numbers of workers and buffer configurations, and
+# records the wall-clock time, the CPU time, the peak resident set size and the
+# peak size of the sort and scratch files of every run in a JSON file. Two such
+# files, for example made with two versions of FORM, can be compared with
+# --compare.
+#
+# Examples:
+#
+#   ./benchmark.rb --path ../sources form tform
+#   ./benchmark.rb -w 1,2,4,8 -c default,small -o new.json tform
+#   ./benchmark.rb --compare old.json new.json
+
+# The default directory of this script and the benchmark programs.
+BENCHDIR = File.dirname(__FILE__)
+
+# The default maximal running time in seconds of one run.
+TIMEOUT = 1800
+
+# The ratio of the wall-clock times above which --compare reports a regression.
+THRESHOLD = 1.1
+
+# The interval in seconds between two samples of the temporary directories.
+POLL_INTERVAL = 0.01
+
+if RUBY_VERSION < "1.9.0"
+  warn("ruby 1.9 required for the benchmarks")
+  exit(1)
+end
+
+require "etc"
+require "fileutils"
+require "json"
+require "optparse"
+require "ostruct"
+require "socket"
+require "time"
+require "tmpdir"
+
+# Show an error message and exit.
+def fatal(message)
+  STDERR.puts("error: #{message}")
+  exit(1)
+end
+
+# Show a warning message.
+def warn(message)
+  STDERR.puts("warning: #{message}")
+end
+
+# The benchmark programs. Each entry gives the input file relative to BENCHDIR,
+# extra preprocessor definitions and, optionally, a header file that has to be
+# found in FORMPATH (otherwise the benchmark is skipped).
+BENCHMARKS = [
+  { :name => "formunit", :file => "formunit/fu.frm", :defs => ["QUIET"] },
+  { :name => "forcer",   :file => "forcer/forcer.frm", :defs => ["TEST=Forcer_1"],
+    :requires => "forcer.h" },
+  { :name => "gcd",      :file => "benchmark/gcd.frm" },
+  { :name => "optimize", :file => "benchmark/optimize.frm" },
+  { :name => "sort",     :file => "benchmark/sort.frm" },
+].freeze
+
+# The predefined buffer configurations, given as lines of a setup file.
+# "small" makes the sorts go through the sort file much earlier.
+CONFIGS = {
+  "default" => [],
+  "small"   => ["SmallSize 1M", "SmallExtension 2M", "TermsInSmall 20K",
+                "LargeSize 4M", "LargePatches 8", "ScratchSize 1M"],
+  "large"   => ["SmallSize 100M", "SmallExtension 200M", "TermsInSmall 1M",
+                "LargeSize 800M", "ScratchSize 100M"],
+}.freeze
+
+# Find the path to a program.
+def which(name)
+  if name != File.basename(name)
+    return File.executable?(name) ? File.expand_path(name) : nil
+  end
+  ENV["PATH"].split(":").each do |path|
+    f = File.join(path, name)
+    return f if File.file?(f) && File.executable?(f)
+  end
+  nil
+end
+
+# Find a file in FORMPATH and the extra directories.
+def find_in_formpath(name, dirs)
+  (dirs + (ENV["FORMPATH"] || "").split(":")).each do |dir|
+    next if dir.empty?
+    f = File.join(dir, name)
+    return dir if File.file?(f)
+  end
+  nil
+end
+
+# Per-process resource usage via wait4(2), if it can be called through Fiddle.
+# Otherwise we fall back on Process.times, which gives no peak memory.
+module ChildUsage
+  WNOHANG = 1
+
+  begin
+    require "fiddle"
+    raise LoadError if Fiddle::SIZEOF_LONG != 8
+    WAIT4 = Fiddle::Function.new(Fiddle.dlopen(nil)["wait4"],
+                                 [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP,
+                                  Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP],
+                                 Fiddle::TYPE_INT)
+  rescue LoadError, StandardError
+    WAIT4 = nil
+  end
+
+  # Return nil while the process is running. Otherwise reap it and return
+  # [exitstatus, user time, system time, peak RSS in bytes or nil].
+  def self.poll(pid, start_times)
+    if WAIT4.nil?
+      _, status = Process.wait2(pid, Process::WNOHANG)
+      return nil if status.nil?
+      t = Process.times
+      return [status.exitstatus || -1,
+              t.cutime - start_times.cutime, t.cstime - start_times.cstime,
+              nil]
+    end
+    status = Fiddle::Pointer.malloc(8)
+    rusage = Fiddle::Pointer.malloc(256)
+    r = WAIT4.call(pid, status, WNOHANG, rusage)
+    return nil if r == 0
+    fatal("wait4 failed for process #{pid}") if r < 0
+    st = status[0, 4].unpack("l")[0]
+    # struct rusage starts with two timevals followed by ru_maxrss.
+    usec, uusec, ssec, susec, maxrss = rusage[0, 40].unpack("qlxxxxqlxxxxq")
+    maxrss *= 1024 if RUBY_PLATFORM !~ /darwin/
+    [(st & 0x7f) == 0 ? (st >> 8) & 0xff : -1,
+     usec + uusec * 1e-6, ssec + susec * 1e-6, maxrss]
+  end
+end
+
+# Total size of the files in a directory.
+def dir_bytes(dir)
+  Dir.glob(File.join(dir, "*")).inject(0) do |sum, f|
+    begin
+      sum + File.size(f)
+    rescue SystemCallError
+      sum
+    end
+  end
+end
+
+# Kind of the executable: serial, threaded or mpi.
+def bin_kind(bin)
+  case File.basename(bin)
+  when /tform/, /tvorm/ then :threaded
+  when /parform/, /parvorm/ then :mpi
+  else :serial
+  end
+end
+
+# The first line of "form -v".
+def bin_version(bin)
+  IO.popen([bin, "-v"]) { |io| (io.gets || "").strip }
+rescue SystemCallError
+  ""
+end
+
+# Run one benchmark once. Returns a Hash with the measurements.
+def run_one(opts, bench, bin, workers, config)
+  Dir.mktmpdir("form_bench_") do |dir|
+    tmpdir = File.join(dir, "tmp")
+    sortdir = File.join(dir, "sort")
+    Dir.mkdir(tmpdir)
+    Dir.mkdir(sortdir)
+
+    input = File.join(dir, File.basename(bench[:file]))
+    FileUtils.cp(File.join(opts.dir, bench[:file]), input)
+
+    cmd = [bin, "-T", "-t", tmpdir, "-ts", sortdir]
+    cmd += ["-w#{workers}"] if bin_kind(bin) == :threaded
+    lines = CONFIGS[config] || opts.configs[config]
+    if !lines.empty?
+      setup = File.join(dir, "bench.set")
+      File.open(setup, "w") { |f| f.puts(lines) }
+      cmd += ["-S", setup]
+    end
+    (bench[:defs] || []).each { |d| cmd += ["-D", d] }
+    cmd += ["-D", "SIZE=#{opts.size}"]
+    cmd << File.basename(input)
+
+    env = {}
+    env["FORMPATH"] = ([bench[:path], File.join(opts.dir, File.dirname(bench[:file]))] +
+                       [ENV["FORMPATH"]]).compact.join(":")
+
+    log = File.join(dir, "bench.log")
+    start_times = Process.times
+    t0 = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    pid = Process.spawn(env, *cmd, :chdir => dir, :out => log,
+                        :err => [:child, :out], :pgroup => true)
+    sort_peak = 0
+    scratch_peak = 0
+    result = nil
+    timedout = false
+    loop do
+      result = ChildUsage.poll(pid, start_times)
+      break if !result.nil?
+      sort_peak = [sort_peak, dir_bytes(sortdir)].max
+      scratch_peak = [scratch_peak, dir_bytes(tmpdir)].max
+      if Process.clock_gettime(Process::CLOCK_MONOTONIC) - t0 > opts.timeout
+        timedout = true
+        begin
+          Process.kill(:KILL, -pid)
+        rescue SystemCallError
+        end
+      end
+      sleep(POLL_INTERVAL)
+    end
+    wall = Process.clock_gettime(Process::CLOCK_MONOTONIC) - t0
+    status, utime, stime, rss = result
+
+    output = File.read(log)
+    puts(output) if opts.verbose
+    space = output =~ /Max\. space for expressions:\s*(\d+) bytes/ ? $1.to_i : nil
+
+    {
+      "benchmark"            => bench[:name],
+      "binary"               => File.basename(bin),
+      "workers"              => bin_kind(bin) == :threaded ? workers : 0,
+      "config"               => config,
+      "status"               => timedout ? "timeout" : (status == 0 ? "ok" : "failed"),
+      "wall_time"            => wall.round(3),
+      "cpu_time"             => (utime + stime).round(3),
+      "user_time"            => utime.round(3),
+      "system_time"          => stime.round(3),
+      "max_rss_bytes"        => rss,
+      "sort_file_bytes"      => sort_peak,
+      "scratch_file_bytes"   => scratch_peak,
+      "max_expr_space_bytes" => space,
+    }
+  end
+end
+
+# The key that identifies comparable runs in two result files.
+def run_key(r)
+  [r["benchmark"], r["binary"], r["workers"], r["config"]]
+end
+
+# The best (minimal) wall-clock time of each successful benchmark run.
+def best_times(results)
+  best = {}
+  results["runs"].each do |r|
+    next if r["status"] != "ok"
+    k = run_key(r)
+    best[k] = r["wall_time"] if best[k].nil? || r["wall_time"] < best[k]
+  end
+  best
+end
+
+# Compare two result files and print the ratios of the wall-clock times.
+# Returns false if any run became slower than the threshold.
+def compare(oldfile, newfile, threshold)
+  oldres = JSON.parse(File.read(oldfile))
+  newres = JSON.parse(File.read(newfile))
+  (oldres["configs"].keys & newres["configs"].keys).each do |c|
+    if oldres["configs"][c] != newres["configs"][c]
+      warn("configuration #{c} differs between the two files")
+    end
+  end
+  old = best_times(oldres)
+  new = best_times(newres)
+  ok = true
+  puts(format("%-10s %-8s %7s %-8s %10s %10s %7s", "benchmark", "binary",
+              "workers", "config", "old", "new", "ratio"))
+  (old.keys & new.keys).sort_by { |k| k.map(&:to_s) }.each do |k|
+    ratio = new[k] / [old[k], 1e-3].max
+    mark = ""
+    if ratio > threshold
+      mark = "  slower"
+      ok = false
+    end
+    puts(format("%-10s %-8s %7d %-8s %10.3f %10.3f %7.3f%s", *k, old[k], new[k],
+                ratio, mark))
+  end
+  (old.keys - new.keys).each { |k| warn("#{k.join(' ')}: no new result") }
+  (new.keys - old.keys).each { |k| warn("#{k.join(' ')}: no old result") }
+  ok
+end
+
+def main
+  opts = OpenStruct.new
+  opts.dir = BENCHDIR
+  opts.workers = [1, 2, 4]
+  opts.config_names = ["default"]
+  opts.configs = {}
+  opts.names = nil
+  opts.size = 1
+  opts.repeat = 1
+  opts.timeout = TIMEOUT
+  opts.output = "benchmark.json"
+  opts.include = []
+  opts.compare = nil
+  opts.threshold = THRESHOLD
+  opts.verbose = false
+
+  parser = OptionParser.new
+  parser.banner = "Usage: #{File.basename($0)} [options] [binaries..]\n" \
+                  "       #{File.basename($0)} --compare OLD.json NEW.json"
+  parser.on("-h", "--help",             "Show this help and exit")              { puts(parser); exit }
+  parser.on("-l", "--list",             "List all benchmarks and exit")         { BENCHMARKS.each { |b| puts(b[:name]) }; exit }
+  parser.on("--path PATH",              "Use PATH for executables")             { |path| ENV["PATH"] = path + ":" + ENV["PATH"] }
+  parser.on("-b", "--bench LIST",       "Run the comma separated benchmarks")   { |l| opts.names = l.split(",") }
+  parser.on("-w", "--workers LIST",     "Numbers of workers for TFORM")         { |l| opts.workers = l.split(",").map(&:to_i) }
+  parser.on("-c", "--config LIST",      "Buffer configurations (#{CONFIGS.keys.join(',')})") { |l| opts.config_names = l.split(",") }
+  parser.on("--setup NAME=LINES",       "Define a configuration by setup lines separated by ';'") do |s|
+    name, lines = s.split("=", 2)
+    opts.configs[name] = (lines || "").split(";").map(&:strip)
+    opts.config_names << name if !opts.config_names.include?(name)
+  end
+  parser.on("-s", "--size N",           "Scale the workload by N")              { |n| opts.size = n.to_i }
+  parser.on("-r", "--repeat N",         "Repeat every run N times")             { |n| opts.repeat = n.to_i }
+  parser.on("-t", "--timeout N",        "Timeout N in seconds of one run")      { |n| opts.timeout = n.to_i }
+  parser.on("-o", "--output FILE",      "Write the results to FILE")            { |f| opts.output = f }
+  parser.on("-I", "--include DIR",      "Search DIR for libraries like Forcer") { |d| opts.include << File.expand_path(d) }
+  parser.on("--compare",                "Compare two result files")             { opts.compare = true }
+  parser.on("--threshold X",            "Slowdown ratio reported by --compare") { |x| opts.threshold = x.to_f }
+  parser.on("-v", "--verbose",          "Show the output of FORM")              { opts.verbose = true }
+  begin
+    parser.parse!(ARGV)
+  rescue OptionParser::ParseError => e
+    STDERR.puts(e.message)
+    puts(parser)
+    exit(1)
+  end
+
+  if opts.compare
+    fatal("--compare needs two result files") if ARGV.length != 2
+    exit(compare(ARGV[0], ARGV[1], opts.threshold) ? 0 : 1)
+  end
+
+  bins = (ARGV.empty? ? ["form"] : ARGV).map do |b|
+    path = which(b)
+    fatal("executable #{b} not found") if path.nil?
+    path
+  end
+
+  (opts.config_names - CONFIGS.keys - opts.configs.keys).each do |c|
+    fatal("unknown configuration #{c}")
+  end
+
+  benches = BENCHMARKS.select { |b| opts.names.nil? || opts.names.include?(b[:name]) }
+  benches = benches.map do |b|
+    b = b.dup
+    if !b[:requires].nil?
+      b[:path] = find_in_formpath(b[:requires], opts.include)
+      if b[:path].nil?
+        warn("#{b[:name]}: #{b[:requires]} not found in FORMPATH, skipped")
+        next nil
+      end
+    end
+    b
+  end.compact
+  fatal("no benchmarks to run") if benches.empty?
+
+  results = {
+    "format"   => 1,
+    "date"     => Time.now.iso8601,
+    "host"     => Socket.gethostname,
+    "ncpu"     => Etc.respond_to?(:nprocessors) ? Etc.nprocessors : nil,
+    "size"     => opts.size,
+    "binaries" => {},
+    "configs"  => {},
+    "runs"     => [],
+  }
+  bins.each do |bin|
+    results["binaries"][File.basename(bin)] = { "path" => bin, "version" => bin_version(bin) }
+  end
+  opts.config_names.each do |c|
+    results["configs"][c] = CONFIGS[c] || opts.configs[c]
+  end
+
+  failed = false
+  bins.each do |bin|
+    case bin_kind(bin)
+    when :mpi
+      warn("#{File.basename(bin)}: MPI versions are not supported, skipped")
+      next
+    when :serial
+      workers = [0]
+    else
+      workers = opts.workers
+    end
+    benches.each do |bench|
+      workers.each do |w|
+        opts.config_names.each do |c|
+          opts.repeat.times do
+            r = run_one(opts, bench, bin, w, c)
+            results["runs"] << r
+            failed = true if r["status"] != "ok"
+            puts(format("%-10s %-8s %3d %-8s %-7s %9.3fs wall %9.3fs cpu %8.1f MB rss %8.1f MB sort",
+                        r["benchmark"], r["binary"], r["workers"], r["config"], r["status"],
+                        r["wall_time"], r["cpu_time"], (r["max_rss_bytes"] || 0) / 1048576.0,
+                        r["sort_file_bytes"] / 1048576.0))
+            STDOUT.flush
+          end
+        end
+      end
+    end
+  end
+
+  File.open(opts.output, "w") { |f| f.puts(JSON.pretty_generate(results)) }
+  puts("Results written to #{opts.output}")
+  exit(failed ? 1 : 0)
+end
+
+main
@@ -2513,7 +2513,8 @@ WORD InsertArg(PHEAD WORD *argin, WORD *argout,int par)
   	#[ CleanupArgCache :
 */
 /**
- *	Cleans up the argument factorization cache.
+ *	Cleans up the argument factorization cache (or the PolyRatFun cache,
+ *	see poly_ratfun_cache in polywrap.cc).
  *	We throw half the elements.
  *	For a weight of what we want to keep we use the product of
  *	usage and the number in the buffer.
@@ -2527,6 +2528,7 @@ int CleanupArgCache(PHEAD WORD bufnum)
 	LONG w, whalf, *extraweights;
 	WORD *a, *to, *from;
 	int i,j,k;
+	DUMMYUSE(AT.WorkPointer);
 	for ( i = 1; i <= C->numrhs; i++ ) {
 		weights[i] = ((LONG)i) * (boomlijst[i].usage);
 	}
@@ -2573,9 +2575,9 @@ int CleanupArgCache(PHEAD WORD bufnum)
 		Note that this can probably be done much faster by using the
 		remains of the old tree !!!!!!!!!!!!!!!!
 */
-	ClearTree(AT.fbufnum);
+	ClearTree(bufnum);
 	for ( i = 1; i <= k; i++ ) {
-		InsTree(AT.fbufnum,i);
+		InsTree(bufnum,i);
 		boomlijst[i].usage = weights[i];
 	}
 /*
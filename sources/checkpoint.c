@@ -766,6 +766,10 @@ static void print_M()
 	MesPrint("%d", AM.ggThreadsFlag);
 	MesPrint("%d", AM.gThreadBalancing);
 	MesPrint("%d", AM.ggThreadBalancing);
+	MesPrint("%d", AM.gThreadWorkStealing);
+	MesPrint("%d", AM.ggThreadWorkStealing);
+	MesPrint("%d", AM.gThreadBucketAutotune);
+	MesPrint("%d", AM.ggThreadBucketAutotune);
 	MesPrint("%d", AM.gThreadSortFileSynch);
 	MesPrint("%d", AM.ggThreadSortFileSynch);
 	MesPrint("%d", AM.gProcessStats);
@@ -1469,6 +1473,8 @@ int DoRecovery(int *moduletype)
 	R_SET(AM.gFinalStats, int);
 	R_SET(AM.gThreadsFlag, int);
 	R_SET(AM.gThreadBalancing, int);
+	R_SET(AM.gThreadWorkStealing, int);
+	R_SET(AM.gThreadBucketAutotune, int);
 	R_SET(AM.gThreadSortFileSynch, int);
 	R_SET(AM.gProcessStats, int);
 	R_SET(AM.gOldParallelStats, int);
@@ -2093,7 +2099,7 @@ int DoRecovery(int *moduletype)
 			R_COPY_B(d->where, size, void*);
 		}
 #ifdef WITHPTHREADS
-		d->pthreadslockread = dummylock;
+		d->pthreadslockread = dummyrwlock;
 		d->pthreadslockwrite = dummylock;
 #endif
 		if ( d->nfactors > 1 ) {
@@ -2539,6 +2545,8 @@ static int DoSnapshot(int moduletype)
 	S_WRITE_B(&AM.gFinalStats, sizeof(int));
 	S_WRITE_B(&AM.gThreadsFlag, sizeof(int));
 	S_WRITE_B(&AM.gThreadBalancing, sizeof(int));
+	S_WRITE_B(&AM.gThreadWorkStealing, sizeof(int));
+	S_WRITE_B(&AM.gThreadBucketAutotune, sizeof(int));
 	S_WRITE_B(&AM.gThreadSortFileSynch, sizeof(int));
 	S_WRITE_B(&AM.gProcessStats, sizeof(int));
 	S_WRITE_B(&AM.gOldParallelStats, sizeof(int));
@@ -114,6 +114,12 @@ static KEYWORD onoffoptions[] = {
 	,{"threads",		(TFUN)&(AC.ThreadsFlag),1,	0}
 	,{"threadsortfilesynch",(TFUN)&(AC.ThreadSortFileSynch),1,  0}
 	,{"threadstats",	(TFUN)&(AC.ThreadStats),1,	0}
+	,{"threadworkstealing",(TFUN)&(AC.ThreadWorkStealing),1,0}
+	,{"threadhandoffstats",(TFUN)&(AC.ThreadHandoffStats),1,0}
+	,{"threadsorthelp",(TFUN)&(AC.ThreadSortHelp),1,0}
+	,{"threadgcdhelp",(TFUN)&(AC.ThreadGcdHelp),1,0}
+	,{"threadprofile",(TFUN)&(AC.ThreadProfile),1,0}
+	,{"threadbucketautotune",(TFUN)&(AC.ThreadBucketAutotune),1,0}
 	,{"finalstats",	    (TFUN)&(AC.FinalStats),1,	0}
 	,{"fewerstats",		(TFUN)&(AC.ShortStatsMax),	10,		0}
 	,{"fewerstatistics",(TFUN)&(AC.ShortStatsMax),	10,		0}
@@ -128,6 +134,8 @@ static KEYWORD onoffoptions[] = {
 	,{"memdebugflag",	(TFUN)&(AC.MemDebugFlag),	1,	0}
 	,{"oldgcd", 		(TFUN)&(AC.OldGCDflag),	1,	0}
 	,{"innertest",      (TFUN)&(AC.InnerTest),  1,  0}
+	,{"keyedsort",      (TFUN)&(AC.KeyedSortFlag),  1,  0}
+	,{"hashsort",       (TFUN)&(AC.HashSortFlag),  1,  0}
 	,{"wtimestats",     (TFUN)&(AC.WTimeStatsFlag),  1,  0}
 };
 
@@ -594,8 +602,30 @@ int CoOn(UBYTE *s)
 				}
 			}
 		}
+		else if ( StrICont(t,(UBYTE *)"threadprofile") == 0 ) {
+			UBYTE *t;
+			*s = c;
+			while ( *s == ' ' || *s == ',' || *s == '\t' ) s++;
+			if ( *s ) {
+				if ( *s == '"' ) {
+					t = ++s; while ( *s && *s != '"' ) s++;
+				}
+				else {
+					t = s; while ( *s && *s != ',' && *s != ' ' && *s != '\t' ) s++;
+				}
+				if ( s == t ) {
+					MesPrint("&Empty file name in ON ThreadProfile statement");
+					return(-1);
+				}
+				c = *s; *s = 0;
+				if ( AC.ThreadProfileName ) M_free(AC.ThreadProfileName,"ThreadProfile");
+				AC.ThreadProfileName = strDup1(t,"ThreadProfile");
+				*s = c;
+				if ( *s == '"' ) s++;
+			}
+		}
 		else { *s = c; }
-	 	*((int *)(onoffoptions[i].func)) = onoffoptions[i].type; 
+	 	*((int *)(onoffoptions[i].func)) = onoffoptions[i].type;
 		AR.SortType = AC.SortType;
 		AC.mparallelflag = AC.parallelflag | AM.hparallelflag;
 	}
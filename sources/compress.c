@@ -61,10 +61,289 @@
 		(in struct A.N or AB[threadnum].N)
 	Bytef **AN.ziobufnum;
 	Bytef *AN.ziobuffers;
+	When the setup parameter SortCodec is fast or varint, each stream that
+	is read also needs room for one decoded block that does not fit in the
+	buffer that is being filled:
+	Bytef *AN.zfastbuffers;
 */
 
+#define FASTBLOCK 16384
+#define FASTHEAD 8
+#define FASTMINMATCH 4
+#define FASTHASHBITS 12
+#define FASTBOUND(n) ((n)+(n)/2+16)
+
 /*
   	#] Variables : 
+  	#[ FastCodec :
+
+	A small LZ77 codec of the LZ4 family for the patches of the sort file.
+	It is selected with the setup parameter SortCodec fast. There is no
+	entropy coding, hence the ratio is worse than for gzip, but it is
+	many times faster, both for compression and for decompression.
+
+	The output is cut into blocks with at most FASTBLOCK bytes of input.
+	Each block starts with a header of FASTHEAD bytes, containing the
+	compressed size and the raw size of the block. The data in the block
+	is a sequence of
+		token, [more literal length], literals, offset, [more match length]
+	The upper four bits of the token give the number of literals, the lower
+	four bits the length of the match minus FASTMINMATCH. A value of 15
+	means that more bytes follow, each adding up to 255 to the value.
+	The offset is two bytes, low byte first. The last sequence of a block
+	has only literals.
+
+	FASTBOUND gives the maximum size of the compressed data of a block,
+	both for this codec and for the one in VarintCompress.
+*/
+
+static void FastPutSize(UBYTE *s, ULONG x)
+{
+	s[0] = (UBYTE)(x & 0xFF);
+	s[1] = (UBYTE)((x >> 8) & 0xFF);
+	s[2] = (UBYTE)((x >> 16) & 0xFF);
+	s[3] = (UBYTE)((x >> 24) & 0xFF);
+}
+
+static LONG FastGetSize(UBYTE *s)
+{
+	return((LONG)(s[0] | (s[1] << 8) | (s[2] << 16) | ((ULONG)(s[3]) << 24)));
+}
+
+static UBYTE *FastSequence(UBYTE *op, UBYTE *lit, LONG nlit, LONG offset, LONG mlen)
+{
+	UBYTE *token = op++;
+	LONG x;
+	if ( nlit >= 15 ) {
+		*token = 15 << 4;
+		x = nlit - 15;
+		while ( x >= 255 ) { *op++ = 255; x -= 255; }
+		*op++ = (UBYTE)x;
+	}
+	else *token = (UBYTE)(nlit << 4);
+	memcpy(op,lit,nlit);
+	op += nlit;
+	if ( mlen > 0 ) {
+		*op++ = (UBYTE)(offset & 0xFF);
+		*op++ = (UBYTE)(offset >> 8);
+		mlen -= FASTMINMATCH;
+		if ( mlen >= 15 ) {
+			*token |= 15;
+			x = mlen - 15;
+			while ( x >= 255 ) { *op++ = 255; x -= 255; }
+			*op++ = (UBYTE)x;
+		}
+		else *token |= (UBYTE)mlen;
+	}
+	return(op);
+}
+
+/*
+	Compresses n bytes (n <= FASTBLOCK) of in into out.
+	Returns the number of bytes in out, which is at most FASTBOUND(n).
+*/
+
+static LONG FastCompress(UBYTE *in, LONG n, UBYTE *out)
+{
+	unsigned short htab[1 << FASTHASHBITS];
+	UBYTE *op = out;
+	LONG i = 0, anchor = 0, r, len;
+	unsigned int v, w, h;
+	memset(htab,0,sizeof(htab));
+	while ( i < n - FASTMINMATCH - 4 ) {
+		memcpy(&v,in+i,4);
+		h = (unsigned int)(v * 2654435761U) >> (32 - FASTHASHBITS);
+		r = htab[h];
+		htab[h] = (unsigned short)i;
+		if ( r < i ) {
+			memcpy(&w,in+r,4);
+			if ( v == w ) {
+				len = 4;
+				while ( i + len < n && in[r+len] == in[i+len] ) len++;
+				op = FastSequence(op,in+anchor,i-anchor,i-r,len);
+				i += len;
+				anchor = i;
+				continue;
+			}
+		}
+		i++;
+	}
+	op = FastSequence(op,in+anchor,n-anchor,0,0);
+	return(op-out);
+}
+
+/*
+	Decompresses the n bytes of in into out, which has room for size bytes.
+	Returns the number of bytes in out or -1 when the data are corrupt.
+*/
+
+static LONG FastDecompress(UBYTE *in, LONG n, UBYTE *out, LONG size)
+{
+	UBYTE *ip = in, *iend = in + n, *op = out, *oend = out + size, *ref;
+	LONG nlit, mlen, offset;
+	int token, x;
+	for (;;) {
+		if ( ip >= iend ) return(-1);
+		token = *ip++;
+		nlit = token >> 4;
+		if ( nlit == 15 ) {
+			do {
+				if ( ip >= iend ) return(-1);
+				x = *ip++; nlit += x;
+			} while ( x == 255 );
+		}
+		if ( nlit > iend - ip || nlit > oend - op ) return(-1);
+		memcpy(op,ip,nlit);
+		op += nlit; ip += nlit;
+		if ( ip == iend ) break;
+		if ( iend - ip < 2 ) return(-1);
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		mlen = (token & 15) + FASTMINMATCH;
+		if ( ( token & 15 ) == 15 ) {
+			do {
+				if ( ip >= iend ) return(-1);
+				x = *ip++; mlen += x;
+			} while ( x == 255 );
+		}
+		if ( offset == 0 || offset > op - out || mlen > oend - op ) return(-1);
+		ref = op - offset;
+		while ( mlen-- > 0 ) *op++ = *ref++;
+	}
+	return(op-out);
+}
+
+/*
+  	#] FastCodec : 
+  	#[ VarintCodec :
+
+	The codec for SortCodec varint. It uses the same blocks as the codec
+	above, but the contents are the words of the terms, each written
+	as a variable length integer: seven bits per byte, starting with the
+	lowest bits, with the high bit set when more bytes follow. Negative
+	numbers are first mapped to odd numbers (0,-1,1,-2,... becomes 0,1,2,3,...).
+	ComPress/PutOut already remove the prefix that a term has in common
+	with the previous term. What remains are mainly the numbers of the
+	variables, their powers, the sizes of the subterms and the lengths of
+	the coefficients. These are small and take a single byte.
+*/
+
+static LONG VarintCompress(UBYTE *in, LONG n, UBYTE *out)
+{
+	UBYTE *op = out;
+	WORD w;
+	ULONG u;
+	LONG i;
+	for ( i = 0; i < n; i += sizeof(WORD) ) {
+		memcpy(&w,in+i,sizeof(WORD));
+		if ( w < 0 ) u = (((ULONG)(-(w+1))) << 1) | 1;
+		else         u = ((ULONG)w) << 1;
+		while ( u >= 0x80 ) { *op++ = (UBYTE)(u | 0x80); u >>= 7; }
+		*op++ = (UBYTE)u;
+	}
+	return(op-out);
+}
+
+static LONG VarintDecompress(UBYTE *in, LONG n, UBYTE *out, LONG size)
+{
+	UBYTE *ip = in, *iend = in + n, *op = out, *oend = out + size;
+	WORD w;
+	ULONG u;
+	int shift;
+	while ( ip < iend ) {
+		if ( oend - op < (LONG)sizeof(WORD) ) return(-1);
+		u = 0; shift = 0;
+		do {
+			if ( ip >= iend || shift >= (int)(8*sizeof(WORD)+7) ) return(-1);
+			u |= ((ULONG)(*ip & 0x7F)) << shift;
+			shift += 7;
+		} while ( *ip++ & 0x80 );
+		if ( u & 1 ) w = (WORD)(-(LONG)(u >> 1) - 1);
+		else         w = (WORD)(u >> 1);
+		memcpy(op,&w,sizeof(WORD));
+		op += sizeof(WORD);
+	}
+	return(op-out);
+}
+
+/*
+  	#] VarintCodec : 
+  	#[ WriteOutputFast :
+
+	Writes the compressed blocks in f->ziobuffer. With the block codecs
+	(SortCodec fast or varint) f->zsp->total_out is the number of bytes
+	in use in f->ziobuffer.
+*/
+
+static int WriteOutputFast(FILEHANDLE *f)
+{
+	LONG size = (LONG)(f->zsp->total_out);
+	if ( size <= 0 ) return(0);
+#ifdef ALLLOCK
+	LOCK(f->pthreadslock);
+#endif
+	SeekFile(f->handle,&(f->POposition),SEEK_SET);
+	if ( WriteFile(f->handle,(UBYTE *)(f->ziobuffer),size) != size ) {
+#ifdef ALLLOCK
+		UNLOCK(f->pthreadslock);
+#endif
+		MLOCK(ErrorMessageLock);
+		MesPrint("%wWrite error during compressed sort. Disk full?");
+		MUNLOCK(ErrorMessageLock);
+		return(-1);
+	}
+#ifdef ALLLOCK
+	UNLOCK(f->pthreadslock);
+#endif
+	ADDPOS(f->filesize,size);
+	ADDPOS(f->POposition,size);
+#ifdef WITHPTHREADS
+	if ( AS.MasterSort && AC.ThreadSortFileSynch ) {
+		if ( f->handle >= 0 ) SynchFile(f->handle);
+	}
+#endif
+	f->zsp->total_out = 0;
+	return(0);
+}
+
+/*
+  	#] WriteOutputFast : 
+  	#[ PutOutputFast :
+
+	The equivalent of PutOutputGZIP for the block codecs.
+	A block has at most half of f->ziosize bytes of input, such that the
+	reading side always has room for a complete block in its buffer.
+	It is a whole number of words, because the varint codec works on words.
+*/
+
+static int PutOutputFast(FILEHANDLE *f)
+{
+	UBYTE *in = (UBYTE *)(f->PObuffer), *out;
+	LONG n = (UBYTE *)(f->POfill) - in, block, size, c;
+	block = (f->ziosize - FASTHEAD) / 2;
+	if ( block > FASTBLOCK ) block = FASTBLOCK;
+	block -= block % sizeof(WORD);
+	while ( n > 0 ) {
+		size = n < block ? n : block;
+		if ( (LONG)(f->zsp->total_out) + FASTHEAD + FASTBOUND(size) > f->ziosize ) {
+			if ( WriteOutputFast(f) ) return(-1);
+		}
+		out = (UBYTE *)(f->ziobuffer) + f->zsp->total_out;
+		if ( AM.SortCodec == SORTCODECVARINT )
+			c = VarintCompress(in,size,out+FASTHEAD);
+		else
+			c = FastCompress(in,size,out+FASTHEAD);
+		FastPutSize(out,(ULONG)c);
+		FastPutSize(out+4,(ULONG)size);
+		f->zsp->total_out += FASTHEAD + c;
+		in += size;
+		n -= size;
+	}
+	return(0);
+}
+
+/*
+  	#] PutOutputFast : 
   	#[ SetupOutputGZIP :
 
 	Routine prepares a gzip output stream for the given file.
@@ -95,6 +374,10 @@ int SetupOutputGZIP(FILEHANDLE *f)
 			Terminate(-1);
 		}
 	}
+	if ( AM.SortCodec >= SORTCODECFAST ) {
+		f->zsp->total_out = 0;
+		return(0);
+	}
 /*
 	3: Set the default fields:
 */
@@ -142,6 +425,7 @@ int PutOutputGZIP(FILEHANDLE *f)
 {
 	GETIDENTITY
 	int zerror;
+	if ( AM.SortCodec >= SORTCODECFAST ) return(PutOutputFast(f));
 /*
 	First set the number of bytes in the input
 */
@@ -235,6 +519,10 @@ int FlushOutputGZIP(FILEHANDLE *f)
 {
 	GETIDENTITY
 	int zerror;
+	if ( AM.SortCodec >= SORTCODECFAST ) {
+		if ( PutOutputFast(f) ) return(-1);
+		return(WriteOutputFast(f));
+	}
 /*
 	Set the proper parameters
 */
@@ -427,7 +715,26 @@ int SetupAllInputGZIP(SORTING *S)
 		MesPrint("%wPreparing z-stream %d with compression %d",i,S->fpincompressed[i]);
 		MUNLOCK(ErrorMessageLock);
 #endif
-		if ( S->fpincompressed[i] ) {
+		if ( S->fpincompressed[i] >= SORTCODECFAST ) {
+/*
+			No zlib stream. next_out and avail_out refer to the decoded
+			bytes of the last block that still wait in the scratch space
+			of the stream.
+*/
+			if ( AN.zfastbuffers == 0 ) {
+				AN.zfastbuffers = (Bytef *)Malloc1(S->MaxFpatches*FASTBLOCK*sizeof(Bytef),"input fast buffers");
+			}
+			zsp = &(S->zsparray[i]);
+			zsp->zalloc = Z_NULL;
+			zsp->next_out  = AN.zfastbuffers + i * FASTBLOCK;
+			zsp->avail_out = 0;
+			zsp->total_out = 0;
+			zsp->next_in  = AN.ziobufnum[i];
+			zsp->avail_in = 0;
+			zsp->total_in = 0;
+			NumberOpened++;
+		}
+		else if ( S->fpincompressed[i] ) {
 			zsp = &(S->zsparray[i]);
 /*
 			1: Set the default fields:
@@ -466,6 +773,106 @@ int SetupAllInputGZIP(SORTING *S)
 
 /*
   	#] SetupAllInputGZIP : 
+  	#[ FillInputFast :
+
+	The equivalent of FillInputGZIP for a stream written with one of the
+	block codecs. The buffer is filled completely unless the stream is finished.
+	Blocks that fit are decoded directly into the buffer. Otherwise the
+	block goes to the scratch space of the stream and the remainder is
+	kept for the next call.
+*/
+
+static LONG FillInputFast(FILEHANDLE *f, POSITION *position, UBYTE *buffer, LONG buffersize, int numstream)
+{
+	GETIDENTITY
+	SORTING *S = AT.SS;
+	z_streamp zsp = &(S->zsparray[numstream]);
+	Bytef *scratch = AN.zfastbuffers + numstream * FASTBLOCK;
+	LONG got = 0, x, c, raw, toread, readsize;
+	int varint = S->fpincompressed[numstream] == SORTCODECVARINT;
+	POSITION pos;
+	for (;;) {
+		if ( zsp->avail_out > 0 ) {
+			x = buffersize - got;
+			if ( x > (LONG)(zsp->avail_out) ) x = zsp->avail_out;
+			memcpy(buffer+got,zsp->next_out,x);
+			zsp->next_out += x;
+			zsp->avail_out -= x;
+			got += x;
+		}
+		if ( got >= buffersize ) return(got);
+		if ( zsp->avail_in < FASTHEAD
+		|| (LONG)(zsp->avail_in) < FASTHEAD + FastGetSize(zsp->next_in) ) {
+/*
+			Move the incomplete block to the start and read more input
+*/
+			if ( zsp->avail_in > 0 && zsp->next_in != AN.ziobufnum[numstream] )
+				memmove(AN.ziobufnum[numstream],zsp->next_in,zsp->avail_in);
+			zsp->next_in = AN.ziobufnum[numstream];
+			toread = f->ziosize - zsp->avail_in;
+			if ( ISLESSPOS(S->fPatchesStop[numstream],*position) ) toread = 0;
+			else {
+				DIFPOS(pos,S->fPatchesStop[numstream],*position);
+				if ( BASEPOSITION(pos) < toread ) toread = (LONG)(BASEPOSITION(pos));
+			}
+			if ( toread > 0 ) {
+#ifdef ALLLOCK
+				LOCK(f->pthreadslock);
+#endif
+				SeekFile(f->handle,position,SEEK_SET);
+				readsize = ReadFile(f->handle,(UBYTE *)(zsp->next_in+zsp->avail_in),toread);
+				SeekFile(f->handle,position,SEEK_CUR);
+#ifdef ALLLOCK
+				UNLOCK(f->pthreadslock);
+#endif
+				if ( readsize < 0 ) {
+					MLOCK(ErrorMessageLock);
+					MesPrint("%wFillInputGZIP: Read error during compressed sort.");
+					MUNLOCK(ErrorMessageLock);
+					return(-1);
+				}
+				if ( ISLESSPOS(*position,S->fPatchesStop[numstream]) )
+					PrefetchFile(f->handle,position,f->ziosize);
+				ADDPOS(f->filesize,readsize);
+				ADDPOS(f->POposition,readsize);
+				zsp->avail_in += readsize;
+			}
+			if ( zsp->avail_in == 0 ) return(got);
+			if ( zsp->avail_in < FASTHEAD
+			|| (LONG)(zsp->avail_in) < FASTHEAD + FastGetSize(zsp->next_in) ) {
+				MLOCK(ErrorMessageLock);
+				MesPrint("%wFillInputGZIP: Incomplete block in stream %d.",numstream);
+				MUNLOCK(ErrorMessageLock);
+				return(-1);
+			}
+		}
+		c = FastGetSize(zsp->next_in);
+		raw = FastGetSize(zsp->next_in+4);
+		if ( raw > FASTBLOCK ) x = -1;
+		else if ( raw <= buffersize - got ) {
+			if ( varint ) x = VarintDecompress(zsp->next_in+FASTHEAD,c,buffer+got,raw);
+			else          x = FastDecompress(zsp->next_in+FASTHEAD,c,buffer+got,raw);
+			got += raw;
+		}
+		else {
+			if ( varint ) x = VarintDecompress(zsp->next_in+FASTHEAD,c,scratch,raw);
+			else          x = FastDecompress(zsp->next_in+FASTHEAD,c,scratch,raw);
+			zsp->next_out = scratch;
+			zsp->avail_out = raw;
+		}
+		if ( x != raw ) {
+			MLOCK(ErrorMessageLock);
+			MesPrint("%wFillInputGZIP: Corrupt block in stream %d.",numstream);
+			MUNLOCK(ErrorMessageLock);
+			return(-1);
+		}
+		zsp->next_in += FASTHEAD + c;
+		zsp->avail_in -= FASTHEAD + c;
+	}
+}
+
+/*
+  	#] FillInputFast : 
   	#[ FillInputGZIP :
 
 	Routine is called when we need new input in the specified buffer.
@@ -482,7 +889,10 @@ LONG FillInputGZIP(FILEHANDLE *f, POSITION *position, UBYTE *buffer, LONG buffer
 	SORTING *S = AT.SS;
 	z_streamp zsp;
 	POSITION pos;
-	if ( S->fpincompressed[numstream] ) {
+	if ( S->fpincompressed[numstream] >= SORTCODECFAST ) {
+		return(FillInputFast(f,position,buffer,buffersize,numstream));
+	}
+	else if ( S->fpincompressed[numstream] ) {
 		zsp = &(S->zsparray[numstream]);
 		zsp->next_out = (Bytef *)buffer;
 		zsp->avail_out = buffersize;
@@ -513,6 +923,8 @@ LONG FillInputGZIP(FILEHANDLE *f, POSITION *position, UBYTE *buffer, LONG buffer
 #ifdef ALLLOCK
 				UNLOCK(f->pthreadslock);
 #endif
+				if ( ISLESSPOS(*position,S->fPatchesStop[numstream]) )
+					PrefetchFile(f->handle,position,f->ziosize);
 #ifdef GZIPDEBUG
 				MLOCK(ErrorMessageLock);
 				{  char *s = AN.ziobufnum[numstream]+readsize;
@@ -616,6 +1028,8 @@ LONG FillInputGZIP(FILEHANDLE *f, POSITION *position, UBYTE *buffer, LONG buffer
 #ifdef ALLLOCK
 				UNLOCK(f->pthreadslock);
 #endif
+				if ( ISLESSPOS(*position,S->fPatchesStop[numstream]) )
+					PrefetchFile(f->handle,position,f->ziosize);
 #ifdef GZIPDEBUG
 				MLOCK(ErrorMessageLock);
 				{  char *s = AN.ziobufnum[numstream]+readsize;
@@ -710,6 +1124,7 @@ LONG FillInputGZIP(FILEHANDLE *f, POSITION *position, UBYTE *buffer, LONG buffer
 #ifdef ALLLOCK
 		UNLOCK(f->pthreadslock);
 #endif
+		if ( readsize == buffersize ) PrefetchFile(f->handle,position,buffersize);
 		if ( readsize < 0 ) {
 			MLOCK(ErrorMessageLock);
 			MesPrint("%wFillInputGZIP: Read error during uncompressed sort.");
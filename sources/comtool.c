@@ -606,19 +606,19 @@ void ClearTree(int i)
   	#[ IniFbuffer :
 */
 /**
- *	Initialize a factorization cache buffer.
+ *	Initialize a factorization cache buffer, or a PolyRatFun cache buffer.
  *	We set the size of the rhs and boomlijst buffers immediately
  *	to their final values.
  */
 
-int IniFbuffer(WORD bufnum)
+int IniFbuffer(WORD bufnum, int size)
 {
 	CBUF *C = cbuf + bufnum;
 	COMPTREE *root;
 	int i;
 	LONG fullsize;
-	C->maxrhs = AM.fbuffersize;
-	C->MaxTreeSize = AM.fbuffersize;
+	C->maxrhs = size;
+	C->MaxTreeSize = size;
 
 	/*
 	 * Note that bufnum is a return value of inicbufs(). So C has been already
@@ -429,7 +429,8 @@ static inline LONG ULongToLong(ULONG x)
 #define RWLOCKR(x)      while ( pthread_rwlock_tryrdlock(&(x)) == EBUSY ) {}
 #define RWLOCKW(x)      while ( pthread_rwlock_trywrlock(&(x)) == EBUSY ) {}
 #else
-#define LOCK(x)       pthread_mutex_lock(&(x))
+/* With the thread profile on a lock goes via LockProfiled */
+#define LOCK(x)       do { if ( AC.ThreadProfile ) LockProfiled(&(x)); else pthread_mutex_lock(&(x)); } while (0)
 #define RWLOCKR(x)      pthread_rwlock_rdlock(&(x))
 #define RWLOCKW(x)      pthread_rwlock_wrlock(&(x))
 #endif
@@ -478,6 +479,7 @@ extern WORD **DebugHeap1, **DebugHeap2;
 
 extern VOID   StartVariables();
 extern VOID   setSignalHandlers(VOID);
+extern VOID   resetSignalHandlers(VOID);
 extern UBYTE *CodeToLine(WORD,UBYTE *);
 extern UBYTE *AddArrayIndex(WORD ,UBYTE *);
 extern INDEXENTRY *FindInIndex(WORD,FILEDATA *,WORD,WORD);
@@ -615,6 +617,9 @@ extern int    FunMatchSy(PHEAD WORD *,WORD *,WORD *,WORD);
 extern int    MatchArgument(PHEAD WORD *,WORD *);
 extern WORD   MatchFunction(PHEAD WORD *,WORD *,WORD *);
 extern WORD   MergePatches(WORD);
+extern VOID   InitMergeIndex(SORTING *);
+extern VOID   AddMergeIndex(SORTING *,WORD *,POSITION *);
+extern WORD   ForkMergePatches(VOID);
 extern WORD   MesCerr(char *, UBYTE *);
 extern WORD   MesComp(char *, UBYTE *, UBYTE *);
 extern WORD   Modulus(WORD *);
@@ -643,6 +648,7 @@ extern WORD   Product(UWORD *,WORD *,WORD);
 extern VOID   PrtLong(UWORD *,WORD,UBYTE *);
 extern VOID   PrtTerms(VOID);
 extern VOID   PrintRunningTime(VOID);
+extern VOID   PrintRatFunCache(VOID);
 extern LONG   GetRunningTime(VOID);
 extern WORD   PutBracket(PHEAD WORD *);
 extern LONG   PutIn(FILEHANDLE *,POSITION *,WORD *,WORD **,int);
@@ -676,6 +682,16 @@ extern WORD   Simplify(PHEAD UWORD *,WORD *,UWORD *,WORD *);
 extern WORD   SortWild(WORD *,WORD);
 extern FILE  *LocateBase(char **,char **);
 extern LONG   SplitMerge(PHEAD WORD **,LONG);
+extern LONG   SplitMergeKeys(PHEAD WORD **,ULONG *,LONG);
+extern LONG   MergeRuns(PHEAD WORD **,LONG,LONG,LONG);
+extern VOID   SortPointers(PHEAD WORD **,WORD **,LONG);
+extern LONG   AddNeighbours(PHEAD WORD **,LONG);
+extern ULONG  SortKey(PHEAD WORD *);
+extern LONG   HashSmallBuffer(PHEAD WORD **,LONG);
+extern LONG   SortSmallBuffer(PHEAD WORD **,LONG);
+extern VOID   SortStatsStart(PHEAD0);
+extern VOID   SortStatsMerge(PHEAD char *,int,LONG,LONG,POSITION *,POSITION *,LONG,LONG,LONG);
+extern VOID   SortStatsEnd(PHEAD POSITION *);
 extern WORD   StoreTerm(PHEAD WORD *);
 extern VOID   SubPLon(UWORD *,WORD,UWORD *,WORD,UWORD *,WORD *);
 extern VOID   Substitute(PHEAD WORD *,WORD *,WORD);
@@ -810,6 +826,7 @@ extern void   FlushFile(int);
 extern int    GetPosFile(int,fpos_t *);
 extern int    SetPosFile(int,fpos_t *);
 extern VOID   SynchFile(int);
+extern VOID   PrefetchFile(int,POSITION *,LONG);
 extern VOID   TruncateFile(int);
 extern int    GetChannel(char *,int);
 extern int    GetAppendChannel(char *);
@@ -845,8 +862,10 @@ extern WORD   ToPolyFunGeneral(PHEAD WORD *);
 extern int    ToFast(WORD *,WORD *);
 extern SETUPPARAMETERS *GetSetupPar(UBYTE *);
 extern int    RecalcSetups(VOID);
+extern VOID   SortMemorySetups(LONG);
 extern int    AllocSetups(VOID);
-extern SORTING *AllocSort(LONG,LONG,LONG,LONG,int,int,LONG);
+extern SORTING *AllocSort(LONG,LONG,LONG,LONG,int,int,LONG,int);
+extern int    SortMemoryAdapts(int);
 extern VOID   AllocSortFileName(SORTING *);
 extern UBYTE *LoadInputFile(UBYTE *,int);
 extern UBYTE  GetInput(VOID);
@@ -1381,12 +1400,38 @@ extern int    PutToMaster(PHEAD WORD *);
 extern void   SetWorkerFiles(VOID);
 extern int    MakeThreadBuckets(int,int);
 extern int    SendOneBucket(int);
+extern void   MarkBucketFilled(THREADBUCKET *,int);
+extern int    ClaimBucket(THREADBUCKET *,int);
+extern THREADBUCKET *StealBucket(int);
+extern void   BookBucket(LONG,LONG,LONG);
+extern LONG   TuneBucketSize(LONG,LONG,LONG,LONG *);
+extern void   IniHandoffs(int);
+extern int    SpinForSignal(int *,int);
+extern void   PrintHandoffs(VOID);
+extern LONG   ProfileClock(VOID);
+extern int    ProfileSwitch(int,int);
+extern void   LockProfiled(pthread_mutex_t *);
+extern void   StartThreadProfile(VOID);
+extern int    WriteThreadProfile(VOID);
+extern void   IniNumaPlacement(int);
+extern int    AffinityIsRestricted(VOID);
+extern void   BindThreadToNode(int);
+extern void   BindMemoryToNode(WORD *,WORD *,int);
+extern void   IniSortHelps(VOID);
+extern LONG   HelpedSplitMerge(PHEAD WORD **,LONG);
+extern void   DoSortHelp(int);
+extern GCDHELP *GcdHelpParts(PHEAD LONG,int,int *);
+extern void   PostGcdHelps(GCDHELP *,int);
+extern void   CollectGcdHelps(PHEAD GCDHELP *,int);
+extern void   DoGcdHelp(int);
+extern void   MasterWaitAllHelping(VOID);
 extern int    LoadOneThread(int,int,THREADBUCKET *,int);
 extern void  *RunSortBot(void *);
 extern void   MasterWaitAllSortBots(VOID);
 extern int    SortBotMerge(PHEAD0);
 extern int    SortBotOut(PHEAD WORD *);
 extern void   DefineSortBotTree(VOID);
+extern void   PlanSortBotTree(VOID);
 extern int    SortBotMasterMerge(VOID);
 extern int    SortBotWait(int);
 extern void   StartIdentity(VOID);
@@ -1548,7 +1593,7 @@ extern int CoDo(UBYTE *);
 extern int CoEndDo(UBYTE *);
 extern int ExtraSymFun(PHEAD WORD *,WORD);
 extern int PruneExtraSymbols(WORD);
-extern int IniFbuffer(WORD);
+extern int IniFbuffer(WORD,int);
 extern void IniFbufs(VOID);
 extern int GCDfunction(PHEAD WORD *,WORD);
 extern WORD *GCDfunction3(PHEAD WORD *,WORD *);
@@ -1597,8 +1642,10 @@ extern VOID optimize_print_code (int);
 #ifdef WITHPTHREADS
 extern void find_Horner_MCTS_expand_tree();
 extern void find_Horner_MCTS_expand_tree_threaded();
+extern LONG find_Horner_MCTS_expand_tree_loop();
 extern void optimize_expression_given_Horner();
 extern void optimize_expression_given_Horner_threaded();
+extern void poly_gcd_image(PHEAD GCDHELP *);
 #endif
  
 extern int DoPreAdd(UBYTE *s);
@@ -253,7 +253,7 @@ int AssignDollar(PHEAD WORD *term, WORD level)
 #ifdef WITHPTHREADS
 		if ( dtype > 0 ) {
 /*			LOCK(d->pthreadslockwrite); */
-			LOCK(d->pthreadslockread);
+			RWLOCKW(d->pthreadslockread);
 NewValIsZero:;
 			switch ( d->type ) {
 				case DOLZERO: goto NoChangeZero;
@@ -279,7 +279,7 @@ NewValIsZero:;
 NoChangeZero:;
 			CleanDollarFactors(d);
 /*			UNLOCK(d->pthreadslockwrite); */
-			UNLOCK(d->pthreadslockread);
+			UNRWLOCK(d->pthreadslockread);
 			AN.ncmod = oldncmod;
 			return(0);
 		}
@@ -302,7 +302,7 @@ NoChangeZero:;
 #ifdef WITHPTHREADS
 		if ( dtype > 0 ) {
 /*			LOCK(d->pthreadslockwrite); */
-			LOCK(d->pthreadslockread);
+			RWLOCKW(d->pthreadslockread);
 			if ( d->size < 32 ) {
 				WORD oldsize, *oldwhere, i;
 				oldsize = d->size; oldwhere = d->where;
@@ -366,7 +366,7 @@ HandleDolZero:;
 NoChangeOne:;
 			CleanDollarFactors(d);
 /*			UNLOCK(d->pthreadslockwrite); */
-			UNLOCK(d->pthreadslockread);
+			UNRWLOCK(d->pthreadslockread);
 			AN.ncmod = oldncmod;
 			return(0);
 		}
@@ -400,7 +400,7 @@ NoChangeOne:;
 #ifdef WITHPTHREADS
 	if ( dtype == MODSUM ) {
 /*		LOCK(d->pthreadslockwrite); */
-		LOCK(d->pthreadslockread);
+		RWLOCKW(d->pthreadslockread);
 	}
 #endif
 	CleanDollarFactors(d);
@@ -448,7 +448,7 @@ NoChangeOne:;
 #ifdef WITHPTHREADS
 	if ( dtype != MODSUM ) {
 /*		LOCK(d->pthreadslockwrite); */
-		LOCK(d->pthreadslockread);
+		RWLOCKW(d->pthreadslockread);
 	}
 #endif
 	if ( numterms == 0 ) {
@@ -575,7 +575,7 @@ HandleDolZero1:;
 #ifdef WITHPTHREADS
 NoChange:;
 /*	UNLOCK(d->pthreadslockwrite); */
-	UNLOCK(d->pthreadslockread);
+	UNRWLOCK(d->pthreadslockread);
 #endif
 	AN.ncmod = oldncmod;
 	return(0);
@@ -1072,7 +1072,7 @@ WORD DolToTensor(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1106,7 +1106,7 @@ WORD DolToTensor(PHEAD WORD numdollar)
 		retval = 0;
 	}
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(retval);
 }
@@ -1133,7 +1133,7 @@ WORD DolToFunction(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1163,7 +1163,7 @@ WORD DolToFunction(PHEAD WORD numdollar)
 		retval = 0;
 	}
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(retval);
 }
@@ -1190,7 +1190,7 @@ WORD DolToVector(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1227,7 +1227,7 @@ WORD DolToVector(PHEAD WORD numdollar)
 		retval = 0;
 	}
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(retval);
 }
@@ -1313,7 +1313,7 @@ WORD DolToSymbol(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1340,7 +1340,7 @@ WORD DolToSymbol(PHEAD WORD numdollar)
 		retval = -1;
 	}
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(retval);
 }
@@ -1367,7 +1367,7 @@ WORD DolToIndex(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1416,7 +1416,7 @@ WORD DolToIndex(PHEAD WORD numdollar)
 		retval = 0;
 	}
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(retval);
 }
@@ -1553,7 +1553,7 @@ ShortArgument:
 	newd->size = size;
 	newd->numdummies = d->numdummies;
 #ifdef WITHPTHREADS
-	newd->pthreadslockread  = dummylock;
+	newd->pthreadslockread  = dummyrwlock;
 	newd->pthreadslockwrite = dummylock;
 #endif
 	size++;
@@ -1746,7 +1746,7 @@ int InsideDollar(PHEAD WORD *ll, WORD level)
 				}
 				else {
 /*					LOCK(d->pthreadslockwrite); */
-					LOCK(d->pthreadslockread);
+					RWLOCKW(d->pthreadslockread);
 				}
 			}
 		}
@@ -1791,7 +1791,7 @@ int InsideDollar(PHEAD WORD *ll, WORD level)
 #ifdef WITHPTHREADS
 		if ( dtype > 0 && dtype != MODLOCAL ) {
 /*			UNLOCK(d->pthreadslockwrite); */
-			UNLOCK(d->pthreadslockread);
+			UNRWLOCK(d->pthreadslockread);
 		}
 #endif
 		if ( newd->factors ) M_free(newd->factors,"Dollar factors");
@@ -1847,7 +1847,7 @@ LONG TermsInDollar(WORD num)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKR(d->pthreadslockread);
 			}
 		}
 	}
@@ -1868,7 +1868,7 @@ LONG TermsInDollar(WORD num)
 	else if ( d->type == DOLZERO ) n = 0;
 	else n = 1;
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(n);
 }
@@ -2895,14 +2895,14 @@ int DollarFactorize(PHEAD WORD numdollar)
 				d = ModOptdollars[nummodopt].dstruct+AT.identity;
 			}
 			else {
-				LOCK(d->pthreadslockread);
+				RWLOCKW(d->pthreadslockread);
 			}
 		}
 	}
 #endif
 	CleanDollarFactors(d);
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	if ( d->type != DOLTERMS ) {	/* only one term */
 		if ( d->type != DOLZERO ) d->nfactors = 1;
@@ -3152,13 +3152,13 @@ getout:
 		        Be careful: there should be more than one factor now.
 */
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { LOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { RWLOCKW(d->pthreadslockread); }
 #endif
 	if ( nfactors ==  1 && extrafactor == 0 ) {	/* we can use the buf1 contents */
 		if ( factorsincontent == 0 ) {
 			d->nfactors = 1;
 #ifdef WITHPTHREADS
-			if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+			if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 /*
 			We used here (before 3-sep-2015) the original and did not make
@@ -3210,7 +3210,7 @@ getout2:			AR.SortType = oldsorttype;
 					M_free(d->factors,"factors in dollar");
 					d->factors = 0;
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					M_free(buf3,"DollarFactorize-4");
 					if ( buf2 != buf1 && buf2 ) M_free(buf2,"DollarFactorize-4");
@@ -3454,7 +3454,7 @@ nextj:;
  		#] Step 8: 
 */
 #ifdef WITHPTHREADS
-	if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+	if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 	return(0);
 }
@@ -286,6 +286,8 @@ WORD PopVariables()
 	AC.WTimeStatsFlag = AM.gWTimeStatsFlag;
 	AC.ThreadsFlag = AM.gThreadsFlag;
 	AC.ThreadBalancing = AM.gThreadBalancing;
+	AC.ThreadWorkStealing = AM.gThreadWorkStealing;
+	AC.ThreadBucketAutotune = AM.gThreadBucketAutotune;
 	AC.ThreadSortFileSynch = AM.gThreadSortFileSynch;
 	AC.ProcessStats = AM.gProcessStats;
 	AC.OldParallelStats = AM.gOldParallelStats;
@@ -419,6 +421,8 @@ VOID MakeGlobal()
 	AM.gWTimeStatsFlag = AC.WTimeStatsFlag;
 	AM.gThreadsFlag = AC.ThreadsFlag;
 	AM.gThreadBalancing = AC.ThreadBalancing;
+	AM.gThreadWorkStealing = AC.ThreadWorkStealing;
+	AM.gThreadBucketAutotune = AC.ThreadBucketAutotune;
 	AM.gThreadSortFileSynch = AC.ThreadSortFileSynch;
 	AM.gProcessStats = AC.ProcessStats;
 	AM.gOldParallelStats = AC.OldParallelStats;
@@ -720,6 +724,28 @@ WORD DoExecute(WORD par, WORD skip)
 	else if ( AC.partodoflag == -1 ) {
 		AC.partodoflag = 0;
 	}
+#ifdef WITHPTHREADS
+/*
+	A sum, maximum or minimum $-variable that no statement of this module
+	can assign is read-only while the workers run. We drop it from the
+	list, so that they read it like any other global $-variable and never
+	take its lock. The list is emptied at the end of the module anyway.
+*/
+	if ( AS.MultiThreaded ) {
+		int k;
+		for ( i = j = 0; i < NumModOptdollars; i++ ) {
+			if ( ModOptdollars[i].type != MODLOCAL ) {
+				for ( k = 0; k < NumPotModdollars; k++ ) {
+					if ( PotModdollars[k] == ModOptdollars[i].number ) break;
+				}
+				if ( k >= NumPotModdollars ) continue;
+			}
+			if ( i != j ) ModOptdollars[j] = ModOptdollars[i];
+			j++;
+		}
+		NumModOptdollars = j;
+	}
+#endif
 #endif
 #ifdef WITHMPI
 	/*
@@ -834,11 +860,17 @@ WORD DoExecute(WORD par, WORD skip)
 	 * Turn on AS.printflag to print runtime errors occurring on slaves.
 	 */
 	AS.printflag = 1;
+#endif
+#ifdef WITHPTHREADS
+	if ( AC.ThreadProfile ) StartThreadProfile();
 #endif
 	if ( AP.preError == 0 && ( Processor() || WriteAll() ) ) RetCode = -1;
 #ifdef WITHMPI
 	AS.printflag = 0;
 #endif
+#ifdef WITHPTHREADS
+	if ( AC.ThreadProfile && WriteThreadProfile() ) RetCode = -1;
+#endif
 /*
 	That was it. Next is cleanup.
 */
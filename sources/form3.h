@@ -474,6 +474,7 @@ extern void   Uflush(FILES *);
 extern int    Ugetpos(FILES *,fpos_t *);
 extern int    Usetpos(FILES *,fpos_t *);
 extern void   Usetbuf(FILES *,char *);
+extern void   Uprefetch(FILES *,off_t,off_t);
 #define Usync(f) fsync(f->descriptor)
 #define Utruncate(f) { \
 	if ( ftruncate(f->descriptor, 0) ) { \
@@ -497,6 +498,7 @@ extern FILES *Ustdout;
 #define Uread(x,y,z,u) fread(x,y,z,u)
 #define Uwrite(x,y,z,u) fwrite(x,y,z,u)
 #define Usetbuf(x,y) setbuf(x,y)
+#define Uprefetch(x,y,z) ((void)(x))
 #define Useek(x,y,z) fseek(x,y,z)
 #define Utell(x) ftell(x)
 #define Ugetpos(x,y) fgetpos(x,y)
@@ -116,6 +116,7 @@
 #define SMAXPATCHES 64
 #define SMAXFPATCHES 64
 #define SSORTIOSIZE 32768L
+#define SORTMEMORYLEVELS 4
 
 #define SCRATCHSIZE 50000000L
 #define SPECTATORSIZE 1048576L
@@ -139,6 +140,11 @@
 #define DEFAULTTHREADS 0
 #define DEFAULTTHREADBUCKETSIZE 500
 #define DEFAULTTHREADLOADBALANCING 1
+#define DEFAULTTHREADSPIN 4000
+#define SORTHELPMINTERMS 2000
+#define MAXSORTHELPPARTS 8
+#define GCDHELPMINSIZE 2000
+#define MAXGCDHELPPARTS 8
 #define THREADSCRATCHSIZE 100000L
 #define THREADSCRATCHOUTSIZE 2500000L
 
@@ -159,6 +165,7 @@
 #define MAXMULTIBRACKETLEVELS 25
 
 #define FBUFFERSIZE 1026
+#define RFBUFFERSIZE 1026
 /*
 	For the random number generator (see commentary there)
 */
@@ -329,6 +329,10 @@ typedef int (*TFUN1)();
 #define SORTPOWERFIRST 2
 #define SORTANTIPOWER 3
 
+#define SORTCODECGZIP 1
+#define SORTCODECFAST 2
+#define SORTCODECVARINT 3
+
 #define NMIN4SHIFT 4
 /*
 	The next are the main codes.
@@ -924,6 +928,8 @@ typedef int (*TFUN1)();
 #define CLEARCLOCK 11
 #define MCTSEXPANDTREE 12
 #define OPTIMIZEEXPRESSION 13
+#define HELPSORT 14
+#define HELPGCD 15
 
 #define MASTERBUFFERISFULL 1
 
@@ -949,6 +955,39 @@ typedef int (*TFUN1)();
 
 #define BUCKETDOINGTERMS 0
 #define BUCKETDOINGBRACKET 1
+
+/*
+	States of a part of a sort or of an image of a gcd for which help
+	has been asked
+*/
+
+#define SORTHELPPOSTED 1
+#define SORTHELPTAKEN 2
+#define SORTHELPDONE 3
+#define SORTHELPWITHDRAWN 4
+
+/*
+	Categories of the thread profile (On threadprofile). The time of a
+	thread goes to one category at a time, see ProfileSwitch.
+*/
+
+#define PROFOTHER 0
+#define PROFGENERATOR 1
+#define PROFNORMALIZE 2
+#define PROFMATCH 3
+#define PROFSORT 4
+#define PROFWAIT 5
+#define PROFLOCK 6
+#define PROFITEMS 7
+
+/*
+	Bucket size autotuning (On threadbucketautotune). Handing out a bucket
+	may cost at most 1/AUTOBUCKETOVERHEAD of the work in it and a bucket
+	may grow to AUTOBUCKETGROWTH times the ThreadBucketSize.
+*/
+
+#define AUTOBUCKETOVERHEAD 20
+#define AUTOBUCKETGROWTH 8
 #endif
 
 /*
@@ -462,7 +462,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 								d = ModOptdollars[nummodopt].dstruct+AT.identity;
 							}
 							else {
-								LOCK(d->pthreadslockread);
+								RWLOCKR(d->pthreadslockread);
 							}
 						}
 					}
@@ -519,7 +519,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 						case DOLUNDEFINED:
 							if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-								if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								MLOCK(ErrorMessageLock);
 								MesPrint("$%s is undefined",AC.dollarnames->namebuffer+d->name);
@@ -536,7 +536,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 							|| d->where[2] < 0 || d->where[2] >= AM.OffsetIndex ) {
 								if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-									if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+									if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 									MLOCK(ErrorMessageLock);
 									MesPrint("$%s is of wrong type",AC.dollarnames->namebuffer+d->name);
@@ -556,7 +556,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 							}
 							else if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-								if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								MLOCK(ErrorMessageLock);
 								MesPrint("$%s is of wrong type",AC.dollarnames->namebuffer+d->name);
@@ -572,7 +572,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 							) {
 								if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-									if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+									if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 									MLOCK(ErrorMessageLock);
 									MesPrint("$%s is of wrong type",AC.dollarnames->namebuffer+d->name);
@@ -620,7 +620,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 							else {
 								if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-									if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+									if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 									MLOCK(ErrorMessageLock);
 									MesPrint("$%s is of wrong type",AC.dollarnames->namebuffer+d->name);
@@ -646,7 +646,7 @@ WORD DoIfStatement(PHEAD WORD *ifcode, WORD *term)
 generic:;
 							if ( AC.UnsureDollarMode == 0 ) {
 #ifdef WITHPTHREADS
-								if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								MLOCK(ErrorMessageLock);
 								MesPrint("$%s is of wrong type",AC.dollarnames->namebuffer+d->name);
@@ -658,7 +658,7 @@ generic:;
 					  }
 					}
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 				}
 				break;
@@ -437,7 +437,7 @@ va_dcl
 								d = ModOptdollars[nummodopt].dstruct+AT.identity;
 							}
 							else {
-								LOCK(d->pthreadslockread);
+								RWLOCKR(d->pthreadslockread);
 							}
 						}
 					}
@@ -492,7 +492,7 @@ printterms:				first = 1;
 							AddToLine((UBYTE *)Out);
 							if ( WriteInnerTerm(term,first) ) {
 #ifdef WITHPTHREADS
-								if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								Terminate(-1);
 							}
@@ -523,7 +523,7 @@ dosubterm:				if ( AC.LineLength > MAXLINELENGTH ) AC.LineLength = MAXLINELENGTH
 						AddToLine((UBYTE *)Out);
 						if ( WriteSubTerm(tt,1) ) {
 #ifdef WITHPTHREADS
-							if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							Terminate(-1);
 						}
@@ -627,7 +627,7 @@ dollarzero:				*t++ = '0'; *t = 0;
 						}
 					}
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					AN.listinprint += 2;
 					while ( AN.listinprint[0] == DOLLAREXPR2 ) AN.listinprint += 2;
@@ -351,6 +351,8 @@ VOID FullCleanUp()
 	if ( AC.ThreadsFlag && AM.totalnumberofthreads > 1 ) AS.MultiThreaded = 1;
 	AC.ThreadBucketSize = AM.gThreadBucketSize = AM.ggThreadBucketSize;
 	AC.ThreadBalancing = AM.gThreadBalancing = AM.ggThreadBalancing;
+	AC.ThreadWorkStealing = AM.gThreadWorkStealing = AM.ggThreadWorkStealing;
+	AC.ThreadBucketAutotune = AM.gThreadBucketAutotune = AM.ggThreadBucketAutotune;
 	AC.ThreadSortFileSynch = AM.gThreadSortFileSynch = AM.ggThreadSortFileSynch;
 	AC.ShortStatsMax = AM.gShortStatsMax = AM.ggShortStatsMax;
 	AC.SizeCommuteInSet = AM.gSizeCommuteInSet = 0;
@@ -682,7 +684,7 @@ UBYTE * DoModDollar(UBYTE *s, int type)
 							dlocal->where[i] = dglobal->where[i];
 						dlocal->where[dlocal->size] = 0;
 					}
-					dlocal->pthreadslockread = dummylock;
+					dlocal->pthreadslockread = dummyrwlock;
 					dlocal->pthreadslockwrite = dummylock;
 					dlocal->nfactors = dglobal->nfactors;
 					if ( dglobal->nfactors > 1 ) {
@@ -2420,7 +2420,7 @@ int AddDollar(UBYTE *name, WORD type, WORD *start, LONG size)
 	dol->zero = 0;
 	dol->numdummies = 0;
 #ifdef WITHPTHREADS
-	dol->pthreadslockread = dummylock;
+	dol->pthreadslockread = dummyrwlock;
 	dol->pthreadslockwrite = dummylock;
 #endif
 	dol->nfactors = 0;
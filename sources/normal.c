@@ -520,14 +520,14 @@ NextSymbol:;
 							d = ModOptdollars[nummodopt].dstruct+AT.identity;
 						}
 						else {
-							LOCK(d->pthreadslockread);
+							RWLOCKR(d->pthreadslockread);
 						}
 					}
 				}
 #endif
 				if ( d->type == DOLZERO ) {
 #ifdef WITHPTHREADS
-					if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					if ( t[3] == 0 ) goto NormZZ;
 					if ( t[3] < 0 ) goto NormInf;
@@ -543,7 +543,7 @@ NextSymbol:;
 					}
 					if ( nnum == 0 || ( nnum == 1 && lnum[0] == 0 ) ) {
 #ifdef WITHPTHREADS
-						if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+						if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 						if ( t[3] < 0 ) goto NormInf;
 						else if ( t[3] == 0 ) goto NormZZ;
@@ -554,7 +554,7 @@ NextSymbol:;
 					if ( t[3] < 0 ) {
 						if ( Divvy(BHEAD (UWORD *)n_coef,&ncoef,(UWORD *)lnum,nnum) ) {
 #ifdef WITHPTHREADS
-							if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							goto FromNorm;
 						}
@@ -562,7 +562,7 @@ NextSymbol:;
 					else if ( t[3] > 0 ) {
 						if ( Mully(BHEAD (UWORD *)n_coef,&ncoef,(UWORD *)lnum,nnum) ) {
 #ifdef WITHPTHREADS
-							if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							goto FromNorm;
 						}
@@ -572,7 +572,7 @@ NextSymbol:;
 				else if ( d->type == DOLINDEX ) {
 					if ( d->index == 0 ) {
 #ifdef WITHPTHREADS
-						if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+						if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 						goto NormZero;
 					}
@@ -643,7 +643,7 @@ IllDollarExp:
 					t[4] = AM.dbufnum;
 					if ( t[3] == 0 ) {
 #ifdef WITHPTHREADS
-						if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+						if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 						break;
 					}
@@ -652,7 +652,7 @@ IllDollarExp:
 					while ( t < m ) {
 						if ( *t == DOLLAREXPRESSION ) {
 #ifdef WITHPTHREADS
-							if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							d = Dollars + t[2];
 #ifdef WITHPTHREADS
@@ -666,7 +666,7 @@ IllDollarExp:
 										d = ModOptdollars[nummodopt].dstruct+AT.identity;
 									}
 									else {
-										LOCK(d->pthreadslockread);
+										RWLOCKR(d->pthreadslockread);
 									}
 								}
 							}
@@ -679,13 +679,13 @@ IllDollarExp:
 						t += t[1];
 					}
 #ifdef WITHPTHREADS
-					if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					goto RegEnd;
 				}
 				else {
 #ifdef WITHPTHREADS
-					if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					MLOCK(ErrorMessageLock);
 					MesPrint("!!!This $ variation has not been implemented yet!!!");
@@ -693,7 +693,7 @@ IllDollarExp:
 					goto NormMin;
 				}
 #ifdef WITHPTHREADS
-				if ( ptype > 0 && ptype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+				if ( ptype > 0 && ptype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 				}
 				else {
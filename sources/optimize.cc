@@ -143,6 +143,8 @@ set<pair<int,vector<WORD> > > mcts_best_schemes;
 
 #ifdef WITHPTHREADS
 pthread_mutex_t optimize_lock;
+int mcts_times;
+LONG mcts_start_time;
 #endif
 
 /*
@@ -1878,11 +1880,10 @@ inline static void next_MCTS_scheme (PHEAD vector<WORD> *porder, vector<WORD> *p
 			}
 		my_random_shuffle(BHEAD new_node.childs.begin(), new_node.childs.end());
 
-		// here locking is necessary, since operator=(tree_node) is a
-		// non-atomic operation (using pointers makes this lock obsolete)
-		LOCK(optimize_lock);
+		// in TForm the caller holds optimize_lock, because
+		// operator=(tree_node) replaces the vector of children that
+		// other threads may be traversing
 		*select = new_node;
-		UNLOCK(optimize_lock);
 	}
 	// set finished if necessary
 	if (select->childs.size()==0)
@@ -1957,17 +1958,12 @@ inline static void update_MCTS_scheme (int num_oper, const vector<WORD> &scheme,
 	vector<tree_node *> &path = *ppath;
 
 	// update the (global) list of best Horner scheme
+	// in TForm the caller holds optimize_lock
 	if ((int)mcts_best_schemes.size() < AO.Optimize.mctsnumkeep ||
 			(--mcts_best_schemes.end())->first > num_oper) {
-		// here locking is necessary, for otherwise best_schemes may
-		// become corrupted; lock can be prevented if each thread keeps
-		// track of it's own list and those lists are merged in the end,
-		// but this seems not useful to implement
-		LOCK(optimize_lock);
 		mcts_best_schemes.insert(make_pair(num_oper,scheme));
 		if ((int)mcts_best_schemes.size() > AO.Optimize.mctsnumkeep)
 			mcts_best_schemes.erase(--mcts_best_schemes.end());
-		UNLOCK(optimize_lock);
 	}
 
 	// MCTS step IV: backpropagate
@@ -2004,13 +2000,29 @@ void find_Horner_MCTS_expand_tree () {
 	// the number of operations obtained by the simulation
 	int num_oper;
 
+	// In TForm the selection, the expansion and the backpropagation
+	// change the shared tree and are done under optimize_lock. They are
+	// cheap compared to the simulation, which runs unlocked. The virtual
+	// loss makes that other threads select other paths meanwhile.
+#ifdef WITHPTHREADS
+	LOCK(optimize_lock);
+#endif
 	next_MCTS_scheme(BHEAD &order, &scheme, &path);
+#ifdef WITHPTHREADS
+	UNLOCK(optimize_lock);
+#endif
 	try_MCTS_scheme(BHEAD scheme, &num_oper);
 #ifdef DEBUG_MCTS
 	// Actually "order" is needed only for this debug output.
 	MesPrint ("{%a} -> {%a} -> %d", order.size(), &order[0], scheme.size(), &scheme[0], num_oper);
+#endif
+#ifdef WITHPTHREADS
+	LOCK(optimize_lock);
 #endif
 	update_MCTS_scheme(num_oper, scheme, &path);
+#ifdef WITHPTHREADS
+	UNLOCK(optimize_lock);
+#endif
 
 #ifdef DEBUG
 	MesPrint ("*** [%s, w=%w] DONE: find_Horner_MCTS_expand_tree(%a-> %d)",
@@ -2021,6 +2033,48 @@ void find_Horner_MCTS_expand_tree () {
 
 /*
   	#] find_Horner_MCTS_expand_tree : 
+  	#[ find_Horner_MCTS_expand_tree_loop :
+*/
+
+#ifdef WITHPTHREADS
+
+/**  Expand MCTS tree until done (TForm)
+ *
+ *	 Description
+ *	 ===========
+ *	 Each thread (the master included) claims the number of the next
+ *	 expansion and does it, until "mctsnumexpand" expansions have been
+ *	 claimed, the time limit is reached or the tree is finished. This
+ *	 way the master does not have to hand out each expansion separately
+ *	 and the workers do not sleep between the expansions.
+ *
+ *	 Returns the number of expansions this thread did.
+ */
+
+LONG find_Horner_MCTS_expand_tree_loop () {
+
+	GETIDENTITY;
+	LONG expansions = 0;
+
+	for (;;) {
+		LOCK(optimize_lock);
+		int times = mcts_times++;
+		bool done = times >= AO.Optimize.mctsnumexpand || mcts_root.finished ||
+			(AO.Optimize.mctstimelimit != 0 &&
+			 (TimeWallClock(1)-mcts_start_time)/100 >= AO.Optimize.mctstimelimit);
+		UNLOCK(optimize_lock);
+		if (done) break;
+		AT.optimtimes = times;
+		find_Horner_MCTS_expand_tree();
+		expansions++;
+	}
+	return expansions;
+}
+
+#endif
+
+/*
+  	#] find_Horner_MCTS_expand_tree_loop : 
   	#[ PF_find_Horner_MCTS_expand_tree :
 */
 #ifdef WITHMPI
@@ -2238,6 +2292,15 @@ void find_Horner_MCTS () {
 	// initialize a potential variable mctsconstant scheme.
 	AT.optimtimes = 0;
 
+#if defined(WITHPTHREADS)
+	// in TForm all threads expand the tree together
+	if (AM.totalnumberofthreads > 1) {
+		mcts_times = 0;
+		mcts_start_time = start_time;
+		find_Horner_MCTS_expand_tree_threaded();
+	}
+	else
+#endif
 	// call expand_tree until it is called "mctsnumexpand" times, the
 	// time limit is reached or the tree is fully finished
 	for (int times=0; times<AO.Optimize.mctsnumexpand && !mcts_root.finished &&
@@ -2245,11 +2308,7 @@ void find_Horner_MCTS () {
 			 times++) {
 		AT.optimtimes = times;
 	// call expand_tree routine depending on threading mode
-#if defined(WITHPTHREADS)
-		if (AM.totalnumberofthreads > 1)
-			find_Horner_MCTS_expand_tree_threaded();
-		else
-#elif defined(WITHMPI)
+#if defined(WITHMPI)
 		if (PF.numtasks > 1)
 			PF_find_Horner_MCTS_expand_tree_master();
 		else
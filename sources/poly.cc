@@ -351,6 +351,67 @@ int poly::monomial_compare (PHEAD const WORD *a, const WORD *b) {
 
 /*
   	#] monomial_compare : 
+  	#[ poly_packing :
+*/
+
+/*   Chooses the packed layout for monomials with at most "bound[i]" in
+ *   variable i. Returns false (and sets nwords=0) if the exponents do
+ *   not fit in POLY_PACKED_WORDS words or in the space of the unpacked
+ *   exponents of a heap element.
+ */
+bool poly_packing::setup (const WORD *bound, int n) {
+
+	nwords = 0;
+	word.resize(n);
+	shift.resize(n);
+	mask.resize(n);
+	for (int i=0; i<POLY_PACKED_WORDS; i++)
+		guard[i] = 0;
+
+	int w=0, used=0;
+	
+	for (int i=0; i<n; i++) {
+		if (bound[i] < 0) return false;
+
+		// one bit more than needed for the bound, for the guard
+		int width = 1;
+		for (WORD x=bound[i]; x>0; x>>=1) width++;
+
+		// fields do not straddle words
+		if (used+width > 64) {
+			w++;
+			used = 0;
+			if (w == POLY_PACKED_WORDS) return false;
+		}
+		used += width;
+		word[i] = w;
+		shift[i] = 64-used;
+		mask[i] = (((poly_packed)1) << (width-1)) - 1;
+		guard[w] |= ((poly_packed)1) << (64-used+width-1);
+	}
+
+	if ((LONG)(n*sizeof(WORD)) < (LONG)((w+1)*sizeof(poly_packed))) return false;
+	
+	nwords = w+1;
+	return true;
+}
+
+// packs the exponents "e" in "k"
+void poly_packing::pack (const WORD *e, poly_packed *k) const {
+	for (int i=0; i<nwords; i++)
+		k[i] = 0;
+	for (int i=0; i<(int)word.size(); i++)
+		k[word[i]] |= ((poly_packed)e[i]) << shift[i];
+}
+
+// unpacks the exponents in "k" to "e"
+void poly_packing::unpack (const poly_packed *k, WORD *e) const {
+	for (int i=0; i<(int)word.size(); i++)
+		e[i] = (WORD)((k[word[i]] >> shift[i]) & mask[i]);
+}
+
+/*
+  	#] poly_packing : 
   	#[ normalize :
 */
 
@@ -542,13 +603,16 @@ void poly::add (const poly &a, const poly &b, poly &c) {
 	UWORD *modq=NULL;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (c.modp!=0) {
 		if (c.modn == 1) {
 			modq = (UWORD *)&c.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(c.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD c.modp,c.modn,&modq,&nmodq);
@@ -580,8 +644,8 @@ void poly::add (const poly &a, const poly &b, poly &c) {
 			c.termscopy(&a[ai],ci,MaX(a[ai],b[bi]));
 			WORD nc=0;
 			if (both_mod_small) {
-				c[ci+1+AN.poly_num_vars] = ((LONG)a[ai+1+AN.poly_num_vars]*a[ai+a[ai]-1]+
-																		(LONG)b[bi+1+AN.poly_num_vars]*b[bi+b[bi]-1]) % c.modp;
+				c[ci+1+AN.poly_num_vars] = pmod.reduce((LONG)a[ai+1+AN.poly_num_vars]*a[ai+a[ai]-1]+
+																		(LONG)b[bi+1+AN.poly_num_vars]*b[bi+b[bi]-1]);
 				if ((WORD)c[ci+1+AN.poly_num_vars] > +c.modp/2) c[ci+1+AN.poly_num_vars] -= c.modp;
 				if ((WORD)c[ci+1+AN.poly_num_vars] < -c.modp/2) c[ci+1+AN.poly_num_vars] += c.modp;
 				nc = (c[ci+1+AN.poly_num_vars]==0 ? 0 : SGN((WORD)c[ci+1+AN.poly_num_vars]));
@@ -626,13 +690,16 @@ void poly::sub (const poly &a, const poly &b, poly &c) {
 	UWORD *modq=NULL;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (c.modp!=0) {
 		if (c.modn == 1) {
 			modq = (UWORD *)&c.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(c.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD c.modp,c.modn,&modq,&nmodq);
@@ -665,8 +732,8 @@ void poly::sub (const poly &a, const poly &b, poly &c) {
 			c.termscopy(&a[ai],ci,MaX(a[ai],b[bi]));
 			WORD nc=0;
 			if (both_mod_small) {
-				c[ci+1+AN.poly_num_vars] = ((LONG)a[ai+1+AN.poly_num_vars]*a[ai+a[ai]-1]-
-																		(LONG)b[bi+1+AN.poly_num_vars]*b[bi+b[bi]-1]) % c.modp;
+				c[ci+1+AN.poly_num_vars] = pmod.reduce((LONG)a[ai+1+AN.poly_num_vars]*a[ai+a[ai]-1]-
+																		(LONG)b[bi+1+AN.poly_num_vars]*b[bi+b[bi]-1]);
 				if ((WORD)c[ci+1+AN.poly_num_vars] > +c.modp/2) c[ci+1+AN.poly_num_vars] -= c.modp;
 				if ((WORD)c[ci+1+AN.poly_num_vars] < -c.modp/2) c[ci+1+AN.poly_num_vars] += c.modp;
 				nc = (c[ci+1+AN.poly_num_vars]==0 ? 0 : SGN((WORD)c[ci+1+AN.poly_num_vars]));
@@ -700,29 +767,30 @@ void poly::sub (const poly &a, const poly &b, poly &c) {
 */
 
 // pops the largest monomial from the heap and stores it in heap[n]
-void poly::pop_heap (PHEAD WORD **heap, int n) {
+// (if "pk" is given, the heap elements have packed exponents)
+void poly::pop_heap (PHEAD WORD **heap, int n, const poly_packing *pk) {
 
 	WORD *old = heap[0];
-	
-	heap[0] = heap[--n];
+	WORD *last = heap[--n];
 
+	// move the hole at the top down to a leaf along the largest children
 	int i=0;
-	while (2*i+2<n && (monomial_compare(BHEAD heap[2*i+1]+3, heap[i]+3)>0 ||
-										 monomial_compare(BHEAD heap[2*i+2]+3, heap[i]+3)>0)) {
-		
-		if (monomial_compare(BHEAD heap[2*i+1]+3, heap[2*i+2]+3)>0) {
-			swap(heap[i], heap[2*i+1]);
-			i=2*i+1;
-		}
-		else {
-			swap(heap[i], heap[2*i+2]);
-			i=2*i+2;
-		}
+	while (2*i+1 < n) {
+		int child = 2*i+1;
+		if (child+1<n && heap_compare(BHEAD heap[child+1], heap[child], pk)>0)
+			child++;
+
+		heap[i] = heap[child];
+		i = child;
 	}
 
-	if (2*i+1<n && monomial_compare(BHEAD heap[2*i+1]+3, heap[i]+3)>0) 
-		swap(heap[i], heap[2*i+1]);
+	// the last element usually belongs near the bottom: move it up
+	while (i>0 && heap_compare(BHEAD last, heap[(i-1)/2], pk) > 0) {
+		heap[i] = heap[(i-1)/2];
+		i=(i-1)/2;
+	}
 
+	heap[i] = last;
 	heap[n] = old;
 }
 
@@ -732,14 +800,17 @@ void poly::pop_heap (PHEAD WORD **heap, int n) {
 */
 
 // pushes the monomial in heap[n] onto the heap
-void poly::push_heap (PHEAD WORD **heap, int n)  {
+void poly::push_heap (PHEAD WORD **heap, int n, const poly_packing *pk)  {
 
 	int i=n-1;
+	WORD *p = heap[i];
 
-	while (i>0 && monomial_compare(BHEAD heap[i]+3, heap[(i-1)/2]+3) > 0) {
-		swap(heap[(i-1)/2], heap[i]);
+	while (i>0 && heap_compare(BHEAD p, heap[(i-1)/2], pk) > 0) {
+		heap[i] = heap[(i-1)/2];
 		i=(i-1)/2;
 	}
+
+	heap[i] = p;
 }
 
 /*
@@ -758,13 +829,16 @@ void poly::mul_one_term (const poly &a, const poly &b, poly &c) {
 	UWORD *modq=NULL;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (c.modp!=0) {
 		if (c.modn == 1) {
 			modq = (UWORD *)&c.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(c.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD c.modp,c.modn,&modq,&nmodq);
@@ -783,8 +857,8 @@ void poly::mul_one_term (const poly &a, const poly &b, poly &c) {
 			// if both polynomials are modulo p^1, use integer calculus
 			if (both_mod_small) {
 				c[ci+1+AN.poly_num_vars] =
-					((LONG)a[ai+1+AN.poly_num_vars] * a[ai+2+AN.poly_num_vars] *
-					 b[bi+1+AN.poly_num_vars] * b[bi+2+AN.poly_num_vars]) % c.modp;
+					pmod.reduce((LONG)a[ai+1+AN.poly_num_vars] * a[ai+2+AN.poly_num_vars] *
+					 b[bi+1+AN.poly_num_vars] * b[bi+2+AN.poly_num_vars]);
 				nc = (c[ci+1+AN.poly_num_vars]==0 ? 0 : 1);
 			}
 			else {
@@ -830,13 +904,16 @@ void poly::mul_univar (const poly &a, const poly &b, poly &c, int var) {
 	UWORD *modq=NULL;
 
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (c.modp!=0) {
 		if (c.modn == 1) {
 			modq = (UWORD *)&c.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(c.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD c.modp,c.modn,&modq,&nmodq);
@@ -877,9 +954,9 @@ void poly::mul_univar (const poly &a, const poly &b, poly &c, int var) {
 				// if both polynomials are modulo p^1, use integer calculus
 				if (both_mod_small) {
 					c[ci+1+AN.poly_num_vars] =
-						((nc==0 ? 0 : (LONG)c[ci+1+AN.poly_num_vars] * nc) +
+						pmod.reduce((nc==0 ? 0 : (LONG)c[ci+1+AN.poly_num_vars] * nc) +
 						(LONG)a[ai+1+AN.poly_num_vars] * a[ai+2+AN.poly_num_vars] *
-						 b[bi+1+AN.poly_num_vars] * b[bi+2+AN.poly_num_vars]) % c.modp;
+						 b[bi+1+AN.poly_num_vars] * b[bi+2+AN.poly_num_vars]);
 					nc = (c[ci+1+AN.poly_num_vars]==0 ? 0 : 1);
 				}
 				else {
@@ -953,6 +1030,10 @@ void poly::mul_univar (const poly &a, const poly &b, poly &c, int var) {
  *   - h[3] = length of coefficient with sign
  *   - h[4...4+AN.poly_num_vars-1] = powers 
  *   - h[4+AN.poly_num_vars...4+h[3]-1] = coefficient
+ *
+ *   If the powers of the product fit in a few machine words (see
+ *   poly_packing), they are stored packed, so that comparing and
+ *   multiplying monomials takes one integer operation per word.
  */
 void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 
@@ -962,13 +1043,16 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 	UWORD *modq=NULL;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (c.modp!=0) {
 		if (c.modn == 1) {
 			modq = (UWORD *)&c.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(c.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD c.modp,c.modn,&modq,&nmodq);
@@ -1010,6 +1094,39 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 		nhash *= maxpower[i]+1;
 	}
 
+	// if possible, pack the powers of the terms of a and b (indexed by
+	// the position of the term) and calculate their contribution to the
+	// hash code
+	poly_packing packing;
+	const poly_packing *pk = NULL;
+	int nw = 0;
+	vector<poly_packed> akey, bkey;
+	vector<int> ahash, bhash;
+	WORD lastkey[POLY_PACKED_WORDS*sizeof(poly_packed)/sizeof(WORD)];
+	bool havelast = false;
+
+	if (packing.setup(maxpower, AN.poly_num_vars)) {
+		pk = &packing;
+		nw = packing.nwords;
+		akey.resize(nw*a[0]);
+		bkey.resize(nw*b[0]);
+		for (int ai=1; ai<a[0]; ai+=a[ai])
+			packing.pack(&a[ai+1], &akey[nw*ai]);
+		for (int bi=1; bi<b[0]; bi+=b[bi])
+			packing.pack(&b[bi+1], &bkey[nw*bi]);
+
+		if (use_hash) {
+			ahash.resize(a[0]);
+			bhash.resize(b[0]);
+			for (int ai=1; ai<a[0]; ai+=a[ai])
+				for (int i=0; i<AN.poly_num_vars; i++)
+					ahash[ai] = (maxpower[i]+1)*ahash[ai] + a[ai+1+i];
+			for (int bi=1; bi<b[0]; bi+=b[bi])
+				for (int i=0; i<AN.poly_num_vars; i++)
+					bhash[bi] = (maxpower[i]+1)*bhash[bi] + b[bi+1+i];
+		}
+	}
+
 	// allocate heap and hash
 	int nheap=a.number_of_terms();
 
@@ -1024,6 +1141,12 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 		heap[i][3] = 0;
 		for (int j=0; j<AN.poly_num_vars; j++)
 			heap[i][4+j] = MAXPOSITIVE;
+		if (pk != NULL) {
+			poly_packed top[POLY_PACKED_WORDS];
+			for (int j=0; j<nw; j++)
+				top[j] = ~(poly_packed)0;
+			packing.put(&heap[i][4], top);
+		}
 	}
 	
 	WORD **hash = AT.pWorkSpace + AT.pWorkPointer + nheap;
@@ -1037,7 +1160,7 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 
 		c.check_memory(ci);
 		
-		pop_heap(BHEAD heap, nheap--);
+		pop_heap(BHEAD heap, nheap--, pk);
 		WORD *p = heap[nheap];
 
 		// if non-zero
@@ -1047,10 +1170,19 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 			c[0] = ci;
 
 			// append this term to the result
-			if (use_hash || ci==1 || monomial_compare(BHEAD p+3, c.last_monomial())!=0) {
+			if (use_hash || ci==1 || (pk != NULL ?
+					!havelast || pk->compare(p+4, lastkey)!=0 :
+					monomial_compare(BHEAD p+3, c.last_monomial())!=0)) {
 				p[4 + AN.poly_num_vars + ABS(p[3])] = p[3];
 				p[3] = 2 + AN.poly_num_vars + ABS(p[3]);
 				c.termscopy(&p[3],ci,p[3]);
+				if (pk != NULL) {
+					poly_packed k[POLY_PACKED_WORDS];
+					packing.get(p+4, k);
+					packing.put(lastkey, k);
+					packing.unpack(k, &c[ci+1]);
+					havelast = true;
+				}
 				ci += c[ci];
 			}
 			else {
@@ -1060,7 +1192,7 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 
 				// if both polynomials are modulo p^1, use integer calculus
 				if (both_mod_small) {
-					c[ci+AN.poly_num_vars+1] = ((LONG)c[ci+AN.poly_num_vars+1]*nc + p[4+AN.poly_num_vars]*p[3]) % c.modp;
+					c[ci+AN.poly_num_vars+1] = pmod.reduce((LONG)c[ci+AN.poly_num_vars+1]*nc + p[4+AN.poly_num_vars]*p[3]);
 					if (c[ci+1+AN.poly_num_vars]==0)
 						nc = 0;
 					else {
@@ -1085,19 +1217,36 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 					ci += c[ci];
 					c[ci-1] = nc;
 				}
+				else {
+					// the last term has vanished
+					havelast = false;
+				}
 			}
 		}
 
 		// add new term to the heap (ai, bi+1)
 		while (p[1] < b[0]) {
-			
-			for (int j=0; j<AN.poly_num_vars; j++)
-				p[4+j] = a[p[0]+1+j] + b[p[1]+1+j];
+
+			int ID = 0;
+
+			if (pk != NULL) {
+				poly_packed k[POLY_PACKED_WORDS];
+				packing.add(&akey[nw*p[0]], &bkey[nw*p[1]], k);
+				packing.put(p+4, k);
+				if (use_hash) ID = ahash[p[0]] + bhash[p[1]];
+			}
+			else {
+				for (int j=0; j<AN.poly_num_vars; j++)
+					p[4+j] = a[p[0]+1+j] + b[p[1]+1+j];
+				if (use_hash)
+					for (int i=0; i<AN.poly_num_vars; i++)
+						ID = (maxpower[i]+1)*ID + p[4+i];
+			}
 
 			// if both polynomials are modulo p^1, use integer calculus
 			if (both_mod_small) {
-				p[4+AN.poly_num_vars] = ((LONG)a[p[0]+1+AN.poly_num_vars]*a[p[0]+a[p[0]]-1]*
-																 b[p[1]+1+AN.poly_num_vars]*b[p[1]+b[p[1]]-1]) % c.modp;
+				p[4+AN.poly_num_vars] = pmod.reduce((LONG)a[p[0]+1+AN.poly_num_vars]*a[p[0]+a[p[0]]-1]*
+																 b[p[1]+1+AN.poly_num_vars]*b[p[1]+b[p[1]]-1]);
 				if (p[4+AN.poly_num_vars]==0)
 					p[3]=0;
 				else {
@@ -1120,15 +1269,11 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 			p[1] += b[p[1]];
 
 			if (use_hash) {
-				int ID = 0;
-				for (int i=0; i<AN.poly_num_vars; i++)
-					ID = (maxpower[i]+1)*ID + p[4+i];
-
 				// if hash and unused, push onto heap
 				if (hash[ID] == NULL) {
 					p[2] = ID;
 					hash[ID] = p;
-					push_heap(BHEAD heap, ++nheap);
+					push_heap(BHEAD heap, ++nheap, pk);
 					break;
 				}
 				else {
@@ -1136,7 +1281,7 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 					WORD *h = hash[ID];
 					// if both polynomials are modulo p^1, use integer calculus
 					if (both_mod_small) {
-						h[4+AN.poly_num_vars] = ((LONG)p[4+AN.poly_num_vars]*p[3] + h[4+AN.poly_num_vars]*h[3]) % c.modp;
+						h[4+AN.poly_num_vars] = pmod.reduce((LONG)p[4+AN.poly_num_vars]*p[3] + h[4+AN.poly_num_vars]*h[3]);
 						if (h[4+AN.poly_num_vars]==0) 
 							h[3]=0;
 						else {
@@ -1160,7 +1305,7 @@ void poly::mul_heap (const poly &a, const poly &b, poly &c) {
 			else {
 				// if no hash, push onto heap
 				p[2] = -1;
-				push_heap(BHEAD heap, ++nheap);
+				push_heap(BHEAD heap, ++nheap, pk);
 				break;
 			}
 		}
@@ -1251,13 +1396,16 @@ void poly::divmod_one_term (const poly &a, const poly &b, poly &q, poly &r, bool
 	UWORD *ltbinv=NULL;
 
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (q.modp!=0) {
 		if (q.modn == 1) {
 			modq = (UWORD *)&q.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(q.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD q.modp,q.modn,&modq,&nmodq);
@@ -1301,7 +1449,7 @@ void poly::divmod_one_term (const poly &a, const poly &b, poly &q, poly &r, bool
 				// if both polynomials are modulo p^1, use integer calculus
 				if (both_mod_small) {
 					q[qi+1+AN.poly_num_vars] =
-						((LONG)a[ai+1+AN.poly_num_vars] * a[ai+a[ai]-1] * ltbinv[0] * nltbinv) % q.modp;
+						pmod.reduce((LONG)a[ai+1+AN.poly_num_vars] * a[ai+a[ai]-1] * ltbinv[0] * nltbinv);
 					nq = (q[qi+1+AN.poly_num_vars]==0 ? 0 : 1);
 				}
 				else {
@@ -1380,13 +1528,16 @@ void poly::divmod_univar (const poly &a, const poly &b, poly &q, poly &r, int va
 	UWORD *ltbinv=NULL;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (q.modp!=0) {
 		if (q.modn == 1) {
 			modq = (UWORD *)&q.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(q.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD q.modp,q.modn,&modq,&nmodq);
@@ -1444,8 +1595,8 @@ void poly::divmod_univar (const poly &a, const poly &b, poly &q, poly &r, int va
 				// if both polynomials are modulo p^1, use integer calculus
 
 				if (both_mod_small) {
-					s[0] = ((WORD)s[0]*ns - (LONG)b[bi+1+AN.poly_num_vars] * b[bi+b[bi]-1] *
-									q[qj+1+AN.poly_num_vars] * q[qj+q[qj]-1]) % q.modp;
+					s[0] = pmod.reduce((WORD)s[0]*ns - (LONG)b[bi+1+AN.poly_num_vars] * b[bi+b[bi]-1] *
+									q[qj+1+AN.poly_num_vars] * q[qj+q[qj]-1]);
 					ns = (s[0]==0 ? 0 : 1);
 				}
 				else {
@@ -1479,7 +1630,7 @@ void poly::divmod_univar (const poly &a, const poly &b, poly &q, poly &r, int va
 				}
 				else {
 					if (both_mod_small) {
-						q[qi+1+AN.poly_num_vars] = ((LONG)s[0]*ns*ltbinv[0]*nltbinv) % q.modp;
+						q[qi+1+AN.poly_num_vars] = pmod.reduce((LONG)s[0]*ns*ltbinv[0]*nltbinv);
 						if ((WORD)q[qi+1+AN.poly_num_vars] > +q.modp/2) q[qi+1+AN.poly_num_vars] -= q.modp;
 						if ((WORD)q[qi+1+AN.poly_num_vars] < -q.modp/2) q[qi+1+AN.poly_num_vars] += q.modp;
 						ns = (q[qi+1+AN.poly_num_vars]==0 ? 0 : SGN((WORD)q[qi+1+AN.poly_num_vars]));
@@ -1571,11 +1722,48 @@ void poly::divmod_univar (const poly &a, const poly &b, poly &q, poly &r, int va
 
  *   For details, see M. Monagan, "Polynomial Division using Dynamic
  *   Array, Heaps, and Packed Exponent Vectors"
+ *
+ *   Implementation
+ *   ==============
+ *   As in mul_heap, the powers are packed if possible. The bound
+ *   used for the packing is twice the maximum power in a and b; if a
+ *   product of a term of b and the quotient does not fit, the
+ *   division is restarted with unpacked powers.
  */
 void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool only_divides, bool check_div, bool &div_fail) {
 
 	POLY_GETIDENTITY(a);
 
+	vector<WORD> bound(AN.poly_num_vars, 0);
+
+	for (int ai=1; ai<a[0]; ai+=a[ai])
+		for (int j=0; j<AN.poly_num_vars; j++)
+			bound[j] = MaX(bound[j], a[ai+1+j]);
+	for (int bi=1; bi<b[0]; bi+=b[bi])
+		for (int j=0; j<AN.poly_num_vars; j++)
+			bound[j] = MaX(bound[j], b[bi+1+j]);
+	for (int j=0; j<AN.poly_num_vars; j++)
+		bound[j] = bound[j] > MAXPOSITIVE/2 ? -1 : 2*bound[j];
+
+	poly_packing packing;
+
+	if (AN.poly_num_vars==0 || !packing.setup(&bound[0], AN.poly_num_vars) ||
+			!divmod_heap_kernel(a,b,q,r,only_divides,check_div,div_fail,&packing))
+		divmod_heap_kernel(a,b,q,r,only_divides,check_div,div_fail,NULL);
+}
+
+/*
+  	#] divmod_heap : 
+  	#[ divmod_heap_kernel :
+*/
+
+/*   The actual division of divmod_heap, with packed powers if "pk" is
+ *   given. Returns false if the packed powers overflow.
+ */
+bool poly::divmod_heap_kernel (const poly &a, const poly &b, poly &q, poly &r, bool only_divides, bool check_div, bool &div_fail, const poly_packing *pk) {
+
+	POLY_GETIDENTITY(a);
+
 	div_fail = false;
 	q[0] = r[0] = 1;
 	
@@ -1587,13 +1775,16 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 	LONG oldpWorkPointer = AT.pWorkPointer;
 	
 	bool both_mod_small=false;
+	poly_modulus pmod;
 	
 	if (q.modp!=0) {
 		if (q.modn == 1) {
 			modq = (UWORD *)&q.modp;
 			nmodq = 1;
-			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1)
+			if (a.modp>0 && b.modp>0 && a.modn==1 && b.modn==1) {
 				both_mod_small=true;
+				pmod = poly_modulus(q.modp);
+			}
 		}
 		else {
 			RaisPowCached(BHEAD q.modp,q.modn,&modq,&nmodq);
@@ -1617,12 +1808,31 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 	
 	for (int i=0; i<nb; i++) 
 		heap[i] = (WORD *) NumberMalloc("poly::div_heap-b");
+
+	// packed powers of the terms of a, b and q (indexed by the position
+	// of the term), of the leading term of b and of the current term t
+	int nw = pk!=NULL ? pk->nwords : 0;
+	vector<poly_packed> akey, bkey, qkey;
+	poly_packed lbkey[POLY_PACKED_WORDS], tkey[POLY_PACKED_WORDS];
+	bool overflow = false;
+
+	if (pk != NULL) {
+		akey.resize(nw*a[0]);
+		bkey.resize(nw*b[0]);
+		for (int ai=1; ai<a[0]; ai+=a[ai])
+			pk->pack(&a[ai+1], &akey[nw*ai]);
+		for (int bi=1; bi<b[0]; bi+=b[bi])
+			pk->pack(&b[bi+1], &bkey[nw*bi]);
+		pk->pack(&b[2], lbkey);
+	}
+	
 	int nheap = 1;
 	heap[0][0] = 1;
 	heap[0][1] = 0;
 	heap[0][2] = -1;
 	WCOPY(&heap[0][3], &a[1], a[1]);
 	heap[0][3] = a[a[1]];
+	if (pk != NULL) pk->put(&heap[0][4], &akey[nw]);
 	
 	int qi=1, ri=1;
 
@@ -1650,7 +1860,7 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 				// extract element from the heap and prepare adding new ones
 				this_insert = false;
 
-				pop_heap(BHEAD heap, nheap--);
+				pop_heap(BHEAD heap, nheap--, pk);
 				p = heap[nheap];
 				
 				if (t[0] == -1) {
@@ -1659,7 +1869,7 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 				else {
 					// if both polynomials are modulo p^1, use integer calculus
 					if (both_mod_small) {
-						t[4+AN.poly_num_vars] = ((LONG)t[4+AN.poly_num_vars]*t[3] + p[4+AN.poly_num_vars]*p[3]) % q.modp;
+						t[4+AN.poly_num_vars] = pmod.reduce((LONG)t[4+AN.poly_num_vars]*t[3] + p[4+AN.poly_num_vars]*p[3]);
 						if (t[4+AN.poly_num_vars]==0)
 							t[3]=0;
 						else {
@@ -1696,6 +1906,7 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 					if (p[0]==a[0]) break;
 					WCOPY(&p[3], &a[p[0]], a[p[0]]);
 					p[3] = p[2+p[3]];
+					if (pk != NULL) pk->put(&p[4], &akey[nw*p[0]]);
 				}			
 				else {
 					if (!this_insert)
@@ -1704,13 +1915,23 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 					
 					if (p[1]==qi) {	s++; break; }
 
-					for (int i=0; i<AN.poly_num_vars; i++)
-						p[4+i] = b[p[0]+1+i] + q[p[1]+1+i];
+					if (pk != NULL) {
+						poly_packed k[POLY_PACKED_WORDS];
+						if (!pk->add(&bkey[nw*p[0]], &qkey[nw*p[1]], k)) {
+							overflow = true;
+							break;
+						}
+						pk->put(&p[4], k);
+					}
+					else {
+						for (int i=0; i<AN.poly_num_vars; i++)
+							p[4+i] = b[p[0]+1+i] + q[p[1]+1+i];
+					}
 					
 					// if both polynomials are modulo p^1, use integer calculus
 					if (both_mod_small) {
-						p[4+AN.poly_num_vars] = ((LONG)b[p[0]+1+AN.poly_num_vars]*b[p[0]+b[p[0]]-1]*
-																		 q[p[1]+1+AN.poly_num_vars]*q[p[1]+q[p[1]]-1]) % q.modp;
+						p[4+AN.poly_num_vars] = pmod.reduce((LONG)b[p[0]+1+AN.poly_num_vars]*b[p[0]+b[p[0]]-1]*
+																		 q[p[1]+1+AN.poly_num_vars]*q[p[1]+q[p[1]]-1]);
 						if (p[4+AN.poly_num_vars]==0)
 							p[3]=0;
 						else {
@@ -1737,18 +1958,27 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 
 				// add it to a heap element
 				swap (heap[nheap],p);
-				push_heap(BHEAD heap, ++nheap);
+				push_heap(BHEAD heap, ++nheap, pk);
 				break;
 			}
 		}
-		while (t[0]==-1 || (nheap>0 && monomial_compare(BHEAD heap[0]+3, t+3)==0));
+		while (!overflow && (t[0]==-1 || (nheap>0 && heap_compare(BHEAD heap[0], t, pk)==0)));
 
+		if (overflow) break;
+		
 		if (t[3] == 0) continue;
 		
 		// check divisibility 
 		bool div = true;
-		for (int i=0; i<AN.poly_num_vars; i++)
-			if (t[4+i] < b[2+i]) div=false;
+		poly_packed qtkey[POLY_PACKED_WORDS];
+		if (pk != NULL) {
+			pk->get(&t[4], tkey);
+			div = pk->divides(tkey, lbkey, qtkey);
+		}
+		else {
+			for (int i=0; i<AN.poly_num_vars; i++)
+				if (t[4+i] < b[2+i]) div=false;
+		}
 		
 		if (!div) {
 			// not divisible, so append it to the remainder
@@ -1756,6 +1986,7 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 			t[4 + AN.poly_num_vars + ABS(t[3])] = t[3];
 			t[3] = 2 + AN.poly_num_vars + ABS(t[3]);
 			r.termscopy(&t[3], ri, t[3]);
+			if (pk != NULL) pk->unpack(tkey, &r[ri+1]);
 			ri += t[3];
 		}
 		else {
@@ -1777,7 +2008,7 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 			else {
 				// if both polynomials are modulo p^1, use integer calculus
 				if (both_mod_small) {
-					q[qi+1+AN.poly_num_vars] = ((LONG)t[4+AN.poly_num_vars]*t[3]*ltbinv[0]*nltbinv) % q.modp;
+					q[qi+1+AN.poly_num_vars] = pmod.reduce((LONG)t[4+AN.poly_num_vars]*t[3]*ltbinv[0]*nltbinv);
 					if (q[qi+1+AN.poly_num_vars]==0)
 						nq=0;
 					else {
@@ -1806,16 +2037,28 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 				s=1;
 				
 				q[qi] = 2+AN.poly_num_vars+ABS(nq);
-				for (int i=0; i<AN.poly_num_vars; i++)
-					q[qi+1+i] = t[4+i] - b[2+i];
+				if (pk != NULL) {
+					if ((int)qkey.size() < nw*(qi+1)) qkey.resize(2*nw*(qi+1));
+					for (int i=0; i<nw; i++)
+						qkey[nw*qi+i] = qtkey[i];
+					pk->unpack(qtkey, &q[qi+1]);
+				}
+				else {
+					for (int i=0; i<AN.poly_num_vars; i++)
+						q[qi+1+i] = t[4+i] - b[2+i];
+				}
 				qi += q[qi];
 				q[qi-1] = nq;
 			}
 
 			if (nr != 0) {
 				r[ri] = 2+AN.poly_num_vars+ABS(nr);
-				for (int i=0; i<AN.poly_num_vars; i++)
-					r[ri+1+i] = t[4+i];
+				if (pk != NULL)
+					pk->unpack(tkey, &r[ri+1]);
+				else {
+					for (int i=0; i<AN.poly_num_vars; i++)
+						r[ri+1+i] = t[4+i];
+				}
 				ri += r[ri];
 				r[ri-1] = nr;
 			}
@@ -1832,10 +2075,12 @@ void poly::divmod_heap (const poly &a, const poly &b, poly &q, poly &r, bool onl
 
 	if (q.modp!=0||ltbinv!=NULL) NumberFree(ltbinv,"poly::div_heap-a");
 	AT.pWorkPointer = oldpWorkPointer;
+
+	return !overflow;
 }
 
 /*
-  	#] divmod_heap : 
+  	#] divmod_heap_kernel : 
   	#[ divmod :
 */
 
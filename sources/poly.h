@@ -46,6 +46,70 @@ extern "C" {
 
 const int POLY_MAX_HASH_SIZE = MiN(1<<20, MAXPOSITIVE);
 
+// maximum number of 64-bit words for the packed exponents of a monomial
+
+const int POLY_PACKED_WORDS = 2;
+
+typedef unsigned INT64 poly_packed;
+
+/*   Layout of the exponents of a monomial packed in one or two 64-bit
+ *   words, as used by mul_heap and divmod_heap. The first variable is in
+ *   the highest bits of the first word, so that the lexicographic order
+ *   of the monomials is the order of the words as unsigned integers. The
+ *   highest bit of each field is a guard bit: it is zero in a valid
+ *   monomial and it catches overflows and failed subtractions.
+ *   A heap element stores its packed exponents in the space of the
+ *   unpacked ones, so packing is only done when they fit there.
+ */
+class poly_packing {
+
+public:
+
+	std::vector<int> word, shift;    // position of the field of each variable
+	std::vector<poly_packed> mask;
+	poly_packed guard[POLY_PACKED_WORDS];
+	int nwords;                      // 0: the exponents are not packed
+
+	poly_packing (): nwords(0) {}
+
+	bool setup (const WORD *, int);
+	void pack (const WORD *, poly_packed *) const;
+	void unpack (const poly_packed *, WORD *) const;
+
+	bool add (const poly_packed *, const poly_packed *, poly_packed *) const;
+	bool divides (const poly_packed *, const poly_packed *, poly_packed *) const;
+
+	// access to the packed exponents stored in a WORD array
+	void get (const WORD *, poly_packed *) const;
+	void put (WORD *, const poly_packed *) const;
+	int compare (const WORD *, const WORD *) const;
+
+	PADPOINTER(0,1,0,0);
+};
+
+// Barrett reduction needs the high word of a 64x64-bit product
+
+#if defined(__SIZEOF_INT128__) && BITSINLONG == 64
+#define POLY_BARRETT
+#endif
+
+/*   Reduction modulo a WORD-sized modulus p, for the arithmetic modulo
+ *   p^1 with LONGs. reduce(x) gives x%p, with the sign of x. With
+ *   POLY_BARRETT the division is replaced by Barrett reduction: the
+ *   product with the precomputed floor((2^64-1)/p) gives the quotient
+ *   up to one.
+ */
+class poly_modulus {
+
+public:
+
+	ULONG p, inv;
+
+	poly_modulus (WORD _p=0): p(_p), inv(_p>0 ? ~(ULONG)0/(ULONG)_p : 0) {}
+
+	LONG reduce (LONG) const;
+};
+
 class poly {
 
 public:
@@ -158,9 +222,11 @@ public:
 	static void divmod_one_term (const poly &, const poly &, poly &, poly &, bool);
 	static void divmod_univar (const poly &, const poly &, poly &, poly &, int, bool);
 	static void divmod_heap (const poly &, const poly &, poly &, poly &, bool, bool, bool&);
+	static bool divmod_heap_kernel (const poly &, const poly &, poly &, poly &, bool, bool, bool&, const poly_packing *);
 	
-	static void push_heap (PHEAD WORD **, int);
-	static void pop_heap (PHEAD WORD **, int);
+	static void push_heap (PHEAD WORD **, int, const poly_packing * =NULL);
+	static void pop_heap (PHEAD WORD **, int, const poly_packing * =NULL);
+	static int heap_compare (PHEAD const WORD *, const WORD *, const poly_packing *);
 
 	PADPOINTER(1,0,2,0);
 };
@@ -212,3 +278,68 @@ inline const WORD& poly::operator[] (int i) const {
 inline void poly::termscopy (const WORD *source, int dest, int num) {
 	memcpy (terms+dest, source, num*sizeof(WORD));
 }
+
+// x%p, with the sign of x (without branches, since the signs of the
+// coefficients are unpredictable)
+inline LONG poly_modulus::reduce (LONG x) const {
+#ifdef POLY_BARRETT
+	ULONG s = -(ULONG)(x<0);
+	ULONG u = ((ULONG)x ^ s) - s;
+	ULONG r = u - (ULONG)(((unsigned __int128)u * inv) >> 64) * p;
+	r -= p & -(ULONG)(r >= p);
+	return (LONG)((r ^ s) - s);
+#else
+	return x % (LONG)p;
+#endif
+}
+
+/*   Compares two heap elements by their exponents, either packed or not
+ */
+inline int poly::heap_compare (PHEAD const WORD *a, const WORD *b, const poly_packing *pk) {
+	if (pk != NULL) return pk->compare(a+4, b+4);
+	return monomial_compare(BHEAD a+3, b+3);
+}
+
+// the packed exponents are copied word by word, since the WORD array
+// need not be aligned (a copy of fixed size compiles to a single load)
+inline void poly_packing::get (const WORD *a, poly_packed *k) const {
+	for (int i=0; i<nwords; i++)
+		memcpy (k+i, (const char *)a + i*sizeof(poly_packed), sizeof(poly_packed));
+}
+
+inline void poly_packing::put (WORD *a, const poly_packed *k) const {
+	for (int i=0; i<nwords; i++)
+		memcpy ((char *)a + i*sizeof(poly_packed), k+i, sizeof(poly_packed));
+}
+
+// c = a*b; returns false if an exponent overflows its field
+inline bool poly_packing::add (const poly_packed *a, const poly_packed *b, poly_packed *c) const {
+	poly_packed over = 0;
+	for (int i=0; i<nwords; i++) {
+		c[i] = a[i] + b[i];
+		over |= c[i] & guard[i];
+	}
+	return over == 0;
+}
+
+// c = a/b; returns false if b does not divide a
+inline bool poly_packing::divides (const poly_packed *a, const poly_packed *b, poly_packed *c) const {
+	for (int i=0; i<nwords; i++) {
+		// a borrow from a field clears its guard bit
+		c[i] = (a[i] | guard[i]) - b[i];
+		if ((c[i] & guard[i]) != guard[i]) return false;
+		c[i] &= ~guard[i];
+	}
+	return true;
+}
+
+// compares two packed monomials (0:equal, <0:a smaller, >0:b smaller)
+inline int poly_packing::compare (const WORD *a, const WORD *b) const {
+	for (int i=0; i<nwords; i++) {
+		poly_packed ka, kb;
+		memcpy (&ka, (const char *)a + i*sizeof(poly_packed), sizeof(poly_packed));
+		memcpy (&kb, (const char *)b + i*sizeof(poly_packed), sizeof(poly_packed));
+		if (ka != kb) return ka > kb ? 1 : -1;
+	}
+	return 0;
+}
@@ -495,6 +495,7 @@ const poly polygcd::substitute(const poly &a, int x, int c) {
 		return b;
 	}
 
+	poly_modulus pmod(a.modp);
 	bool zero=true;
 	int bi=1;
 
@@ -546,13 +547,13 @@ const poly polygcd::substitute(const poly &a, int x, int c) {
 		if (pow<(int)cache.size()) {
 			if (cache[pow]==0) 
 				cache[pow] = RaisPowMod(c, pow, a.modp);
-			coeff = (coeff * cache[pow]) % a.modp;
+			coeff = pmod.reduce(coeff * cache[pow]);
 		}
 		else {
-			coeff = (coeff * RaisPowMod(c, pow, a.modp)) % a.modp;
+			coeff = pmod.reduce(coeff * RaisPowMod(c, pow, a.modp));
 		}
 		
-		b[bi+AN.poly_num_vars+1] = (coeff + b[bi+AN.poly_num_vars+1]) % a.modp;
+		b[bi+AN.poly_num_vars+1] = pmod.reduce(coeff + b[bi+AN.poly_num_vars+1]);
 		if (b[bi+AN.poly_num_vars+1] != 0) zero=false;
 	}
 
@@ -573,6 +574,7 @@ const vector<int> polygcd::sparse_interpolation_get_mul_list (const poly &a, con
 	// the number of terms of the polynomial and a constant
 	vector<vector<WORD> > cache(c.size());
 	int max_cache_size = min(2*a.number_of_terms(),POLYGCD_RAISPOWMOD_CACHE_SIZE);
+	poly_modulus pmod(a.modp);
 	for (int i=0; i<(int)c.size(); i++)
 		cache[i] = vector<WORD>(min(a.degree(x[i+1])+1,max_cache_size), 0);
 	
@@ -584,10 +586,10 @@ const vector<int> polygcd::sparse_interpolation_get_mul_list (const poly &a, con
 			if (pow<(int)cache[j].size()) {
 				if (cache[j][pow]==0) 
 					cache[j][pow] = RaisPowMod(c[j], pow, a.modp);
-				coeff = (coeff * cache[j][pow]) % a.modp;
+				coeff = pmod.reduce(coeff * cache[j][pow]);
 			}
 			else {
-				coeff = (coeff * RaisPowMod(c[j], pow, a.modp)) % a.modp;
+				coeff = pmod.reduce(coeff * RaisPowMod(c[j], pow, a.modp));
 			}
 		}
 		res.push_back(coeff);
@@ -597,8 +599,9 @@ const vector<int> polygcd::sparse_interpolation_get_mul_list (const poly &a, con
 
 // Multiplies the coefficients of a with the entries of mul
 void polygcd::sparse_interpolation_mul_poly (poly &a, const vector<int> &mul) {
+	poly_modulus pmod(a.modp);
 	for (int i=1,j=0; i<a[0]; i+=a[i],j++) 
-		a[i+a[i]-2] = ((LONG)a[i+a[i]-2]*mul[j]) % a.modp;
+		a[i+a[i]-2] = pmod.reduce((LONG)a[i+a[i]-2]*mul[j]);
 }
 
 // Sets all coefficients to the range 0..modp-1 and the powers of x2...xn to 0
@@ -620,6 +623,7 @@ const poly polygcd::sparse_interpolation_fix_poly (const poly &a, int x) {
 	
 	POLY_GETIDENTITY(a);
 	poly res(BHEAD 0,a.modp,1);
+	poly_modulus pmod(a.modp);
 
 	int j=1;
 	bool newterm=true;
@@ -628,7 +632,7 @@ const poly polygcd::sparse_interpolation_fix_poly (const poly &a, int x) {
 		if (newterm)
 			res.termscopy(&a[i], j, a[i]);
 		else 
-			res[j+res[j]-2] = ((LONG)res[j+res[j]-2] + a[i+a[i]-2]) % a.modp;
+			res[j+res[j]-2] = pmod.reduce((LONG)res[j+res[j]-2] + a[i+a[i]-2]);
 		
 		newterm = i+a[i] == a[0] || res[j+1+x] != a[i+a[i]+1+x];
 		if (newterm && res[j+res[j]-2]!=0) j += res[j];
@@ -809,6 +813,7 @@ const poly polygcd::gcd_modular_sparse_interpolation (const poly &origa, const p
 	}
 
 	// solve the linear equations
+	poly_modulus pmod(a.modp);
 	for (int i=0; i<(int)M.size(); i++) {
 		int n = M[i].size();
 
@@ -817,22 +822,22 @@ const poly polygcd::gcd_modular_sparse_interpolation (const poly &origa, const p
 			for (int k=0; k<j; k++) {
 				LONG x = M[i][j][k];
 				for (int l=k; l<n; l++) 
-					M[i][j][l] = (M[i][j][l] - M[i][k][l]*x) % a.modp;
-				V[i][j] = (V[i][j] - V[i][k]*x) % a.modp;
+					M[i][j][l] = pmod.reduce(M[i][j][l] - M[i][k][l]*x);
+				V[i][j] = pmod.reduce(V[i][j] - V[i][k]*x);
 			}
 			
 			// normalize row
 			WORD x = M[i][j][j]; // WORD for GetModInverses
 			GetModInverses(x + (x<0?a.modp:0), a.modp, &x, NULL);
 			for (int k=0; k<n; k++) 
-				M[i][j][k] = (M[i][j][k]*x) % a.modp;
-			V[i][j] = (V[i][j]*x) % a.modp;
+				M[i][j][k] = pmod.reduce(M[i][j][k]*x);
+			V[i][j] = pmod.reduce(V[i][j]*x);
 		}
 
 		// solve
 		for (int j=n-1; j>=0; j--)
 			for (int k=j+1; k<n; k++) 
-				V[i][j] = (V[i][j] - M[i][j][k]*V[i][k]) % a.modp;
+				V[i][j] = pmod.reduce(V[i][j] - M[i][j][k]*V[i][k]);
 	}
 
 	// create coefficient list
@@ -999,6 +1004,112 @@ const poly polygcd::gcd_modular_dense_interpolation (const poly &a, const poly &
 
 /*
   	#] gcd_modular_dense_interpolation : : 
+	 	#[ gcd_modular_image :
+*/
+
+/**  Image of the gcd modulo a prime
+ *
+ *   Description
+ *   ===========
+ *   Calculates the gcd of a and b modulo the prime p with
+ *   "gcd_modular_dense_interpolation", with the shape d of the
+ *   previous images as a hint, and normalizes it such that its
+ *   leading coefficient is g modulo p. The result is one of the
+ *   POLYGCD_IMAGE values: whether the image can be used, whether the
+ *   prime should be skipped or whether everything has to start again.
+ */
+int polygcd::gcd_modular_image (const poly &a, const poly &b, const poly &g, const vector<int> &x, const poly &d, WORD p, poly &c) {
+
+	if (poly(a.integer_lcoeff(),p).is_zero()) return POLYGCD_IMAGE_BADPRIME;
+	if (poly(b.integer_lcoeff(),p).is_zero()) return POLYGCD_IMAGE_BADPRIME;
+
+	c = gcd_modular_dense_interpolation(poly(a,p),poly(b,p),x,poly(d,p));
+	c = (c * poly(g,p)) / c.integer_lcoeff(); // normalize so that lcoeff(c) = g mod p
+
+	// unlucky choices somewhere
+	if (c.is_zero()) return POLYGCD_IMAGE_UNLUCKY;
+		
+	if (!(poly(a,p)%c).is_zero()) return POLYGCD_IMAGE_BADPRIME;
+	if (!(poly(b,p)%c).is_zero()) return POLYGCD_IMAGE_BADPRIME;
+
+	return POLYGCD_IMAGE_OK;
+}
+
+/*
+  	#] gcd_modular_image : 
+	 	#[ gcd_modular_images :
+*/
+
+#ifdef WITHPTHREADS
+
+/**  Images of the gcd modulo several primes at once
+ *
+ *   Description
+ *   ===========
+ *   In TFORM a gcd is calculated inside the term of one worker. When
+ *   the gcd is big, the other workers may be idle at the end of the
+ *   module. In that case (see GcdHelpParts in threads.c) the images
+ *   modulo the next primes are given to them, while this worker
+ *   calculates the first one. The images that nobody has started with
+ *   by then are not calculated at all. The images come back in the
+ *   order of the primes and "gcd_modular" combines them one by one, as
+ *   before.
+ *
+ *   Notes
+ *   =====
+ *   - The vectors are empty when there is no help.
+ *   - At most want images are made. All of them use the same shape d.
+ */
+void polygcd::gcd_modular_images (const poly &a, const poly &b, const poly &g, const vector<int> &x, const poly &d, int want, int &pnum, vector<WORD> &primes, vector<poly> &images, vector<int> &status) {
+
+	POLY_GETIDENTITY(a);
+
+	primes.clear();
+	images.clear();
+	status.clear();
+
+	int parts;
+	GCDHELP *h = GcdHelpParts(BHEAD a[0]+b[0], want, &parts);
+	if (h == NULL) return;
+
+	for (int i=0; i<parts; i++) {
+		h[i].a = const_cast<WORD *>(&a[0]);
+		h[i].b = const_cast<WORD *>(&b[0]);
+		h[i].g = const_cast<WORD *>(&g[0]);
+		h[i].d = const_cast<WORD *>(&d[0]);
+		h[i].x = x.empty() ? NULL : const_cast<int *>(&x[0]);
+		h[i].numx = x.size();
+		h[i].numvars = AN.poly_num_vars;
+		h[i].prime = NextPrime(BHEAD pnum++);
+		h[i].result = NULL;
+	}
+
+	PostGcdHelps(h, parts);
+	poly c(BHEAD 0);
+	int s = gcd_modular_image(a,b,g,x,d,h[0].prime,c);
+	CollectGcdHelps(BHEAD h, parts);
+
+	primes.push_back(h[0].prime);
+	images.push_back(c);
+	status.push_back(s);
+	
+	for (int i=1; i<parts; i++) {
+		if (h[i].result == NULL) continue; // withdrawn
+		poly e(BHEAD 0, h[i].prime, 1);
+		e.check_memory(h[i].result[0]);
+		e.termscopy(h[i].result, 0, h[i].result[0]);
+		M_free(h[i].result, "gcd image");
+		h[i].result = NULL;
+		primes.push_back(h[i].prime);
+		images.push_back(e);
+		status.push_back(h[i].status);
+	}
+}
+
+#endif
+
+/*
+  	#] gcd_modular_images : 
 	 	#[ gcd_modular :
 */
 
@@ -1009,7 +1120,13 @@ const poly polygcd::gcd_modular_dense_interpolation (const poly &a, const poly &
  *   This method choose a prime number and calls the method
  *   "gcd_modular_dense_interpolation" to calculate the gcd modulo
  *   this prime. It continues choosing more primes and constructs a
- *   final result with the Chinese Remainder Algorithm.
+ *   final result with the Chinese Remainder Algorithm. In TFORM idle
+ *   workers may calculate the images for the next primes in the
+ *   meantime (see "gcd_modular_images"). Because most gcds are found
+ *   with the first prime, this starts only after the result of the
+ *   first prime has failed the test, and the number of images asked
+ *   for is the number that is in the result so far, so that at most
+ *   half of them can be wasted.
  *
  *   Notes
  *   =====
@@ -1043,25 +1160,51 @@ const poly polygcd::gcd_modular (const poly &origa, const poly &origb, const vec
 	poly m1(BHEAD 1);
 	int mindeg=MAXPOSITIVE;
 
+#ifdef WITHPTHREADS
+	vector<WORD> primes;
+	vector<poly> images;
+	vector<int> status;
+	int next=0, numimages=0;
+#endif
+
 	while (true) {
 		// choose a prime and solve modulo the prime
-		WORD p = NextPrime(BHEAD pnum++);
-		if (poly(a.integer_lcoeff(),p).is_zero()) continue;
-		if (poly(b.integer_lcoeff(),p).is_zero()) continue;
+		WORD p;
+		poly c(BHEAD 0);
+		int res;
+
+#ifdef WITHPTHREADS
+		if (next == (int)primes.size() && numimages > 0) {
+			gcd_modular_images(a,b,g,x,d,numimages+1,pnum,primes,images,status);
+			next = 0;
+		}
+		if (next < (int)primes.size()) {
+			p = primes[next];
+			c = images[next];
+			res = status[next];
+			next++;
+		}
+		else
+#endif
+		{
+			p = NextPrime(BHEAD pnum++);
+			res = gcd_modular_image(a,b,g,x,d,p,c);
+		}
 
-		poly c(gcd_modular_dense_interpolation(poly(a,p),poly(b,p),x,poly(d,p)));
-		c = (c * poly(g,p)) / c.integer_lcoeff(); // normalize so that lcoeff(c) = g mod p
+		if (res == POLYGCD_IMAGE_BADPRIME) continue;
 
-		if (c.is_zero()) {
+		if (res == POLYGCD_IMAGE_UNLUCKY) {
 			// unlucky choices somewhere, so start all over again
 			d = poly(BHEAD 0);
 			m1 = poly(BHEAD 1);
 			mindeg = MAXPOSITIVE;
+#ifdef WITHPTHREADS
+			// the rest of the batch was made with the old shape
+			next = primes.size();
+			numimages = 0;
+#endif
 			continue;
 		}
-		
-		if (!(poly(a,p)%c).is_zero()) continue;
-		if (!(poly(b,p)%c).is_zero()) continue;
 
 		int deg = c.degree(x[0]);
 
@@ -1072,6 +1215,10 @@ const poly polygcd::gcd_modular (const poly &origa, const poly &origb, const vec
 			d.modn=a.modn;
 			m1 = poly(BHEAD p);
 			mindeg=deg;
+#ifdef WITHPTHREADS
+			next = primes.size();
+			numimages = 1;
+#endif
 		}
 		else if (deg == mindeg) {
 			// same degree, so use Chinese Remainder Algorithm
@@ -1102,6 +1249,9 @@ const poly polygcd::gcd_modular (const poly &origa, const poly &origb, const vec
 
 			m1 *= poly(BHEAD p);
 			d=newd;
+#ifdef WITHPTHREADS
+			numimages++;
+#endif
 		}
 
 		// divide out spurious integer content
@@ -47,6 +47,11 @@ const int POLYGCD_HEURISTIC_MAX_ADD_RANDOM = 10;
 // maximum cached power in substitute_last and sparse_interpolation_get_mul_list
 const int POLYGCD_RAISPOWMOD_CACHE_SIZE = 1000;
 
+// outcomes of gcd_modular_image
+const int POLYGCD_IMAGE_OK = 0;
+const int POLYGCD_IMAGE_BADPRIME = 1; // skip this prime
+const int POLYGCD_IMAGE_UNLUCKY = 2;  // start all over again
+
 namespace polygcd {
 
 	// functions to call the gcd routines
@@ -63,6 +68,10 @@ namespace polygcd {
 	const poly gcd_heuristic (const poly &a, const poly &b, const std::vector<int> &x, int max_tries=POLYGCD_HEURISTIC_MAX_TRIES);
 	const poly gcd_Euclidean (const poly &a, const poly &b);
 	const poly gcd_modular (const poly &a, const poly &b, const std::vector<int> &x);
+	int gcd_modular_image (const poly &a, const poly &b, const poly &g, const std::vector<int> &x, const poly &d, WORD p, poly &c);
+#ifdef WITHPTHREADS
+	void gcd_modular_images (const poly &a, const poly &b, const poly &g, const std::vector<int> &x, const poly &d, int want, int &pnum, std::vector<WORD> &primes, std::vector<poly> &images, std::vector<int> &status);
+#endif
 	const poly gcd_modular_dense_interpolation (const poly &a, const poly &b, const std::vector<int> &x, const poly &s);
 	const poly gcd_modular_sparse_interpolation (const poly &a, const poly &b, const std::vector<int> &x, const poly &s);
 
@@ -186,6 +186,56 @@ WORD *poly_gcd(PHEAD WORD *a, WORD *b, WORD fit) {
 
 /*
   	#] poly_gcd : 
+  	#[ poly_gcd_image :
+*/
+
+#ifdef WITHPTHREADS
+
+/**  Image of a polynomial gcd for another worker
+ *
+ *   Description
+ *   ===========
+ *   Calculates the image modulo a prime of the gcd in
+ *   polygcd::gcd_modular of the worker that owns h. The polynomials
+ *   are copied, because the owner keeps them.
+ *
+ *   Notes
+ *   =====
+ *   - The result is written at newly allocated memory
+ *   - Called from threads.c (DoGcdHelp)
+ *   - Calls polygcd::gcd_modular_image
+ */
+void poly_gcd_image(PHEAD GCDHELP *h) {
+
+	WORD oldnumvars = AN.poly_num_vars;
+	WORD oldncmod = AN.ncmod;
+	AN.poly_num_vars = h->numvars;
+	AN.ncmod = 0;
+
+	poly a(BHEAD 0), b(BHEAD 0), g(BHEAD 0), d(BHEAD 0), c(BHEAD 0);
+	a.check_memory(h->a[0]);
+	a.termscopy(h->a, 0, h->a[0]);
+	b.check_memory(h->b[0]);
+	b.termscopy(h->b, 0, h->b[0]);
+	g.check_memory(h->g[0]);
+	g.termscopy(h->g, 0, h->g[0]);
+	d.check_memory(h->d[0]);
+	d.termscopy(h->d, 0, h->d[0]);
+	vector<int> x(h->x, h->x+h->numx);
+
+	h->status = polygcd::gcd_modular_image(a, b, g, x, d, h->prime, c);
+
+	h->result = (WORD *)Malloc1(c[0]*sizeof(WORD), "gcd image");
+	memcpy(h->result, &c[0], c[0]*sizeof(WORD));
+
+	AN.ncmod = oldncmod;
+	AN.poly_num_vars = oldnumvars;
+}
+
+#endif
+
+/*
+  	#] poly_gcd_image : 
   	#[ poly_divmod :
 
 	if fit == 1 the answer must fit inside a term.
@@ -581,6 +631,71 @@ void poly_sort(PHEAD WORD *a) {
 
 /*
   	#] poly_sort : 
+  	#[ poly_ratfun_cache :
+*/
+
+/**  Cache of PolyRatFun results
+ *
+ *   Description
+ *   ===========
+ *   The same sums and products of PolyRatFuns tend to come back
+ *   many times, for instance when a few hundred denominators
+ *   dominate a calculation. Each thread keeps the results in the
+ *   compiler buffer AT.rfbufnum, in the same way as the
+ *   factorization cache (see FindArg and InsertArg in
+ *   argument.c). The key is a single piece of key[0] words with the
+ *   input in Form notation, followed by a zero. An entry is the key
+ *   followed by the arguments of the resulting PolyRatFun and a
+ *   zero. When the buffer is full, the half of the entries that was
+ *   used least is removed by CleanupArgCache. The number of entries
+ *   is the setup parameter PolyRatFunCache; zero switches the cache
+ *   off.
+ *
+ *   Notes
+ *   =====
+ *   - Nothing is cached in modulus calculus
+ *   - The key is made at a distance MaxTer from the workpointer, to
+ *     leave room for the result
+ */
+static WORD *poly_ratfun_cache_key (PHEAD int size) {
+
+	if (AM.rfbuffersize <= 0 || AN.ncmod != 0) return NULL;
+	
+	WORD *key = AT.WorkPointer + AM.MaxTer/sizeof(WORD);
+	if (key + size + 2 > AT.WorkTop) return NULL;
+	key[0] = size + 1;
+	key[size+1] = 0;
+	return key;
+}
+
+// returns the arguments of the result, or NULL if the key is not in the cache
+static WORD *poly_ratfun_cache_find (PHEAD WORD *key) {
+
+	int number = FindTree(AT.rfbufnum, key);
+	if (number < 0) {
+		AT.rfcachemisses++;
+		return NULL;
+	}
+	
+	AT.rfcachehits++;
+	return cbuf[AT.rfbufnum].rhs[number] + key[0] + 1;
+}
+
+// stores the arguments args...argsstop of the result for key
+static void poly_ratfun_cache_insert (PHEAD WORD *key, WORD *args, WORD *argsstop) {
+
+	CBUF *C = cbuf + AT.rfbufnum;
+	if (C->numrhs >= C->maxrhs-2) CleanupArgCache(BHEAD AT.rfbufnum);
+	AddRHS(AT.rfbufnum, 1);
+	AddNtoC(AT.rfbufnum, key[0], key, 18);
+	AddToCB(C, 0)
+	AddNtoC(AT.rfbufnum, argsstop-args, args, 19);
+	AddToCB(C, 0)
+	InsTree(AT.rfbufnum, C->numrhs);
+}
+
+/*
+  	#] poly_ratfun_cache : 
   	#[ poly_ratfun_add :
 */
 
@@ -596,6 +711,7 @@ void poly_sort(PHEAD WORD *a) {
  *   - The result is written at the workpointer
  *   - Called from sort.c and threads.c
  *   - Calls poly::operators and polygcd::gcd
+ *   - Uses the cache of poly_ratfun_cache
  */
 WORD *poly_ratfun_add (PHEAD WORD *t1, WORD *t2) {
  
@@ -606,6 +722,30 @@ WORD *poly_ratfun_add (PHEAD WORD *t1, WORD *t2) {
 #endif
 
 	WORD *oldworkpointer = AT.WorkPointer;
+
+	// Look for the sum in the cache
+	WORD *key = poly_ratfun_cache_key(BHEAD t1[1]+t2[1]);
+	if (key != NULL) {
+		WCOPY(key+1, t1, t1[1]);
+		WCOPY(key+1+t1[1], t2, t2[1]);
+
+		WORD *args = poly_ratfun_cache_find(BHEAD key);
+		if (args != NULL) {
+			WORD *t = oldworkpointer;
+			*t++ = AR.PolyFun;
+			*t++ = 0;
+			*t++ = 0;
+			FILLFUN3(t);
+			WORD *a = args;
+			while (*a) NEXTARG(a);
+			WCOPY(t, args, a-args);
+			t += a-args;
+			oldworkpointer[1] = t - oldworkpointer;
+			AT.WorkPointer = t;
+			return oldworkpointer;
+		}
+		AT.WorkPointer = key + key[0] + 1;
+	}
 	
 	// Extract variables
 	vector<WORD *> e;
@@ -688,6 +828,9 @@ WORD *poly_ratfun_add (PHEAD WORD *t1, WORD *t2) {
 	oldworkpointer[1] = t - oldworkpointer; // length
 	AT.WorkPointer = t;
 
+	if (key != NULL)
+		poly_ratfun_cache_insert(BHEAD key, oldworkpointer+FUNHEAD, t);
+
 	poly_free_poly_vars(BHEAD "AN.poly_vars_ratfun_add");
 
 	// reset modulo calculation
@@ -753,92 +896,149 @@ int poly_ratfun_normalize (PHEAD WORD *term) {
 	}
 
 	
-	// Extract all variables in the polyfuns
-	vector<WORD *> e;
+	// Look for the product in the cache
+	int size = 1+ABS(ncoeff);
+	for (WORD *t=term+1; t<tstop; t+=t[1])
+		if (*t == AR.PolyFun) size += t[1];
 	
-	for (WORD *t=term+1; t<tstop; t+=t[1]) {
-		if (*t == AR.PolyFun) 
-			for (WORD *t2 = t+FUNHEAD; t2<t+t[1];) {
-				e.push_back(t2);
-				NEXTARG(t2);
-			}		
-	}
-	poly::get_variables(BHEAD e, true, true);
-
-	// Check for modulus calculus
-	WORD modp=poly_determine_modulus(BHEAD true, true, "PolyRatFun");
+	WORD *oldworkpointer = AT.WorkPointer;
+	WORD *key = poly_ratfun_cache_key(BHEAD size);
+	WORD *args = NULL;
 	
-	// Accumulate total denominator/numerator and copy the remaining terms
-	// We start with 'trivial' polynomials
-	poly num1(BHEAD (UWORD *)tstop, ncoeff/2, modp, 1);
-	poly den1(BHEAD (UWORD *)tstop+ABS(ncoeff/2), ABS(ncoeff)/2, modp, 1);
-
-	WORD *s = term+1;
-
-	for (WORD *t=term+1; t<tstop;) 
-		if (*t == AR.PolyFun) {
-
-			poly num2(BHEAD 0,modp,1);
-			poly den2(BHEAD 0,modp,1);
-			poly_ratfun_read(t,num2,den2);
-			if ((t[2] & MUSTCLEANPRF) != 0) { // first normalize
-				poly gcd1(polygcd::gcd(num2,den2));
-				num2 = num2/gcd1;
-				den2 = den2/gcd1;
+	if (key != NULL) {
+		WORD *k = key+1;
+		*k++ = ncoeff;
+		WCOPY(k, tstop, ABS(ncoeff));
+		k += ABS(ncoeff);
+		for (WORD *t=term+1; t<tstop; t+=t[1])
+			if (*t == AR.PolyFun) {
+				WCOPY(k, t, t[1]);
+				k += t[1];
 			}
-			t += t[1];
-			poly gcd1(polygcd::gcd(num1,den2));
-			poly gcd2(polygcd::gcd(num2,den1));
+		args = poly_ratfun_cache_find(BHEAD key);
+		if (args == NULL) AT.WorkPointer = key + key[0] + 1;
+	}
 
-			num1 = (num1 / gcd1) * (num2 / gcd2);
-			den1 = (den1 / gcd2) * (den2 / gcd1);
+	if (args != NULL) {
+		// Remove the polyratfuns and put the result from the cache at the end
+		WORD *s = term+1;
+		for (WORD *t=term+1; t<tstop;)
+			if (*t == AR.PolyFun) {
+				t += t[1];
+			}
+			else {
+				int i = t[1];
+				if ( s != t ) {	NCOPY(s,t,i) }
+				else { t += i; s += i; }
+			}
+		
+		WORD *t = s;
+		*t++ = AR.PolyFun;                   // function
+		*t++ = 0;                            // size (to be determined)
+		*t++ &= ~MUSTCLEANPRF;               // clean polyratfun
+		FILLFUN3(t);                         // header
+		WORD *a = args;
+		while (*a) NEXTARG(a);
+		WCOPY(t, args, a-args);              // numerator and denominator
+		t += a-args;
+		s[1] = t - s;                        // function length
+		*t++ = 1;                            // term coefficient
+		*t++ = 1;
+		*t++ = 3;
+		term[0] = t-term;                    // term length
+	}
+	else {
+		// Extract all variables in the polyfuns
+		vector<WORD *> e;
+	
+		for (WORD *t=term+1; t<tstop; t+=t[1]) {
+			if (*t == AR.PolyFun) 
+				for (WORD *t2 = t+FUNHEAD; t2<t+t[1];) {
+					e.push_back(t2);
+					NEXTARG(t2);
+				}		
 		}
-		else {
-			int i = t[1];
-			if ( s != t ) {	NCOPY(s,t,i) }
-			else { t += i; s += i; }
-		}			
+		poly::get_variables(BHEAD e, true, true);
 
-	// Fix sign
-	if (den1.sign() == -1) { num1*=poly(BHEAD -1); den1*=poly(BHEAD -1); }
+		// Check for modulus calculus
+		WORD modp=poly_determine_modulus(BHEAD true, true, "PolyRatFun");
+	
+		// Accumulate total denominator/numerator and copy the remaining terms
+		// We start with 'trivial' polynomials
+		poly num1(BHEAD (UWORD *)tstop, ncoeff/2, modp, 1);
+		poly den1(BHEAD (UWORD *)tstop+ABS(ncoeff/2), ABS(ncoeff)/2, modp, 1);
+
+		WORD *s = term+1;
+
+		for (WORD *t=term+1; t<tstop;) 
+			if (*t == AR.PolyFun) {
+
+				poly num2(BHEAD 0,modp,1);
+				poly den2(BHEAD 0,modp,1);
+				poly_ratfun_read(t,num2,den2);
+				if ((t[2] & MUSTCLEANPRF) != 0) { // first normalize
+					poly gcd1(polygcd::gcd(num2,den2));
+					num2 = num2/gcd1;
+					den2 = den2/gcd1;
+				}
+				t += t[1];
+				poly gcd1(polygcd::gcd(num1,den2));
+				poly gcd2(polygcd::gcd(num2,den1));
 
-	// Check size
-	if (num1.size_of_form_notation() + den1.size_of_form_notation() + 3 >= AM.MaxTer/(int)sizeof(WORD)) {
-		MLOCK(ErrorMessageLock);
-		MesPrint ("ERROR: PolyRatFun doesn't fit in a term");
-		MesPrint ("(2) num size = %d, den size = %d,  MaxTer = %d",num1.size_of_form_notation(),
-				den1.size_of_form_notation(),AM.MaxTer);
-		MUNLOCK(ErrorMessageLock);
-		Terminate(-1);
-	}
+				num1 = (num1 / gcd1) * (num2 / gcd2);
+				den1 = (den1 / gcd2) * (den2 / gcd1);
+			}
+			else {
+				int i = t[1];
+				if ( s != t ) {	NCOPY(s,t,i) }
+				else { t += i; s += i; }
+			}			
 
-	// Format result in Form notation
-	WORD *t = s;
-	*t++ = AR.PolyFun;                   // function
-	*t++ = 0;                            // size (to be determined)
-	*t++ &= ~MUSTCLEANPRF;                   // clean polyratfun
-	FILLFUN3(t);                         // header
-	poly::poly_to_argument(num1,t,true); // argument 1 (numerator)
-	if (*t>0 && t[1]==DIRTYFLAG)         // to Form order
-		poly_sort(BHEAD t);
-	t += (*t>0 ? *t : 2);
-	poly::poly_to_argument(den1,t,true); // argument 2 (denominator)
-	if (*t>0 && t[1]==DIRTYFLAG)         // to Form order
-		poly_sort(BHEAD t);        
-	t += (*t>0 ? *t : 2);
+		// Fix sign
+		if (den1.sign() == -1) { num1*=poly(BHEAD -1); den1*=poly(BHEAD -1); }
 
-	s[1] = t - s;                        // function length
+		// Check size
+		if (num1.size_of_form_notation() + den1.size_of_form_notation() + 3 >= AM.MaxTer/(int)sizeof(WORD)) {
+			MLOCK(ErrorMessageLock);
+			MesPrint ("ERROR: PolyRatFun doesn't fit in a term");
+			MesPrint ("(2) num size = %d, den size = %d,  MaxTer = %d",num1.size_of_form_notation(),
+					den1.size_of_form_notation(),AM.MaxTer);
+			MUNLOCK(ErrorMessageLock);
+			Terminate(-1);
+		}
 
-	*t++ = 1;                            // term coefficient
-	*t++ = 1;
-	*t++ = 3;
+		// Format result in Form notation
+		WORD *t = s;
+		*t++ = AR.PolyFun;                   // function
+		*t++ = 0;                            // size (to be determined)
+		*t++ &= ~MUSTCLEANPRF;                   // clean polyratfun
+		FILLFUN3(t);                         // header
+		poly::poly_to_argument(num1,t,true); // argument 1 (numerator)
+		if (*t>0 && t[1]==DIRTYFLAG)         // to Form order
+			poly_sort(BHEAD t);
+		t += (*t>0 ? *t : 2);
+		poly::poly_to_argument(den1,t,true); // argument 2 (denominator)
+		if (*t>0 && t[1]==DIRTYFLAG)         // to Form order
+			poly_sort(BHEAD t);        
+		t += (*t>0 ? *t : 2);
+
+		s[1] = t - s;                        // function length
+
+		*t++ = 1;                            // term coefficient
+		*t++ = 1;
+		*t++ = 3;
 	
-	term[0] = t-term;                    // term length
+		term[0] = t-term;                    // term length
 
-	poly_free_poly_vars(BHEAD "AN.poly_vars_ratfun_normalize");
+		if (key != NULL)
+			poly_ratfun_cache_insert(BHEAD key, s+FUNHEAD, t-3);
+		AT.WorkPointer = oldworkpointer;
 
-	// reset modulo calculation
-	AN.ncmod = AC.ncmod;
+		poly_free_poly_vars(BHEAD "AN.poly_vars_ratfun_normalize");
+
+		// reset modulo calculation
+		AN.ncmod = AC.ncmod;
+	}
 
 	tstop = term + *term; tstop -= ABS(tstop[-1]);
 	for (WORD *t=term+1; t<tstop; t+=t[1]) {
@@ -2102,7 +2102,7 @@ WORD InFunction(PHEAD WORD *term, WORD *termout)
 								d = ModOptdollars[nummodopt].dstruct+AT.identity;
 							}
 							else {
-								LOCK(d->pthreadslockread);
+								RWLOCKR(d->pthreadslockread);
 							}
 						}
 					}
@@ -2247,12 +2247,12 @@ WORD InFunction(PHEAD WORD *term, WORD *termout)
 							AC.dollarnames->namebuffer+d->name);
 							MUNLOCK(ErrorMessageLock);
 #ifdef WITHPTHREADS
-							if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							Terminate(-1);
 					}
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					r = term + *term;
 					t = v;
@@ -2327,7 +2327,7 @@ WORD InFunction(PHEAD WORD *term, WORD *termout)
 								d = ModOptdollars[nummodopt].dstruct+AT.identity;
 							}
 							else {
-								LOCK(d->pthreadslockread);
+								RWLOCKR(d->pthreadslockread);
 							}
 						}
 					}
@@ -2357,7 +2357,7 @@ WORD InFunction(PHEAD WORD *term, WORD *termout)
 							else {
 wrongtype:;
 #ifdef WITHPTHREADS
-								if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								MLOCK(ErrorMessageLock);
 								MesPrint("$%s has wrong type for tensor substitution",
@@ -2423,7 +2423,7 @@ wrongtype:;
 							break;
 						case DOLUNDEFINED:
 #ifdef WITHPTHREADS
-							if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							MLOCK(ErrorMessageLock);
 							MesPrint("$%s is undefined in tensor substitution",
@@ -2433,7 +2433,7 @@ wrongtype:;
 							return(-1);
 					}
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 					w[1] = w[1] - 2 + (m-to);
 					from += 2;
@@ -3042,7 +3042,7 @@ WORD Generator(PHEAD WORD *term, WORD level)
 	DOLLARS d = 0;
 	WORD numfac[5], idfunctionflag;
 #ifdef WITHPTHREADS
-	int nummodopt, dtype = -1, id;
+	int nummodopt, dtype = -1, id, profile;
 #endif
 	oldtoprhs = CC->numrhs;
 	oldcpointer = CC->Pointer - CC->Buffer;
@@ -3061,7 +3061,14 @@ ReStart:
 Renormalize:
 		AN.PolyNormFlag = 0;
 		AN.idfunctionflag = 0;
-		if ( ( retnorm = Normalize(BHEAD term) ) != 0 ) {
+#ifdef WITHPTHREADS
+		profile = ProfileSwitch(AT.identity,PROFNORMALIZE);
+#endif
+		retnorm = Normalize(BHEAD term);
+#ifdef WITHPTHREADS
+		ProfileSwitch(AT.identity,profile);
+#endif
+		if ( retnorm != 0 ) {
 			if ( retnorm > 0 ) {
 				if ( AT.WorkPointer < term + *term ) AT.WorkPointer = term + *term;
 				goto ReStart;
@@ -3237,7 +3244,7 @@ SkipCount:	level++;
 										d = ModOptdollars[nummodopt].dstruct+AT.identity;
 									}
 									else {
-										LOCK(d->pthreadslockread);
+										RWLOCKR(d->pthreadslockread);
 									}
 								}
 							}
@@ -3261,13 +3268,13 @@ SkipCount:	level++;
 								,AC.dollarnames->namebuffer+d->name);
 								MUNLOCK(ErrorMessageLock);
 #ifdef WITHPTHREADS
-							if ( ddtype > 0 && ddtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( ddtype > 0 && ddtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 								goto GenCall;
 							}
 							theindex = d->index;
 #ifdef WITHPTHREADS
-							if ( ddtype > 0 && ddtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+							if ( ddtype > 0 && ddtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 						}
 						cp[1] = SUBEXPSIZE+4;
@@ -3332,7 +3339,7 @@ SkipCount:	level++;
 											d = ModOptdollars[nummodopt].dstruct+AT.identity;
 										}
 										else {
-											LOCK(d->pthreadslockread);
+											RWLOCKR(d->pthreadslockread);
 										}
 									}
 								}
@@ -3355,13 +3362,13 @@ SkipCount:	level++;
 									,AC.dollarnames->namebuffer+d->name);
 									MUNLOCK(ErrorMessageLock);
 #ifdef WITHPTHREADS
-									if ( ddtype > 0 && ddtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+									if ( ddtype > 0 && ddtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 									goto GenCall;
 								}
 								theindex = d->index;
 #ifdef WITHPTHREADS
-								if ( ddtype > 0 && ddtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+								if ( ddtype > 0 && ddtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 							}
 							*cp++ = INDTOIND;
@@ -3684,7 +3691,13 @@ CommonEnd:
 			#] Special action : 
 */
 			}
+#ifdef WITHPTHREADS
+		} while ( ( profile = ProfileSwitch(AT.identity,PROFMATCH)
+			, i = TestMatch(BHEAD term,&level)
+			, ProfileSwitch(AT.identity,profile), i ) == 0 );
+#else
 		} while ( ( i = TestMatch(BHEAD term,&level) ) == 0 );
+#endif
 		if ( AT.WorkPointer < term + *term ) AT.WorkPointer = term + *term;
 		if ( i > 0 ) replac = TestSub(BHEAD term,level);
 		else replac = i;
@@ -3888,7 +3901,7 @@ AutoGen:	i = *AT.TMout;
 							MUNLOCK(ErrorMessageLock);
 							goto GenCall;
 						}
-						LOCK(d->pthreadslockread);
+						RWLOCKR(d->pthreadslockread);
 					}
 				}
 			}
@@ -3923,7 +3936,7 @@ AutoGen:	i = *AT.TMout;
 				}
 */
 #ifdef WITHPTHREADS
-				if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); }
+				if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); }
 				if ( ( AS.Balancing && CC->numrhs == 0 ) && StartBuf[posisub] ) {
 					if ( ( id = ConditionalGetAvailableThread() ) >= 0 ) {
 						if ( BalanceRunThread(BHEAD id,termout,level) < 0 ) goto GenCall;
@@ -3950,7 +3963,7 @@ AutoGen:	i = *AT.TMout;
 				Ce->Pointer = Ce->rhs[Ce->numrhs--];
 			}
 #ifdef WITHPTHREADS
-			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); dtype = 0; }
+			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); dtype = 0; }
 #endif
 			if ( iscopy ) {
 				if ( d->nfactors > 1 ) {
@@ -4008,7 +4021,7 @@ AutoGen:	i = *AT.TMout;
 					*AN.RepPoint = 1;
 					AR.expchanged = 1;
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); }
 					if ( ( AS.Balancing && CC->numrhs == 0 ) && ( i > 0 )
 					&& ( id = ConditionalGetAvailableThread() ) >= 0 ) {
 						if ( BalanceRunThread(BHEAD id,termout,level) < 0 ) goto GenCall;
@@ -4025,7 +4038,7 @@ AutoGen:	i = *AT.TMout;
 				}
 			} while ( i > 0 );
 #ifdef WITHPTHREADS
-			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); dtype = 0; }
+			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); dtype = 0; }
 #endif
 			if ( iscopy ) {
 				if ( d->nfactors > 1 ) {
@@ -4072,7 +4085,7 @@ AutoGen:	i = *AT.TMout;
 					*AN.RepPoint = 1;
 					AR.expchanged = 1;
 #ifdef WITHPTHREADS
-					if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); }
+					if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); }
 					if ( ( AS.Balancing && CC->numrhs == 0 ) && ( i > 0 ) && ( id = ConditionalGetAvailableThread() ) >= 0 ) {
 						if ( BalanceRunThread(BHEAD id,termout,level) < 0 ) goto GenCall;
 					}
@@ -4088,7 +4101,7 @@ AutoGen:	i = *AT.TMout;
 				}
 			}
 #ifdef WITHPTHREADS
-			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNLOCK(d->pthreadslockread); dtype = 0; }
+			if ( dtype > 0 && dtype != MODLOCAL && dtype != MODSUM ) { UNRWLOCK(d->pthreadslockread); dtype = 0; }
 #endif
 			if ( iscopy ) {
 				if ( d->nfactors > 1 ) {
@@ -43,6 +43,8 @@ char dotchar[] = "_";
 char highfirst[] = "highfirst";
 char lowfirst[] = "lowfirst";
 char procedureextension[] = "prc";
+char sortcodec[] = "gzip";
+char sortstatistics[] = "";
 
 #define NUMERICALVALUE 0
 #define STRINGVALUE 1
@@ -72,6 +74,7 @@ SETUPPARAMETERS setupparameters[] =
 /*	,{(UBYTE *)"maxnumbersize",         NUMERICALVALUE, 0, (LONG)MAXNUMBERSIZE} */
 	,{(UBYTE *)"maxtermsize",           NUMERICALVALUE, 0, (LONG)MAXTER}
 	,{(UBYTE *)"maxwildcards",          NUMERICALVALUE, 0, (LONG)MAXWILDC}
+	,{(UBYTE *)"mergeprocesses",        NUMERICALVALUE, 0, (LONG)0}
 	,{(UBYTE *)"nospacesinnumbers",         ONOFFVALUE, 0, (LONG)0}
 	,{(UBYTE *)"numstorecaches",        NUMERICALVALUE, 0, (LONG)NUMSTORECACHES}
 	,{(UBYTE *)"nwritefinalstatistics",     ONOFFVALUE, 0, (LONG)0}
@@ -84,6 +87,7 @@ SETUPPARAMETERS setupparameters[] =
 	,{(UBYTE *)"oldparallelstatistics",     ONOFFVALUE, 0, (LONG)0}
 	,{(UBYTE *)"parentheses",           NUMERICALVALUE, 0, (LONG)MAXPARLEVEL}
 	,{(UBYTE *)"path",                       PATHVALUE, 0, (LONG)curdirp}
+	,{(UBYTE *)"polyratfuncache",       NUMERICALVALUE, 0, (LONG)RFBUFFERSIZE}
 	,{(UBYTE *)"procedureextension",       STRINGVALUE, 0, (LONG)procedureextension}
 	,{(UBYTE *)"processbucketsize",     NUMERICALVALUE, 0, (LONG)DEFAULTPROCESSBUCKETSIZE}
 	,{(UBYTE *)"resettimeonclear",          ONOFFVALUE, 0, (LONG)1}
@@ -92,7 +96,10 @@ SETUPPARAMETERS setupparameters[] =
 	,{(UBYTE *)"sizestorecache",        NUMERICALVALUE, 0, (LONG)SIZESTORECACHE}
 	,{(UBYTE *)"smallextension",        NUMERICALVALUE, 0, (LONG)SMALLOVERFLOW}
 	,{(UBYTE *)"smallsize",             NUMERICALVALUE, 0, (LONG)SMALLBUFFER}
+	,{(UBYTE *)"sortcodec",               STRINGVALUE, 0, (LONG)sortcodec}
 	,{(UBYTE *)"sortiosize",            NUMERICALVALUE, 0, (LONG)SORTIOSIZE}
+	,{(UBYTE *)"sortmemory",            NUMERICALVALUE, 0, 0}
+	,{(UBYTE *)"sortstatistics",          STRINGVALUE, 0, (LONG)sortstatistics}
 	,{(UBYTE *)"sorttype",                 STRINGVALUE, 0, (LONG)lowfirst}
 	,{(UBYTE *)"spectatorsize",         NUMERICALVALUE, 0, (LONG)SPECTATORSIZE}
 	,{(UBYTE *)"subfilepatches",        NUMERICALVALUE, 0, (LONG)SMAXFPATCHES}
@@ -107,10 +114,13 @@ SETUPPARAMETERS setupparameters[] =
 	,{(UBYTE *)"termsinsmall",          NUMERICALVALUE, 0, (LONG)TERMSSMALL}
     ,{(UBYTE *)"threadbucketsize",      NUMERICALVALUE, 0, (LONG)DEFAULTTHREADBUCKETSIZE}
     ,{(UBYTE *)"threadloadbalancing",       ONOFFVALUE, 0, (LONG)DEFAULTTHREADLOADBALANCING}
+    ,{(UBYTE *)"threadnuma",                ONOFFVALUE, 0, (LONG)1}
+    ,{(UBYTE *)"threadnumanodes",       NUMERICALVALUE, 0, (LONG)0}
     ,{(UBYTE *)"threads",               NUMERICALVALUE, 0, (LONG)DEFAULTTHREADS}
 	,{(UBYTE *)"threadscratchoutsize",  NUMERICALVALUE, 0, (LONG)THREADSCRATCHOUTSIZE}
 	,{(UBYTE *)"threadscratchsize",     NUMERICALVALUE, 0, (LONG)THREADSCRATCHSIZE}
     ,{(UBYTE *)"threadsortfilesynch",       ONOFFVALUE, 0, (LONG)0}
+    ,{(UBYTE *)"threadspin",            NUMERICALVALUE, 0, (LONG)DEFAULTTHREADSPIN}
 	,{(UBYTE *)"totalsize",                 ONOFFVALUE, 0, (LONG)2}
 	,{(UBYTE *)"workspace",             NUMERICALVALUE, 0, (LONG)WORKBUFFER}
 	,{(UBYTE *)"wtimestats",                ONOFFVALUE, 0, (LONG)2}
@@ -362,6 +372,9 @@ int RecalcSetups()
 	if ( sp->value < AM.totalnumberofthreads-1 )
 		sp->value = AM.totalnumberofthreads - 1;
 
+	sp  = GetSetupPar((UBYTE *)"sortmemory");
+	if ( sp->value > 0 ) SortMemorySetups(sp->value);
+
 	sp  = GetSetupPar((UBYTE *)"smallsize");
 	sp1 = GetSetupPar((UBYTE *)"smallextension");
 	if ( 6*sp1->value < 7*sp->value ) sp1->value = (7*sp->value)/6;
@@ -391,6 +404,70 @@ int RecalcSetups()
 
 /*
  		#] RecalcSetups : 
+ 		#[ SortMemorySetups :
+
+	With the setup parameter SortMemory the sizes of the sort buffers are
+	derived from a single budget in bytes. Parameters that were set
+	explicitly keep their value.
+	Seven eighths of the budget are for the sorts of the expressions. In
+	TFORM the master gets half of this, because each worker gets the
+	buffers of the master divided by the number of workers.
+	The other eighth is for the sorts of function arguments and $-variables.
+	It is spread over SORTMEMORYLEVELS levels of such sorts in each thread.
+	Inside a sort the small buffer, its extension and the large buffer
+	are in the ratio 1:2:5 as in the defaults. The pointers to the terms
+	in the small buffer are counted for terms of 8 words.
+	This is a fixed split: the buffers are allocated once and memory does
+	not move between the levels, the threads or the modules. The only
+	thing that adapts is the maximum number of terms in the small buffer
+	when it was derived here (SortMemoryAdapts): it starts at a quarter
+	and can grow (see GrowTermsInSmall in sort.c).
+*/
+
+static char *sortmemorymain[4] = {
+	"smallsize", "smallextension", "largesize", "termsinsmall" };
+static char *sortmemorysub[4] = {
+	"subsmallsize", "subsmallextension", "sublargesize", "subtermsinsmall" };
+
+static VOID SortMemorySplit(char **names, LONG size)
+{
+	SETUPPARAMETERS *sp;
+	LONG perterm = 8*sizeof(WORD), small, value[4];
+	int i;
+	small = (size/(8*perterm+3*sizeof(WORD *)))*perterm;
+	value[0] = small;
+	value[1] = 2*small;
+	value[2] = 5*small;
+	value[3] = small/perterm;
+	for ( i = 0; i < 4; i++ ) {
+		sp = GetSetupPar((UBYTE *)(names[i]));
+		if ( sp->flags != USEDFLAG ) sp->value = value[i];
+	}
+}
+
+/**
+ *	Tells whether the number of terms in the small buffer of the main
+ *	sorts (sub = 0) or of the other sorts (sub = 1) was derived from
+ *	SortMemory. Only then AllocSort starts with a quarter of them.
+ */
+
+int SortMemoryAdapts(int sub)
+{
+	if ( AM.SortMemory <= 0 ) return(0);
+	return(GetSetupPar((UBYTE *)(sub ? sortmemorysub[3] : sortmemorymain[3]))->flags != USEDFLAG);
+}
+
+VOID SortMemorySetups(LONG budget)
+{
+	LONG mainsize = budget - budget/8;
+	int nthreads = AM.totalnumberofthreads > 1 ? AM.totalnumberofthreads : 1;
+	if ( nthreads > 1 ) mainsize /= 2;
+	SortMemorySplit(sortmemorymain,mainsize);
+	SortMemorySplit(sortmemorysub,(budget/8)/(SORTMEMORYLEVELS*nthreads));
+}
+
+/*
+ 		#] SortMemorySetups : 
  		#[ AllocSetups :
 */
 
@@ -512,11 +589,16 @@ int AllocSetups()
 	}
 	sp = GetSetupPar((UBYTE *)"factorizationcache");
 	AM.fbuffersize = sp->value;
+	sp = GetSetupPar((UBYTE *)"polyratfuncache");
+	AM.rfbuffersize = sp->value;
+	if ( AM.rfbuffersize > 0 && AM.rfbuffersize < 16 ) AM.rfbuffersize = 16;
 #ifdef WITHPTHREADS
 	sp = GetSetupPar((UBYTE *)"threadscratchsize");
 	AM.ThreadScratSize = sp->value/sizeof(WORD);
 	sp = GetSetupPar((UBYTE *)"threadscratchoutsize");
 	AM.ThreadScratOutSize = sp->value/sizeof(WORD);
+	sp = GetSetupPar((UBYTE *)"threadspin");
+	AM.ThreadSpin = sp->value;
 #endif
 #ifndef WITHPTHREADS
 	for ( j = 0; j < 2; j++ ) {
@@ -533,6 +615,10 @@ int AllocSetups()
 	AC.ThreadBucketSize = AM.gThreadBucketSize = AM.ggThreadBucketSize = sp->value;
 	sp = GetSetupPar((UBYTE *)"threadloadbalancing");
 	AC.ThreadBalancing = AM.gThreadBalancing = AM.ggThreadBalancing = sp->value;
+	sp = GetSetupPar((UBYTE *)"threadnuma");
+	AM.ThreadNuma = sp->value;
+	sp = GetSetupPar((UBYTE *)"threadnumanodes");
+	AM.ThreadNumaNodes = sp->value;
 	sp = GetSetupPar((UBYTE *)"threadsortfilesynch");
 	AC.ThreadSortFileSynch = AM.gThreadSortFileSynch = AM.ggThreadSortFileSynch = sp->value;
 /*
@@ -542,8 +628,10 @@ int AllocSetups()
 	AM.shmWinSize = sp->value/sizeof(WORD);
 	if ( AM.shmWinSize < 4*AM.MaxTer ) AM.shmWinSize = 4*AM.MaxTer;
 /*
-	The sort buffer
+	The sort buffer. AllocSort needs AM.SortMemory already.
 */
+	sp = GetSetupPar((UBYTE *)"sortmemory");
+	AM.SortMemory = sp->value;
 	sp = GetSetupPar((UBYTE *)"smallsize");
 	SmallSize = sp->value;
 	sp = GetSetupPar((UBYTE *)"smallextension");
@@ -556,6 +644,16 @@ int AllocSetups()
 	MaxPatches = sp->value;
 	sp = GetSetupPar((UBYTE *)"filepatches");
 	MaxFpatches = sp->value;
+/*
+	Helper processes for the final merge of the sort file.
+	Only the sequential version can use them.
+*/
+	sp = GetSetupPar((UBYTE *)"mergeprocesses");
+#if defined(WITHPTHREADS) || defined(WITHMPI)
+	AM.MergeProcesses = 0;
+#else
+	AM.MergeProcesses = sp->value;
+#endif
 	sp = GetSetupPar((UBYTE *)"sortiosize");
 	IOsize = sp->value;
 	if ( IOsize < AM.MaxTer ) { IOsize = AM.MaxTer; sp->value = IOsize; }
@@ -566,7 +664,7 @@ int AllocSetups()
 #endif
 	AM.S0 = 0;
 	AM.S0 = AllocSort(LargeSize,SmallSize,SmallEsize,TermsInSmall
-					,MaxPatches,MaxFpatches,IOsize);
+					,MaxPatches,MaxFpatches,IOsize,SortMemoryAdapts(0));
 #ifdef WITHZLIB
 	AM.S0->file.ziosize = IOsize;
 #ifndef WITHPTHREADS
@@ -701,6 +799,24 @@ int AllocSetups()
 		MesPrint("  Illegal SortType specification: %s",(UBYTE *)sp->value);
 		error = -2;
 	}
+	sp = GetSetupPar((UBYTE *)"sortcodec");
+	if ( StrICmp((UBYTE *)"gzip",(UBYTE *)sp->value) == 0 ) {
+		AM.SortCodec = SORTCODECGZIP;
+	}
+	else if ( StrICmp((UBYTE *)"fast",(UBYTE *)sp->value) == 0 ) {
+		AM.SortCodec = SORTCODECFAST;
+	}
+	else if ( StrICmp((UBYTE *)"varint",(UBYTE *)sp->value) == 0 ) {
+		AM.SortCodec = SORTCODECVARINT;
+	}
+	else {
+		MesPrint("  Illegal SortCodec specification: %s",(UBYTE *)sp->value);
+		error = -2;
+	}
+	sp = GetSetupPar((UBYTE *)"sortstatistics");
+	if ( *((UBYTE *)(sp->value)) ) AM.SortStatsFile = (UBYTE *)(sp->value);
+	else                            AM.SortStatsFile = 0;
+	AM.SortStatsHandle = -1;
 
 	sp = GetSetupPar((UBYTE *)"processbucketsize");
 	AM.hProcessBucketSize = AM.gProcessBucketSize =
@@ -833,7 +949,7 @@ VOID WriteSetup()
 */
 
 SORTING *AllocSort(LONG LargeSize, LONG SmallSize, LONG SmallEsize, LONG TermsInSmall,
-                   int MaxPatches, int MaxFpatches, LONG IOsize)
+                   int MaxPatches, int MaxFpatches, LONG IOsize, int adapt)
 {
 	LONG allocation,longer,terms2insmall,sortsize,longerp;
 	LONG IObuffersize = IOsize;
@@ -888,6 +1004,7 @@ SORTING *AllocSort(LONG LargeSize, LONG SmallSize, LONG SmallEsize, LONG TermsIn
 		 3*sizeof(POSITION)*(LONG)longer				/* Filepositions!! */
 		+2*sizeof(WORD *)*longer
 		+2*(longerp*(sizeof(WORD *)+sizeof(WORD)))
+		+longerp*sizeof(ULONG)
 		+(3*longerp+2)*sizeof(WORD)
 #ifdef WITHZLIB
 		+(2*longerp+4)*sizeof(WORD)
@@ -907,6 +1024,13 @@ SORTING *AllocSort(LONG LargeSize, LONG SmallSize, LONG SmallEsize, LONG TermsIn
 	sort->MaxFpatches = MaxFpatches;
 	sort->TermsInSmall = TermsInSmall;
 	sort->Terms2InSmall = terms2insmall;
+/*
+	When the number of terms was derived from SortMemory the pointers are
+	for the smallest terms. We start with a quarter of them and let
+	GrowTermsInSmall increase this. An explicit value is kept.
+*/
+	if ( adapt && TermsInSmall > 64 )
+		sort->TermsInSmall = (TermsInSmall/4) & (-16L);
 
 	sort->sPointer = (WORD **)(sort+1);
 	sort->SplitScratch = sort->sPointer + terms2insmall;
@@ -914,7 +1038,8 @@ SORTING *AllocSort(LONG LargeSize, LONG SmallSize, LONG SmallEsize, LONG TermsIn
 	sort->pStop = sort->Patches+longer;
 	sort->poina = sort->pStop+longer;
 	sort->poin2a = sort->poina + longerp;
-	sort->fPatches = (POSITION *)(sort->poin2a+longerp);
+	sort->pkeys = (ULONG *)(sort->poin2a+longerp);
+	sort->fPatches = (POSITION *)(sort->pkeys+longerp);
 	sort->fPatchesStop = sort->fPatches + longer;
 	sort->inPatches = sort->fPatchesStop + longer;
 	sort->tree = (WORD *)(sort->inPatches + longer);
@@ -927,6 +1052,8 @@ SORTING *AllocSort(LONG LargeSize, LONG SmallSize, LONG SmallEsize, LONG TermsIn
 #else
 	sort->ktoi = sort->used + longerp;
 #endif
+	sort->mindex = 0;
+	sort->stats = 0;
 	sort->lBuffer = (WORD *)(sort->ktoi + longerp + 2);
 	sort->lTop = sort->lBuffer+sort->LargeSize;
 	sort->sBuffer = sort->lTop;
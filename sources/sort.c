@@ -54,6 +54,23 @@
 
 #include "form3.h"
 
+#if defined(UNIX) && !defined(WITHPTHREADS) && !defined(WITHMPI)
+#define WITHMERGEPROCESSES
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#if defined(__GNUC__)
+#define PREFETCH(x) __builtin_prefetch(x)
+#else
+#define PREFETCH(x)
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define WITHSIMDCOMPARE
+#include <immintrin.h>
+#endif
+
 #ifdef WITHPTHREADS
 UBYTE THRbuf[100];
 #endif
@@ -66,8 +83,6 @@ extern LONG nummallocs;
 extern LONG numfrees;
 #endif
 
-LONG numcompares;
-
 /*
   	#] Includes : 
 	#[ SortUtilities :
@@ -576,6 +591,221 @@ VOID WriteStats(POSITION *plspace, WORD par)
 
 /*
  		#] WriteStats : 
+ 		#[ SortStatistics :
+
+	The records for the setup parameter SortStatistics. Each record is
+	a line with a JSON object. There is a record of type "merge" for each
+	merge of patches and one of type "sort" at the end of each main sort.
+	A merge is of the kind
+		"patch"  the small or the large buffer into a patch of the sort file,
+		"stage"  patches of the sort file into a patch of a new sort file,
+		"final"  the large buffer or the sort file into the output.
+	Sizes are in bytes, times in milliseconds. "raw" is the size of the
+	terms before the compression of the sort file, and "wait" is the time
+	that the wall clock ran ahead of the CPU clock, which is mostly time
+	spent waiting for the disk.
+*/
+
+/*
+	Each field is written only when there is room for it: a name and a
+	number never need more than SORTSTATSFIELD characters. The end of the
+	buffer that is passed leaves room for the closing brace. With at most
+	100 characters of the name of the expression all fields fit.
+*/
+
+#define SORTSTATSLINE 1024
+#define SORTSTATSFIELD 40
+
+static char *SortStatsName(char *s, char *name)
+{
+	*s++ = ','; *s++ = '"';
+	while ( *name ) *s++ = *name++;
+	*s++ = '"'; *s++ = ':';
+	return(s);
+}
+
+static char *SortStatsNumber(char *s, char *stop, char *name, LONG x)
+{
+	if ( s + SORTSTATSFIELD > stop ) return(s);
+	return(LongCopy(x,SortStatsName(s,name)));
+}
+
+static char *SortStatsSize(char *s, char *stop, char *name, POSITION *x)
+{
+	if ( s + SORTSTATSFIELD > stop ) return(s);
+	return(LongLongCopy(&(BASEPOSITION(*x)),SortStatsName(s,name)));
+}
+
+static char *SortStatsTimes(char *s, char *stop, LONG cpu, LONG wall)
+{
+	s = SortStatsNumber(s,stop,"cpu",cpu);
+	s = SortStatsNumber(s,stop,"wall",wall);
+	return(SortStatsNumber(s,stop,"wait",wall > cpu ? wall-cpu : 0));
+}
+
+static char *SortStatsRatio(char *s, char *stop, POSITION *raw, POSITION *file)
+{
+	LONG x;
+	if ( ISPOSPOS(*file) == 0 || s + SORTSTATSFIELD > stop ) return(s);
+	x = (LONG)((BASEPOSITION(*raw)*100)/BASEPOSITION(*file));
+	s = LongCopy(x/100,SortStatsName(s,"ratio"));
+	*s++ = '.'; *s++ = (char)('0'+(x/10)%10); *s++ = (char)('0'+x%10);
+	return(s);
+}
+
+/*
+	The name of the expression is a JSON string: quotes and backslashes
+	get a backslash and control characters are left out.
+*/
+
+static char *SortStatsHead(PHEAD char *s, char *stop, char *type)
+{
+	UBYTE *name = (UBYTE *)"";
+	int i;
+	if ( AR.CurExpr >= 0 && AR.CurExpr < NumExpressions ) name = EXPRNAME(AR.CurExpr);
+	s = (char *)StrCopy((UBYTE *)"{\"type\":\"",(UBYTE *)s);
+	while ( *type ) *s++ = *type++;
+	*s++ = '"';
+	s = SortStatsName(s,"expr");
+	*s++ = '"';
+	for ( i = 0; *name && i < 100; i++, name++ ) {
+		if ( *name < ' ' ) continue;
+		if ( *name == '"' || *name == '\\' ) *s++ = '\\';
+		*s++ = (char)(*name);
+	}
+	*s++ = '"';
+#ifdef WITHPTHREADS
+	s = SortStatsNumber(s,stop,"thread",(LONG)(AT.identity));
+#else
+	DUMMYUSE(stop);
+#endif
+	return(s);
+}
+
+static VOID SortStatsWrite(char *line, char *s)
+{
+	*s++ = '}'; *s++ = '\n';
+#ifdef WITHMPI
+	if ( PF.me != MASTER ) return;
+#endif
+	MLOCK(ErrorMessageLock);
+	if ( AM.SortStatsFile && AM.SortStatsHandle < 0 ) {
+		if ( ( AM.SortStatsHandle = CreateFile((char *)AM.SortStatsFile) ) < 0 ) {
+			MesPrint("&Cannot create file %s for SortStatistics",AM.SortStatsFile);
+			AM.SortStatsFile = 0;
+		}
+	}
+	if ( AM.SortStatsHandle >= 0 )
+		WriteFile(AM.SortStatsHandle,(UBYTE *)line,(LONG)(s-line));
+	MUNLOCK(ErrorMessageLock);
+}
+
+/**
+ *	Prepares the counts of a main sort. Called from NewSort.
+ */
+
+VOID SortStatsStart(PHEAD0)
+{
+	SORTING *S = AT.S0;
+	if ( S->stats == 0 )
+		S->stats = (SORTSTATS *)Malloc1(sizeof(SORTSTATS),"SortStatistics");
+	PUTZERO(S->stats->rawbytes);
+	PUTZERO(S->stats->filebytes);
+	S->stats->cputime = TimeCPU(1);
+	S->stats->walltime = TimeWallClock(1)*10;
+	S->stats->patches = S->stats->stages = 0;
+	S->stats->maxfanin = 0;
+}
+
+/**
+ *	Writes the record of a merge and adds it to the counts of the sort.
+ *
+ *	@param kind     "patch", "stage" or "final"
+ *	@param fanin    The number of patches that were merged
+ *	@param termsin  The number of terms that went into the merge
+ *	@param termsout The number of terms that came out
+ *	@param raw      The size of the terms that came out
+ *	@param file     The size of the output on file
+ *	@param compares The number of calls of the compare routine
+ *	@param cpu      The CPU time at the start of the merge
+ *	@param wall     The wall clock time (in milliseconds) at the start
+ */
+
+VOID SortStatsMerge(PHEAD char *kind, int fanin, LONG termsin, LONG termsout,
+	POSITION *raw, POSITION *file, LONG compares, LONG cpu, LONG wall)
+{
+	SORTSTATS *st = AT.S0->stats;
+	char line[SORTSTATSLINE], *s, *stop = line+SORTSTATSLINE-2;
+	if ( kind[0] == 'p' ) st->patches++;
+	else if ( kind[0] == 's' ) st->stages++;
+	if ( kind[0] != 'f' ) {
+		ADD2POS(st->rawbytes,*raw);
+		ADD2POS(st->filebytes,*file);
+	}
+	if ( fanin > st->maxfanin ) st->maxfanin = fanin;
+	s = SortStatsHead(BHEAD line,stop,"merge");
+	s = SortStatsName(s,"kind");
+	*s++ = '"'; while ( *kind ) *s++ = *kind++; *s++ = '"';
+	s = SortStatsNumber(s,stop,"fanin",(LONG)fanin);
+	s = SortStatsNumber(s,stop,"termsin",termsin);
+	s = SortStatsNumber(s,stop,"termsout",termsout);
+	s = SortStatsSize(s,stop,"raw",raw);
+	s = SortStatsSize(s,stop,"bytes",file);
+	s = SortStatsRatio(s,stop,raw,file);
+	s = SortStatsNumber(s,stop,"compares",compares);
+	s = SortStatsTimes(s,stop,TimeCPU(1)-cpu,TimeWallClock(1)*10-wall);
+	SortStatsWrite(line,s);
+}
+
+/**
+ *	Each thread counts the calls of Compare1 in its own main sort. When
+ *	the master merges the output of the workers (and sortbots) the sort
+ *	of the expression includes their compares. They have all finished
+ *	their part by then and each of them has reset its count at the start
+ *	of the expression.
+ */
+
+static LONG SortStatsCompares(PHEAD0)
+{
+	LONG compares = AN.numcompares;
+#ifdef WITHPTHREADS
+	int i;
+	if ( AT.identity == 0 && AS.MasterSort ) {
+		for ( i = 1; i < AM.totalnumberofthreads; i++ )
+			compares += AB[i]->N.numcompares;
+	}
+#endif
+	return(compares);
+}
+
+/**
+ *	Writes the record of a main sort. Called from EndSort.
+ *
+ *	@param size The size of the output of the sort
+ */
+
+VOID SortStatsEnd(PHEAD POSITION *size)
+{
+	SORTING *S = AT.S0;
+	SORTSTATS *st = S->stats;
+	char line[SORTSTATSLINE], *s, *stop = line+SORTSTATSLINE-2;
+	s = SortStatsHead(BHEAD line,stop,"sort");
+	s = SortStatsNumber(s,stop,"generated",S->GenTerms);
+	s = SortStatsNumber(s,stop,"terms",S->TermsLeft);
+	s = SortStatsSize(s,stop,"bytes",size);
+	s = SortStatsNumber(s,stop,"compares",SortStatsCompares(BHEAD0));
+	s = SortStatsNumber(s,stop,"patches",st->patches);
+	s = SortStatsNumber(s,stop,"stages",st->stages);
+	s = SortStatsNumber(s,stop,"maxfanin",(LONG)(st->maxfanin));
+	s = SortStatsSize(s,stop,"raw",&(st->rawbytes));
+	s = SortStatsSize(s,stop,"filebytes",&(st->filebytes));
+	s = SortStatsRatio(s,stop,&(st->rawbytes),&(st->filebytes));
+	s = SortStatsTimes(s,stop,TimeCPU(1)-st->cputime,TimeWallClock(1)*10-st->walltime);
+	SortStatsWrite(line,s);
+}
+
+/*
+ 		#] SortStatistics : 
  		#[ NewSort :				WORD NewSort()
 */
 /**
@@ -607,7 +837,8 @@ WORD NewSort(PHEAD0)
 	}
 	if ( AR.sLevel == 0 ) {
 
-		numcompares = 0;
+		AN.numcompares = 0;
+		if ( AM.SortStatsFile ) SortStatsStart(BHEAD0);
 
 		AN.FunSorts[0] = AT.S0;
 		if ( AR.PolyFun == 0 ) { AT.S0->PolyFlag = 0; }
@@ -623,7 +854,7 @@ WORD NewSort(PHEAD0)
 		if ( AN.FunSorts[AR.sLevel] == 0 ) {
 			AN.FunSorts[AR.sLevel] = AllocSort(
 				AM.SLargeSize,AM.SSmallSize,AM.SSmallEsize,AM.STermsInSmall
-					,AM.SMaxPatches,AM.SMaxFpatches,AM.SIOsize);
+					,AM.SMaxPatches,AM.SMaxFpatches,AM.SIOsize,SortMemoryAdapts(1));
 		}
 		AN.FunSorts[AR.sLevel]->PolyFlag = 0;
 	}
@@ -687,6 +918,7 @@ LONG EndSort(PHEAD WORD *buffer, int par)
   off_t lSpace;
   FILEHANDLE *fout = 0, *oldoutfile = 0, *newout = 0;
 
+  PUTZERO(pp);
   if ( AM.exitflag && AR.sLevel == 0 ) return(0);
 #ifdef WITHMPI 
   if( (retval = PF_EndSort()) > 0){
@@ -729,7 +961,7 @@ LONG EndSort(PHEAD WORD *buffer, int par)
 		MesPrint(" Before SplitMerge: %7l.%2is",millitime,timepart);
 	}
 	*/
-	S->sPointer[SplitMerge(BHEAD S->sPointer,S->sTerms)] = 0;
+	S->sPointer[SortSmallBuffer(BHEAD S->sPointer,S->sTerms)] = 0;
 	/*
 	{
 		LONG millitime;
@@ -1051,18 +1283,23 @@ TooLarge:
 			position = S->fPatches[S->fPatchN];
 			ss = S->sPointer;
 			if ( *ss ) {
+				POSITION raw, file;
+				LONG stcompares = AN.numcompares, stcpu = 0, stwall = 0, nout = 0;
+				PUTZERO(raw);
+				if ( S->stats ) { stcpu = TimeCPU(1); stwall = TimeWallClock(1)*10; }
 #ifdef WITHZLIB
 				*AR.CompressPointer = 0;
 				if ( S == AT.S0 && AR.NoCompress == 0 && AR.gzipCompress > 0 )
-					S->fpcompressed[S->fPatchN] = 1;
+					S->fpcompressed[S->fPatchN] = AM.SortCodec;
 				else
 					S->fpcompressed[S->fPatchN] = 0;
 				SetupOutputGZIP(&(S->file));
 #endif
 				while ( ( t = *ss++ ) != 0 ) {
-					if ( PutOut(BHEAD t,&position,&(S->file),1) < 0 ) {
+					if ( ( jj = PutOut(BHEAD t,&position,&(S->file),1) ) < 0 ) {
 						retval = -1; goto RetRetval;
 					}
+					ADDPOS(raw,jj); nout++;
 				}
 				if ( FlushOut(&position,&(S->file),1) ) {
 					retval = -1; goto RetRetval;
@@ -1070,6 +1307,12 @@ TooLarge:
 				++(S->fPatchN);
 				S->fPatches[S->fPatchN] = position;
 				UpdateMaxSize();
+				if ( S->stats ) {
+					DIFPOS(file,position,S->fPatches[S->fPatchN-1]);
+					MULPOS(raw,sizeof(WORD));
+					SortStatsMerge(BHEAD "patch",1,nout,nout,&raw,&file,
+						AN.numcompares-stcompares,stcpu,stwall);
+				}
 #ifdef GZIPDEBUG
 				MLOCK(ErrorMessageLock);
 				MesPrint("%w EndSort+: fPatchN = %d, lPatch = %d, position = %12p"
@@ -1087,7 +1330,11 @@ TooLarge:
 		}
 #endif
 		UpdateMaxSize();
+#ifdef WITHMERGEPROCESSES
+		if ( ForkMergePatches() ) {
+#else
 		if ( MergePatches(0) ) {
+#endif
 			MLOCK(ErrorMessageLock);
 			MesCall("EndSort");
 			MUNLOCK(ErrorMessageLock);
@@ -1116,6 +1363,12 @@ RetRetval:
 		Expressions[AR.CurExpr].size = pp;
 	}/*if ( AR.sLevel == 0 )*/
 #endif
+#ifdef WITHMPI
+	if ( AR.sLevel == 0 && S->stats && retval >= 0 && PF.me == MASTER )
+#else
+	if ( AR.sLevel == 0 && S->stats && retval >= 0 )
+#endif
+		SortStatsEnd(BHEAD &pp);
 /*:[25nov2003 mt]*/
 	if ( S->file.handle >= 0 && ( par != 1 ) && ( par != 2 ) ) {
 				/* sortfile is still open */
@@ -1238,7 +1491,7 @@ RetRetval:
 	}
 /*
 	if ( AR.sLevel < 0 ) {
-		MesPrint(" number of calls to compare was %l",numcompares);
+		MesPrint(" number of calls to compare was %l",AN.numcompares);
 	}
 */
 	return(retval);
@@ -1315,6 +1568,11 @@ LONG PutIn(FILEHANDLE *file, POSITION *position, WORD *buffer, WORD **take, int
 #ifdef ALLLOCK
 	UNLOCK(file->pthreadslock);
 #endif
+	if ( RetCode == file->POsize ) {	/* Ask for the next block already */
+		POSITION next = *position;
+		ADDPOS(next,RetCode);
+		PrefetchFile(file->handle,&next,file->POsize);
+	}
 #endif
 	return(RetCode);
 }
@@ -2520,6 +2778,134 @@ twogen:
 
 /*
  		#] AddArgs : 
+ 		#[ CompareSymbolTerms :
+
+	Most terms in polynomial work consist of a single subterm of type
+	SYMBOL and the coefficient. For those Compare1 uses the routines in
+	this fold: the (symbol,power) pairs of both terms are compared as one
+	block of words and only the first difference is inspected.
+	On x86_64 the block compare uses SSE2, and for long blocks AVX2 if the
+	CPU has it (tested once at runtime). Short blocks, where the first
+	difference is usually in the first words, are done word by word.
+	Because the words are compared bytewise this works for any size of WORD.
+*/
+
+#ifdef WITHSIMDCOMPARE
+
+static inline LONG FirstDiffSSE2(WORD *a, WORD *b, LONG n)
+{
+	UBYTE *ua = (UBYTE *)a, *ub = (UBYTE *)b;
+	LONG i = 0, nb = n*(LONG)sizeof(WORD);
+	unsigned int mask;
+	for ( ; i+16 <= nb; i += 16 ) {
+		mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i *)(ua+i)),_mm_loadu_si128((__m128i *)(ub+i))));
+		if ( mask != 0xFFFF )
+			return((i+__builtin_ctz(~mask))/(LONG)sizeof(WORD));
+	}
+	for ( i /= (LONG)sizeof(WORD); i < n; i++ ) { if ( a[i] != b[i] ) break; }
+	return(i);
+}
+
+__attribute__((target("avx2")))
+static LONG FirstDiffAVX2(WORD *a, WORD *b, LONG n)
+{
+	UBYTE *ua = (UBYTE *)a, *ub = (UBYTE *)b;
+	LONG i = 0, nb = n*(LONG)sizeof(WORD);
+	unsigned int mask;
+	for ( ; i+32 <= nb; i += 32 ) {
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((__m256i *)(ua+i)),_mm256_loadu_si256((__m256i *)(ub+i))));
+		if ( mask != 0xFFFFFFFFU )
+			return((i+__builtin_ctz(~mask))/(LONG)sizeof(WORD));
+	}
+	i /= (LONG)sizeof(WORD);
+	return(i+FirstDiffSSE2(a+i,b+i,n-i));
+}
+
+/*
+	0: not yet tested, 1: SSE2 only, 2: AVX2
+*/
+static int simdcompare = 0;
+
+#define SIMDSHORT (16/(LONG)sizeof(WORD))
+#define SIMDLONG (64/(LONG)sizeof(WORD))
+
+#endif
+
+static inline LONG FirstDiff(WORD *a, WORD *b, LONG n)
+{
+	LONG i;
+#ifdef WITHSIMDCOMPARE
+	if ( n >= SIMDSHORT ) {
+		if ( n >= SIMDLONG ) {
+			if ( simdcompare == 0 )
+				simdcompare = __builtin_cpu_supports("avx2") ? 2 : 1;
+			if ( simdcompare == 2 ) return(FirstDiffAVX2(a,b,n));
+		}
+		return(FirstDiffSSE2(a,b,n));
+	}
+#endif
+	for ( i = 0; i < n; i++ ) { if ( a[i] != b[i] ) break; }
+	return(i);
+}
+
+/**
+ *	The part of Compare1 for terms that have only a subterm of type
+ *	SYMBOL or no subterm at all. The result is identical to what the
+ *	general code in Compare1 gives for SORTLOWFIRST and SORTHIGHFIRST.
+ *
+ *	@param term1    First input term
+ *	@param term2    Second input term
+ *	@param stopper1 Start of the coefficient of term1
+ *	@param stopper2 Start of the coefficient of term2
+ *	@param level    As in Compare1
+ */
+
+static WORD CompareSymbolTerms(PHEAD WORD *term1, WORD *term2,
+	WORD *stopper1, WORD *stopper2, WORD level)
+{
+	WORD *s1 = term1+3, *s2 = term2+3;
+	LONG n1, n2, n, i;
+	int low = AR.SortType == SORTLOWFIRST;
+	if ( stopper1 == term1+1 ) {
+		if ( stopper2 != term2+1 ) return(low ? 1 : -1);
+		goto Coefficient;
+	}
+	if ( stopper2 == term2+1 ) return(low ? -1 : 1);
+	n1 = stopper1-s1; n2 = stopper2-s2;
+	n = n1 < n2 ? n1 : n2;
+	i = FirstDiff(s1,s2,n);
+	if ( i < n ) {
+		s1 += i; s2 += i;
+		if ( ( i & 1 ) != 0 ) return(low ? *s2-*s1 : *s1-*s2);
+		if ( *s1 < *s2 ) {
+			if ( low ) return(s1[1] < 0 ? 1 : -1);
+			else       return(s1[1] < 0 ? -1 : 1);
+		}
+		else {
+			if ( low ) return(s2[1] < 0 ? -1 : 1);
+			else       return(s2[1] < 0 ? 1 : -1);
+		}
+	}
+	if ( n1 > n ) {
+		s1 += n;
+		if ( low ) return(s1[1] > 0 ? -1 : 1);
+		else       return(s1[1] < 0 ? -1 : 1);
+	}
+	if ( n2 > n ) {
+		s2 += n;
+		if ( low ) return(s2[1] < 0 ? -1 : 1);
+		else       return(s2[1] < 0 ? 1 : -1);
+	}
+Coefficient:
+	if ( level == 3 ) return(CompCoef(term1,term2));
+	if ( level >= 1 ) return(CompCoef(term2,term1));
+	return(0);
+}
+
+/*
+ 		#] CompareSymbolTerms : 
  		#[ Compare1 :				WORD Compare1(term1,term2,level)
 */
 /**
@@ -2559,7 +2945,21 @@ WORD Compare1(PHEAD WORD *term1, WORD *term2, WORD level)
 	WORD count = -1, localPoly, polyhit = -1;
 
 	if ( AR.sLevel == 0 ) {
-		numcompares++;
+		AN.numcompares++;
+	}
+/*
+	The fast path for terms with only symbols.
+*/
+	if ( S->PolyFlag == 0 && AT.fromindex == 0
+	 && ( AR.SortType == SORTLOWFIRST || AR.SortType == SORTHIGHFIRST ) ) {
+		GETSTOP(term1,stopper1);
+		GETSTOP(term2,stopper2);
+		if ( ( stopper1 == term1+1 || ( term1[1] == SYMBOL && term1[2] > 2
+				&& term1+1+term1[2] == stopper1 ) )
+		  && ( stopper2 == term2+1 || ( term2[1] == SYMBOL && term2[2] > 2
+				&& term2+1+term2[2] == stopper2 ) ) ) {
+			return(CompareSymbolTerms(BHEAD term1,term2,stopper1,stopper2,level));
+		}
 	}
 
 	if ( S->PolyFlag ) {
@@ -3272,89 +3672,7 @@ LONG SplitMerge(PHEAD WORD **Pointer, LONG number)
 	split = number/2;
 	newleft  = SplitMerge(BHEAD Pointer,split);
 	newright = SplitMerge(BHEAD Pointer+split,number-split);
-	if ( newright == 0 ) return(newleft);
-/*
-	We compare the last of the left with the first of the right
-	If they are already in order, we will be done quickly.
-	We may have to compactify the buffer because the recursion may
-	have created holes. Also this compare may result in equal terms.
-	Addition of 23-jul-1999. It makes things a bit faster.
-*/
-	if ( newleft > 0 && newright > 0 &&
-	( i = CompareTerms(BHEAD Pointer[newleft-1],Pointer[split],(WORD)0) ) >= 0 ) {
-		pp2 = Pointer+split; pp1 = Pointer+newleft-1;
-		if ( i == 0 ) {
-		  if ( S->PolyWise ) {
-			if ( AddPoly(BHEAD pp1,pp2) > 0 ) pp1++;
-			else newleft--;
-		  }
-		  else {               
-			if ( AddCoef(BHEAD pp1,pp2) > 0 ) pp1++;
-			else newleft--;
-		  }
-		  pp2++; newright--;
-		}
-		else pp1++;
-		newleft += newright;
-		if ( pp1 < pp2 ) {
-			while ( --newright >= 0 ) *pp1++ = *pp2++;
-		}
-		return(newleft);
-	}
-
-	if ( split >= AN.SplitScratchSize ) {
-		AN.SplitScratchSize = (split*3)/2+100;
-		if ( AN.SplitScratchSize > S->Terms2InSmall/2 )
-			 AN.SplitScratchSize = S->Terms2InSmall/2;
-		if ( AN.SplitScratch ) M_free(AN.SplitScratch,"AN.SplitScratch");
-		AN.SplitScratch = (WORD **)Malloc1(AN.SplitScratchSize*sizeof(WORD *),"AN.SplitScratch");
-	}
-	pp3 = AN.SplitScratch; pp1 = Pointer;
-	for ( i = 0; i < newleft; i++ ) *pp3++ = *pp1++;
-	AN.InScratch = newleft;
-	pp1 = AN.SplitScratch; pp2 = Pointer + split; pp3 = Pointer;
-/*
-		An improvement in the style of Timsort
-*/
-	while ( newleft > 8 ) {
-		LONG nnleft = newleft/2;
-		if ( ( i = CompareTerms(BHEAD pp1[nnleft],*pp2,(WORD)0) ) < 0 ) break;
-		pp3 += nnleft+1;
-		pp1 += nnleft+1;
-		newleft -= nnleft+1;
-		if ( i == 0 ) {
-			if ( S->PolyWise ) { i = AddPoly(BHEAD pp3-1,pp2); }
-			else               { i = AddCoef(BHEAD pp3-1,pp2); }
-			if ( i == 0 ) pp3--;
-			pp2++;
-			newright--;
-			break;
-		}
-	}
-
-	while ( newleft > 0 && newright > 0 ) {
-		if ( ( i = CompareTerms(BHEAD *pp1,*pp2,(WORD)0) ) < 0 ) {
-			*pp3++ = *pp2++;
-			newright--;
-		}
-		else if ( i > 0 ) {
-			*pp3++ = *pp1++;
-			newleft--;
-		}
-		else {
-		  if ( S->PolyWise ) { if ( AddPoly(BHEAD pp1,pp2) > 0 ) *pp3++ = *pp1; }
-		  else {               if ( AddCoef(BHEAD pp1,pp2) > 0 ) *pp3++ = *pp1; }
-		  pp1++; pp2++; newleft--; newright--;
-		}
-	}
-	for ( i = 0; i < newleft; i++ ) *pp3++ = *pp1++;
-	if ( pp3 == pp2 ) {
-		pp3 += newright;
-	} else {
-		for ( i = 0; i < newright; i++ ) *pp3++ = *pp2++;
-	}
-	AN.InScratch = 0;
-	return(pp3 - Pointer);
+	return(MergeRuns(BHEAD Pointer,newleft,split,newright));
 }
 
 #else
@@ -3454,43 +3772,528 @@ LONG SplitMerge(PHEAD WORD **Pointer, LONG number)
 
 /*
  		#] SplitMerge : 
- 		#[ GarbHand :				VOID GarbHand()
+ 		#[ MergeRuns :				LONG MergeRuns(Pointer,newleft,split,newright)
 */
 /**
- *		Garbage collection that takes place when the small extension is full
- *		and we need to place more terms there.
- *		When this is the case there are many holes in the small buffer and
- *		the whole can be compactified.
- *		The major complication is the buffer for SplitMerge.
- *		There are to options for temporary memory:
- *		1: find some buffer that has enough space (maybe in the large
- *		   buffer).
- *		2: allocate a buffer. Give it back afterwards of course.
- *		If the small extension is properly dimensioned this routine should
- *		be called very rarely. Most of the time it will be called when the
- *		polyfun or polyratfun is active.
+ *		The merge step of SplitMerge. There are two sorted runs without
+ *		equal terms: Pointer[0..newleft) and Pointer[split..split+newright).
+ *		The result is placed from Pointer on, equal terms are added.
+ *
+ *		@return The number of terms in the result.
  */
 
-VOID GarbHand()
+LONG MergeRuns(PHEAD WORD **Pointer, LONG newleft, LONG split, LONG newright)
 {
-	GETIDENTITY
+	GETBIDENTITY
 	SORTING *S = AT.SS;
-	WORD **Point, *s2, *t, *garbuf, i;
-	LONG k, total = 0;
-	int tobereturned = 0;
+	WORD **pp3, **pp1, **pp2;
+	LONG i;
+
+	if ( newright == 0 ) return(newleft);
 /*
-	Compute the size needed. Put it in total.
+	We compare the last of the left with the first of the right
+	If they are already in order, we will be done quickly.
+	We may have to compactify the buffer because the recursion may
+	have created holes. Also this compare may result in equal terms.
+	Addition of 23-jul-1999. It makes things a bit faster.
 */
-#ifdef TESTGARB
-	MLOCK(ErrorMessageLock);
-	MesPrint("in:  S->sFill = %x, S->sTop2 = %x",S->sFill,S->sTop2);
-#endif
-	Point = S->sPointer;
-	k = S->sTerms;
-	while ( --k >= 0 ) {
-		if ( ( s2 = *Point++ ) != 0 ) { total += *s2; }
-	}
-	Point = AN.SplitScratch;
+	if ( newleft > 0 && newright > 0 &&
+	( i = CompareTerms(BHEAD Pointer[newleft-1],Pointer[split],(WORD)0) ) >= 0 ) {
+		pp2 = Pointer+split; pp1 = Pointer+newleft-1;
+		if ( i == 0 ) {
+		  if ( S->PolyWise ) {
+			if ( AddPoly(BHEAD pp1,pp2) > 0 ) pp1++;
+			else newleft--;
+		  }
+		  else {               
+			if ( AddCoef(BHEAD pp1,pp2) > 0 ) pp1++;
+			else newleft--;
+		  }
+		  pp2++; newright--;
+		}
+		else pp1++;
+		newleft += newright;
+		if ( pp1 < pp2 ) {
+			while ( --newright >= 0 ) *pp1++ = *pp2++;
+		}
+		return(newleft);
+	}
+
+	if ( split >= AN.SplitScratchSize ) {
+		AN.SplitScratchSize = (split*3)/2+100;
+		if ( AN.SplitScratchSize > S->Terms2InSmall/2 )
+			 AN.SplitScratchSize = S->Terms2InSmall/2;
+		if ( AN.SplitScratch ) M_free(AN.SplitScratch,"AN.SplitScratch");
+		AN.SplitScratch = (WORD **)Malloc1(AN.SplitScratchSize*sizeof(WORD *),"AN.SplitScratch");
+	}
+	pp3 = AN.SplitScratch; pp1 = Pointer;
+	for ( i = 0; i < newleft; i++ ) *pp3++ = *pp1++;
+	AN.InScratch = newleft;
+	pp1 = AN.SplitScratch; pp2 = Pointer + split; pp3 = Pointer;
+/*
+		An improvement in the style of Timsort
+*/
+	while ( newleft > 8 ) {
+		LONG nnleft = newleft/2;
+		if ( ( i = CompareTerms(BHEAD pp1[nnleft],*pp2,(WORD)0) ) < 0 ) break;
+		pp3 += nnleft+1;
+		pp1 += nnleft+1;
+		newleft -= nnleft+1;
+		if ( i == 0 ) {
+			if ( S->PolyWise ) { i = AddPoly(BHEAD pp3-1,pp2); }
+			else               { i = AddCoef(BHEAD pp3-1,pp2); }
+			if ( i == 0 ) pp3--;
+			pp2++;
+			newright--;
+			break;
+		}
+	}
+
+	while ( newleft > 0 && newright > 0 ) {
+		if ( ( i = CompareTerms(BHEAD *pp1,*pp2,(WORD)0) ) < 0 ) {
+			*pp3++ = *pp2++;
+			newright--;
+		}
+		else if ( i > 0 ) {
+			*pp3++ = *pp1++;
+			newleft--;
+		}
+		else {
+		  if ( S->PolyWise ) { if ( AddPoly(BHEAD pp1,pp2) > 0 ) *pp3++ = *pp1; }
+		  else {               if ( AddCoef(BHEAD pp1,pp2) > 0 ) *pp3++ = *pp1; }
+		  pp1++; pp2++; newleft--; newright--;
+		}
+	}
+	for ( i = 0; i < newleft; i++ ) *pp3++ = *pp1++;
+	if ( pp3 == pp2 ) {
+		pp3 += newright;
+	} else {
+		for ( i = 0; i < newright; i++ ) *pp3++ = *pp2++;
+	}
+	AN.InScratch = 0;
+	return(pp3 - Pointer);
+}
+
+/*
+ 		#] MergeRuns : 
+ 		#[ SortPointers :			VOID SortPointers(Pointer,Scratch,number)
+*/
+/**
+ *		Sorts an array of pointers to terms without adding equal terms.
+ *		The terms are only read, hence this can be done by another thread
+ *		than the one that owns the sort buffer (see HelpedSplitMerge in
+ *		threads.c). Equal terms end up next to each other and can be
+ *		added afterwards by AddNeighbours.
+ *
+ *		@param  Pointer The array of pointers to the terms to be sorted.
+ *		@param  Scratch Space for number/2 pointers.
+ *		@param  number  The number of pointers in Pointer.
+ */
+
+VOID SortPointers(PHEAD WORD **Pointer, WORD **Scratch, LONG number)
+{
+	GETBIDENTITY
+	WORD **pp1, **pp2, **pp3, **stop1, **stop2;
+	LONG split;
+	if ( number < 2 ) return;
+	if ( number == 2 ) {
+		if ( CompareTerms(BHEAD Pointer[0],Pointer[1],(WORD)0) < 0 ) {
+			pp1 = (WORD **)(Pointer[0]); Pointer[0] = Pointer[1]; Pointer[1] = (WORD *)pp1;
+		}
+		return;
+	}
+	split = number/2;
+	SortPointers(BHEAD Pointer,Scratch,split);
+	SortPointers(BHEAD Pointer+split,Scratch,number-split);
+	if ( CompareTerms(BHEAD Pointer[split-1],Pointer[split],(WORD)0) >= 0 ) return;
+	pp1 = Scratch; pp2 = Pointer;
+	while ( pp2 < Pointer+split ) *pp1++ = *pp2++;
+	stop1 = pp1; stop2 = Pointer+number;
+	pp1 = Scratch; pp2 = Pointer+split; pp3 = Pointer;
+	while ( pp1 < stop1 && pp2 < stop2 ) {
+		if ( CompareTerms(BHEAD *pp1,*pp2,(WORD)0) < 0 ) *pp3++ = *pp2++;
+		else *pp3++ = *pp1++;
+	}
+	while ( pp1 < stop1 ) *pp3++ = *pp1++;
+}
+
+/*
+ 		#] SortPointers : 
+ 		#[ AddNeighbours :			LONG AddNeighbours(Pointer,number)
+*/
+/**
+ *		Adds the equal terms in an array that has been sorted by
+ *		SortPointers and removes the holes.
+ *		This must be done by the thread that owns the sort buffer,
+ *		because the sums are put in the extension of its small buffer.
+ *
+ *		@return The number of terms that remain.
+ */
+
+LONG AddNeighbours(PHEAD WORD **Pointer, LONG number)
+{
+	GETBIDENTITY
+	LONG i, n = 0;
+	for ( i = 0; i < number; i++ ) {
+		if ( n > 0 && CompareTerms(BHEAD Pointer[n-1],Pointer[i],(WORD)0) == 0 ) {
+			if ( AddCoef(BHEAD Pointer+n-1,Pointer+i) == 0 ) n--;
+		}
+		else if ( n < i ) { Pointer[n++] = Pointer[i]; Pointer[i] = 0; }
+		else n++;
+	}
+	return(n);
+}
+
+/*
+ 		#] AddNeighbours : 
+ 		#[ SortKey :				ULONG SortKey(term)
+*/
+/**
+ *		Computes a prefix key for a term for the keyed version of SplitMerge
+ *		(On keyedsort;). The key encodes the first symbol and its power in
+ *		such a way that, for the sort types SORTLOWFIRST and SORTHIGHFIRST,
+ *		an unsigned comparison of two different keys gives the same answer as
+ *		Compare1 would give. A smaller key means that the term comes first.
+ *
+ *		The terms that qualify start with a SYMBOL subterm. In the lowfirst
+ *		mode the negative powers come first with the lowest symbol first,
+ *		followed by the positive powers with the highest symbol first.
+ *		In the highfirst mode the roles of the positive and negative powers
+ *		are interchanged. Inside each region the powers are ordered as in
+ *		Compare1. This is the top bit of the key, the symbol occupies the
+ *		next BITSINWORD-1 bits and the power the lowest BITSINWORD bits.
+ *
+ *		@param  term  The term.
+ *		@return The key, or zero when the term does not qualify. Two terms
+ *		        with equal keys or with a zero key must be compared with
+ *		        CompareTerms.
+ */
+
+ULONG SortKey(PHEAD WORD *term)
+{
+	WORD *t, *tstop, s, p;
+	ULONG region, symfield, powfield;
+	GETSTOP(term,tstop);
+	t = term + 1;
+	if ( t >= tstop || *t != SYMBOL || t[1] < 4 ) return(0);
+	s = t[2]; p = t[3];
+	if ( s < 0 || s == MAXPOSITIVE || s == FACTORSYMBOL ) return(0);
+	powfield = (ULONG)(((UWORD)p) ^ SPECMASK);
+	if ( AR.SortType == SORTLOWFIRST ) {
+		region = ( p < 0 ) ? 0: 1;
+	}
+	else if ( AR.SortType == SORTHIGHFIRST ) {
+		region = ( p > 0 ) ? 0: 1;
+		powfield = ( ~powfield ) & WORDMASK;
+	}
+	else return(0);
+	if ( region == 0 ) symfield = (ULONG)s + 1;
+	else               symfield = (ULONG)(MAXPOSITIVE - s);
+	return((region << (BITSINLONG-1)) | (symfield << BITSINWORD) | powfield);
+}
+
+/*
+ 		#] SortKey : 
+ 		#[ SplitMergeKeys :			LONG SplitMergeKeys(Pointer,Keys,number)
+*/
+/**
+ *		The same as (the NEWSPLITMERGE version of) SplitMerge, but each
+ *		pointer has a key from SortKey in the array Keys that moves along
+ *		with it. When both keys are nonzero and different they decide the
+ *		order without looking at the terms. Otherwise CompareTerms is called.
+ *		This saves a function call and the walk through the subterms for
+ *		polynomials in a single symbol or in a few symbols.
+ *
+ *		The keys are only attached to the positions in the pointer arrays.
+ *		Hence GarbHand, which moves the terms but keeps the pointers in
+ *		their places, does not disturb them.
+ *
+ *		@param  Pointer The array of pointers to the terms to be sorted.
+ *		@param  Keys    The keys of the terms in Pointer.
+ *		@param  number  The number of pointers in Pointer.
+ *		@return The number of terms after sorting and adding.
+ */
+
+#define KEYCOMPARE(k1,k2,t1,t2) ( ( (k1) && (k2) && (k1) != (k2) ) \
+	? ( (k1) < (k2) ? 1: -1 ) : CompareTerms(BHEAD t1,t2,(WORD)0) )
+
+LONG SplitMergeKeys(PHEAD WORD **Pointer, ULONG *Keys, LONG number)
+{
+	GETBIDENTITY
+	SORTING *S = AT.SS;
+	WORD **pp3, **pp1, **pp2;
+	ULONG *kp3, *kp1, *kp2, k;
+	LONG i, newleft, newright, split;
+
+	if ( number < 2 ) return(number);
+	if ( number == 2 ) {
+		pp1 = Pointer; pp2 = pp1 + 1;
+		if ( ( i = KEYCOMPARE(Keys[0],Keys[1],*pp1,*pp2) ) < 0 ) {
+			pp3 = (WORD **)(*pp1); *pp1 = *pp2; *pp2 = (WORD *)pp3;
+			k = Keys[0]; Keys[0] = Keys[1]; Keys[1] = k;
+		}
+		else if ( i == 0 ) {
+			number--;
+			if ( AddCoef(BHEAD pp1,pp2) == 0 ) number = 0;
+		}
+		return(number);
+	}
+	split = number/2;
+	newleft  = SplitMergeKeys(BHEAD Pointer,Keys,split);
+	newright = SplitMergeKeys(BHEAD Pointer+split,Keys+split,number-split);
+	if ( newright == 0 ) return(newleft);
+/*
+	The check for runs as in SplitMerge.
+*/
+	if ( newleft > 0 && newright > 0 &&
+	( i = KEYCOMPARE(Keys[newleft-1],Keys[split],Pointer[newleft-1],Pointer[split]) ) >= 0 ) {
+		pp2 = Pointer+split; pp1 = Pointer+newleft-1;
+		kp2 = Keys+split;    kp1 = Keys+newleft-1;
+		if ( i == 0 ) {
+			if ( AddCoef(BHEAD pp1,pp2) > 0 ) { pp1++; kp1++; }
+			else newleft--;
+			pp2++; kp2++; newright--;
+		}
+		else { pp1++; kp1++; }
+		newleft += newright;
+		if ( pp1 < pp2 ) {
+			while ( --newright >= 0 ) { *pp1++ = *pp2++; *kp1++ = *kp2++; }
+		}
+		return(newleft);
+	}
+
+	if ( split >= AN.SplitScratchSize ) {
+		AN.SplitScratchSize = (split*3)/2+100;
+		if ( AN.SplitScratchSize > S->Terms2InSmall/2 )
+			 AN.SplitScratchSize = S->Terms2InSmall/2;
+		if ( AN.SplitScratch ) M_free(AN.SplitScratch,"AN.SplitScratch");
+		AN.SplitScratch = (WORD **)Malloc1(AN.SplitScratchSize*sizeof(WORD *),"AN.SplitScratch");
+	}
+	if ( split >= AN.SplitScratchKeysSize ) {
+		AN.SplitScratchKeysSize = (split*3)/2+100;
+		if ( AN.SplitScratchKeysSize > S->Terms2InSmall/2 )
+			 AN.SplitScratchKeysSize = S->Terms2InSmall/2;
+		if ( AN.SplitScratchKeys ) M_free(AN.SplitScratchKeys,"AN.SplitScratchKeys");
+		AN.SplitScratchKeys = (ULONG *)Malloc1(AN.SplitScratchKeysSize*sizeof(ULONG),"AN.SplitScratchKeys");
+	}
+	pp3 = AN.SplitScratch; pp1 = Pointer;
+	kp3 = AN.SplitScratchKeys; kp1 = Keys;
+	for ( i = 0; i < newleft; i++ ) { *pp3++ = *pp1++; *kp3++ = *kp1++; }
+	AN.InScratch = newleft;
+	pp1 = AN.SplitScratch; pp2 = Pointer + split; pp3 = Pointer;
+	kp1 = AN.SplitScratchKeys; kp2 = Keys + split; kp3 = Keys;
+/*
+		The Timsort style improvement of SplitMerge
+*/
+	while ( newleft > 8 ) {
+		LONG nnleft = newleft/2;
+		if ( ( i = KEYCOMPARE(kp1[nnleft],*kp2,pp1[nnleft],*pp2) ) < 0 ) break;
+		pp3 += nnleft+1; kp3 += nnleft+1;
+		pp1 += nnleft+1; kp1 += nnleft+1;
+		newleft -= nnleft+1;
+		if ( i == 0 ) {
+			if ( AddCoef(BHEAD pp3-1,pp2) == 0 ) { pp3--; kp3--; }
+			pp2++; kp2++;
+			newright--;
+			break;
+		}
+	}
+
+	while ( newleft > 0 && newright > 0 ) {
+		if ( ( i = KEYCOMPARE(*kp1,*kp2,*pp1,*pp2) ) < 0 ) {
+			*pp3++ = *pp2++; *kp3++ = *kp2++;
+			newright--;
+		}
+		else if ( i > 0 ) {
+			*pp3++ = *pp1++; *kp3++ = *kp1++;
+			newleft--;
+		}
+		else {
+			if ( AddCoef(BHEAD pp1,pp2) > 0 ) { *pp3++ = *pp1; *kp3++ = *kp1; }
+			pp1++; pp2++; kp1++; kp2++; newleft--; newright--;
+		}
+	}
+	for ( i = 0; i < newleft; i++ ) { *pp3++ = *pp1++; *kp3++ = *kp1++; }
+	if ( pp3 == pp2 ) {
+		pp3 += newright;
+	} else {
+		for ( i = 0; i < newright; i++ ) { *pp3++ = *pp2++; *kp3++ = *kp2++; }
+	}
+	AN.InScratch = 0;
+	return(pp3 - Pointer);
+}
+
+/*
+ 		#] SplitMergeKeys : 
+ 		#[ HashSmallBuffer :		LONG HashSmallBuffer(Pointer,number)
+*/
+/**
+ *		Adds the terms in the small buffer that differ only in their
+ *		coefficient before they are sorted (On hashsort;). The part of each
+ *		term outside the coefficient is hashed into an open addressing table
+ *		in AN.SortHashes that holds pairs (hash, index+1). Terms with equal
+ *		hashes are compared word by word and equal ones are added with
+ *		AddCoef. When the same monomial comes many times this leaves much
+ *		less work for SplitMerge and for all later stages of the sort.
+ *
+ *		The pointers are those of S->sPointer, so GarbHand, which may be
+ *		called from AddCoef, knows about all terms. Afterwards the pointers
+ *		are packed.
+ *
+ *		@param  Pointer The array of pointers to the terms.
+ *		@param  number  The number of pointers in Pointer.
+ *		@return The number of terms that are left.
+ */
+
+#if BITSINLONG == 64
+#define HASHSEED 14695981039346656037UL
+#define HASHPRIME 1099511628211UL
+#else
+#define HASHSEED 2166136261UL
+#define HASHPRIME 16777619UL
+#endif
+
+LONG HashSmallBuffer(PHEAD WORD **Pointer, LONG number)
+{
+	ULONG *table, h, mask, size = 64;
+	WORD *t, *tstop, *u, *v, **pp;
+	LONG i, j, k;
+	while ( size < 2*(ULONG)number ) size *= 2;
+	if ( (LONG)size > AN.SortHashesSize ) {
+		if ( AN.SortHashes ) M_free(AN.SortHashes,"AN.SortHashes");
+		AN.SortHashesSize = (LONG)size;
+		AN.SortHashes = (ULONG *)Malloc1(2*size*sizeof(ULONG),"AN.SortHashes");
+	}
+	table = AN.SortHashes;
+	mask = size-1;
+	for ( j = 0; j < (LONG)(2*size); j++ ) table[j] = 0;
+	for ( i = 0; i < number; i++ ) {
+		t = Pointer[i];
+		GETSTOP(t,tstop);
+		h = HASHSEED;
+		for ( u = t+1; u < tstop; u++ ) h = ( h ^ (ULONG)((UWORD)(*u)) ) * HASHPRIME;
+		j = (LONG)(( h ^ ( h >> (BITSINLONG/2) ) ) & mask);
+		for (;;) {
+			if ( table[2*j+1] == 0 ) {
+				table[2*j] = h; table[2*j+1] = (ULONG)(i+1);
+				break;
+			}
+			if ( table[2*j] == h ) {
+				k = (LONG)(table[2*j+1])-1;
+				if ( Pointer[k] == 0 ) {	/* Cancelled. Take its place. */
+					table[2*j+1] = (ULONG)(i+1);
+					break;
+				}
+				u = Pointer[k]; GETSTOP(u,v);
+				if ( v-u == tstop-t ) {
+					u++; v = t+1;
+					while ( v < tstop && *u == *v ) { u++; v++; }
+					if ( v >= tstop ) {
+						AddCoef(BHEAD Pointer+k,Pointer+i);
+						Pointer[i] = 0;
+						break;
+					}
+				}
+			}
+			j = ( j+1 ) & mask;
+		}
+	}
+	pp = Pointer;
+	for ( i = 0; i < number; i++ ) {
+		if ( Pointer[i] ) *pp++ = Pointer[i];
+	}
+	k = pp - Pointer;
+	while ( pp < Pointer+number ) *pp++ = 0;
+	return(k);
+}
+
+/*
+ 		#] HashSmallBuffer : 
+ 		#[ SortSmallBuffer :		LONG SortSmallBuffer(Pointer,number)
+*/
+/**
+ *		Sorts the pointers to the terms in the small buffer. Normally this
+ *		is just SplitMerge. When the keyedsort option is on, the regular
+ *		compare routine is active, there is no polyfun and the sort type is
+ *		lowfirst or highfirst, we compute the keys of SortKey first and
+ *		use SplitMergeKeys. The result is identical.
+ *		With the hashsort option equal terms are first added by
+ *		HashSmallBuffer.
+ *		In a worker of TFORM the idle workers may help (HelpedSplitMerge
+ *		in threads.c).
+ *
+ *		@param  Pointer The array of pointers to the terms to be sorted.
+ *		@param  number  The number of pointers in Pointer.
+ *		@return The number of terms after sorting and adding.
+ */
+
+LONG SortSmallBuffer(PHEAD WORD **Pointer, LONG number)
+{
+	GETBIDENTITY
+	SORTING *S = AT.SS;
+	ULONG *k;
+	LONG i;
+	if ( AC.HashSortFlag && number > 2 && S->PolyFlag == 0
+	&& AR.CompareRoutine == (VOID *)&Compare1 )
+		number = HashSmallBuffer(BHEAD Pointer,number);
+#ifdef WITHPTHREADS
+	if ( AT.identity > 0 && S->PolyFlag == 0 && number >= 2*SORTHELPMINTERMS
+	&& AR.CompareRoutine == (VOID *)&Compare1 )
+		return(HelpedSplitMerge(BHEAD Pointer,number));
+#endif
+	if ( AC.KeyedSortFlag == 0 || number <= 2 || S->PolyFlag
+	|| AR.CompareRoutine != (VOID *)&Compare1
+	|| ( AR.SortType != SORTLOWFIRST && AR.SortType != SORTHIGHFIRST ) )
+		return(SplitMerge(BHEAD Pointer,number));
+	if ( number > AN.SortKeysSize ) {
+		AN.SortKeysSize = (number*3)/2+100;
+		if ( AN.SortKeys ) M_free(AN.SortKeys,"AN.SortKeys");
+		AN.SortKeys = (ULONG *)Malloc1(AN.SortKeysSize*sizeof(ULONG),"AN.SortKeys");
+	}
+	k = AN.SortKeys;
+	for ( i = 0; i < number; i++ ) k[i] = SortKey(BHEAD Pointer[i]);
+	return(SplitMergeKeys(BHEAD Pointer,k,number));
+}
+
+/*
+ 		#] SortSmallBuffer : 
+ 		#[ GarbHand :				VOID GarbHand()
+*/
+/**
+ *		Garbage collection that takes place when the small extension is full
+ *		and we need to place more terms there.
+ *		When this is the case there are many holes in the small buffer and
+ *		the whole can be compactified.
+ *		The major complication is the buffer for SplitMerge.
+ *		There are to options for temporary memory:
+ *		1: find some buffer that has enough space (maybe in the large
+ *		   buffer).
+ *		2: allocate a buffer. Give it back afterwards of course.
+ *		If the small extension is properly dimensioned this routine should
+ *		be called very rarely. Most of the time it will be called when the
+ *		polyfun or polyratfun is active.
+ */
+
+VOID GarbHand()
+{
+	GETIDENTITY
+	SORTING *S = AT.SS;
+	WORD **Point, *s2, *t, *garbuf, i;
+	LONG k, total = 0;
+	int tobereturned = 0;
+/*
+	Compute the size needed. Put it in total.
+*/
+#ifdef TESTGARB
+	MLOCK(ErrorMessageLock);
+	MesPrint("in:  S->sFill = %x, S->sTop2 = %x",S->sFill,S->sTop2);
+#endif
+	Point = S->sPointer;
+	k = S->sTerms;
+	while ( --k >= 0 ) {
+		if ( ( s2 = *Point++ ) != 0 ) { total += *s2; }
+	}
+	Point = AN.SplitScratch;
 	k = AN.InScratch;
 	while ( --k >= 0 ) {
 		if ( ( s2 = *Point++ ) != 0 ) { total += *s2; }
@@ -3586,6 +4389,9 @@ VOID GarbHand()
  *
  */
 
+#define SETKEY(x) pkey[x] = ( keyed && poin[x] && *(poin[x]) ) \
+	? SortKey(BHEAD poin[x]) : 0
+
 WORD MergePatches(WORD par)
 {
 	GETIDENTITY
@@ -3596,7 +4402,11 @@ WORD MergePatches(WORD par)
 	UWORD *coef;
 	POSITION position;
 	FILEHANDLE *fin, *fout;
-	int fhandle;
+	int fhandle, keyed;
+	ULONG *pkey = S->pkeys;
+	POSITION stsize, stposition;
+	LONG stcompares = 0, stcpu = 0, stwall = 0, stterms = 0, nout = 0;
+	int stfanin = 0;
 /*
 	UBYTE *s;
 */
@@ -3609,6 +4419,15 @@ WORD MergePatches(WORD par)
 #endif
 	fin = &S->file;
 	fout = &(AR.FoStage4[0]);
+	PUTZERO(stsize); PUTZERO(stposition);
+/*
+	With On keyedsort the streams carry the key of their current term
+	(see SortKey). This settles most of the comparisons in the tree
+	without calling the compare routine.
+*/
+	keyed = AC.KeyedSortFlag && S->PolyFlag == 0
+		&& AR.CompareRoutine == (VOID *)&Compare1
+		&& ( AR.SortType == SORTLOWFIRST || AR.SortType == SORTHIGHFIRST );
 NewMerge:
 	coef = AN.SoScratC;
 	poin = S->poina; poin2 = S->poin2a;
@@ -3653,12 +4472,14 @@ FileMake:
 			PUTZERO(S->fPatches[0]);
 			fout->POfill = fout->PObuffer;	
 			PUTZERO(fout->POposition);
+			if ( par == 1 && S == AT.S0 && AM.MergeProcesses > 1 )
+				InitMergeIndex(S);
 		}
 ConMer:
 		StageSort(fout);
 #ifdef WITHZLIB
 		if ( S == AT.S0 && AR.NoCompress == 0 && AR.gzipCompress > 0 )
-			S->fpcompressed[S->fPatchN] = 1;
+			S->fpcompressed[S->fPatchN] = AM.SortCodec;
 		else
 			S->fpcompressed[S->fPatchN] = 0;
 		SetupOutputGZIP(fout);
@@ -3775,6 +4596,12 @@ ConMer:
 	through PutOut. For this we have to go term by term and keep
 	track of the compression.
 */
+	if ( S->stats ) {
+		stcompares = AN.numcompares; stcpu = TimeCPU(1);
+		stwall = TimeWallClock(1)*10; stterms = S->TermsLeft;
+		stsize = S->SizeInFile[par]; stposition = position;
+		stfanin = S->lPatch; nout = 0;
+	}
 	if ( S->lPatch == 1 ) {	/* Single patch --> direct copy. Very rare. */
 		LONG length;
 
@@ -3797,6 +4624,7 @@ ConMer:
 #endif
 				if ( ( im = PutOut(BHEAD m1,&position,fout,1) ) < 0 ) goto ReturnError;
 				ADDPOS(S->SizeInFile[par],im);
+				nout++;
 				m2 = m1;
 				m1 += *m1;
 			}
@@ -3855,6 +4683,7 @@ ConMer:
 #endif
 					if ( ( im = PutOut(BHEAD m1,&position,fout,1) ) < 0 ) goto ReturnError;
 					ADDPOS(S->SizeInFile[par],im);
+					nout++;
 					m2 = m1;
 					m1 += *m1;
 				}
@@ -3930,6 +4759,7 @@ ConMer:
 			poin[i] = S->Patches[i-k-1];
 			poin2[i] = poin[i] + *(poin[i]);
 		}
+		for ( i = 1; i <= lpat; i++ ) { SETKEY(i); }
 /*
 		the array poin tells the position of the i-th element of the S->tree
 		'S->used' is a stack with the S->tree elements that need to be entered
@@ -3964,7 +4794,8 @@ OneTerm:
 */
 		while ( i >>= 1 ) {
 			if ( S->tree[i] > 0 ) {
-				if ( ( c = CompareTerms(BHEAD poin[S->tree[i]],poin[k],(WORD)0) ) > 0 ) {
+				if ( ( c = KEYCOMPARE(pkey[S->tree[i]],pkey[k],
+						poin[S->tree[i]],poin[k]) ) > 0 ) {
 /*
 					S->tree[i] is the smaller. Exchange and go on.
 */
@@ -4099,6 +4930,8 @@ cancelled:
 						else {
 							poin2[ul] += im;
 						}
+						SETKEY(ul);
+						PREFETCH(poin2[ul]);
 						S->used[++level] = k;
 						S->TermsLeft--;
 					  }
@@ -4168,6 +5001,8 @@ NextTerm:
 					else {
 						poin2[k] += im;
 					}
+					SETKEY(k);
+					PREFETCH(poin2[k]);
 					goto OneTerm;
 				}
 			}
@@ -4180,7 +5015,17 @@ NextTerm:
 /*
 			found the smallest in the set. indicated by k.
 			write to its destination.
+			A helper of ForkMergePatches only writes its own range.
 */
+		if ( S->mindex ) {
+			if ( S->mindex->helper ) {
+				if ( S->mindex->low && CompareTerms(BHEAD
+						poin[k],S->mindex->low,(WORD)0) > 0 ) goto NextTerm;
+				if ( S->mindex->high && CompareTerms(BHEAD
+						poin[k],S->mindex->high,(WORD)0) <= 0 ) goto EndOfMerge;
+			}
+			else if ( par == 1 ) AddMergeIndex(S,poin[k],&position);
+		}
 #ifdef WITHPTHREADS
 		if ( AS.MasterSort && ( fout == AR.outfile ) ) { im = PutToMaster(BHEAD poin[k]); }
 		else
@@ -4192,6 +5037,7 @@ NextTerm:
 			goto ReturnError;
 		}
 		ADDPOS(S->SizeInFile[par],im);
+		nout++;
 		goto NextTerm;
 	}
 	else {
@@ -4212,6 +5058,16 @@ EndOfAll:
 		(S->fPatchN)++;
 		S->fPatches[S->fPatchN] = position;
 	}
+	if ( S->stats && ( S->mindex == 0 || S->mindex->helper == 0 ) ) {
+		POSITION raw, file;
+		DIFPOS(raw,S->SizeInFile[par],stsize);
+		MULPOS(raw,sizeof(WORD));
+		if ( par == 2 || fout == AR.outfile ) { PUTZERO(file); }
+		else { DIFPOS(file,position,stposition); }
+		SortStatsMerge(BHEAD par == 1 ? "patch" : ( fout != AR.outfile ? "stage" : "final" ),
+			stfanin,nout+(stterms-S->TermsLeft),nout,&raw,&file,
+			AN.numcompares-stcompares,stcpu,stwall);
+	}
 	if ( par == 0 && fout != AR.outfile ) {
 /*
 			Output went to sortfile. We have two possibilities:
@@ -4287,7 +5143,7 @@ EndOfAll:
 			goto NewMerge;
 		}
 	}
-	if ( par == 0 ) {
+	if ( par == 0 && ( S->mindex == 0 || S->mindex->helper == 0 ) ) {
 /*		TruncateFile(fin->handle); */
 		UpdateMaxSize();
 #ifdef WITHZLIB
@@ -4331,6 +5187,320 @@ PatCall2:;
 
 /*
  		#] MergePatches : 
+ 		#[ MergeIndex :
+ 			#[ InitMergeIndex :			VOID InitMergeIndex(S)
+*/
+/**
+ *	Prepares the sample of the sort file of the main sort for a new
+ *	sort file. The buffer is allocated the first time it is needed.
+ *	One in every stride terms that go into the sort file is sampled.
+ *	When the buffer is full the stride is doubled and half of the
+ *	samples are dropped. This way the samples stay evenly spread.
+ *
+ *	@param S  The sort struct that owns the sort file.
+ */
+
+#define MIPOS  (2+(LONG)((sizeof(LONG)+sizeof(WORD)-1)/sizeof(WORD)))
+#define MIHEAD (MIPOS+(LONG)((sizeof(POSITION)+sizeof(WORD)-1)/sizeof(WORD)))
+
+VOID InitMergeIndex(SORTING *S)
+{
+	MERGEINDEX *mi = S->mindex;
+	if ( mi == 0 ) {
+		mi = (MERGEINDEX *)Malloc1(sizeof(MERGEINDEX),"MergeIndex");
+		mi->size = S->SmallSize/8 + AM.MaxTer/sizeof(WORD) + MIHEAD;
+		mi->buffer = (WORD *)Malloc1(mi->size*sizeof(WORD),"MergeIndex");
+		mi->helper = 0;
+		S->mindex = mi;
+	}
+	mi->low = mi->high = 0;
+	mi->fill = 0;
+	mi->count = 0;
+	mi->stride = 16;
+}
+
+/*
+ 			#] InitMergeIndex : 
+ 			#[ AddMergeIndex :			VOID AddMergeIndex(S,term,position)
+*/
+/**
+ *	Called by MergePatches for each term that goes to the sort file.
+ *	If the term is to be sampled we make sure it is written uncompressed
+ *	and we remember it together with its patch and its position.
+ *
+ *	@param S         The sort struct that owns the sort file.
+ *	@param term      The term that is about to be written.
+ *	@param position  The position in the sort file at which it goes.
+ */
+
+VOID AddMergeIndex(SORTING *S, WORD *term, POSITION *position)
+{
+	GETIDENTITY
+	MERGEINDEX *mi = S->mindex;
+	LONG ordinal = mi->count++, reclen = MIHEAD + *term;
+	WORD *r, *m, *rstop;
+	LONG ord;
+
+	if ( ordinal % mi->stride != 0 ) return;
+	if ( mi->fill + reclen > mi->size ) {
+		mi->stride *= 2;
+		r = m = mi->buffer; rstop = mi->buffer + mi->fill;
+		while ( r < rstop ) {
+			memcpy(&ord,r+2,sizeof(LONG));
+			if ( ord % mi->stride == 0 ) {
+				if ( m < r ) memmove(m,r,*r*sizeof(WORD));
+				m += *m;
+			}
+			r += *r;
+		}
+		mi->fill = m - mi->buffer;
+		if ( ordinal % mi->stride != 0 || mi->fill + reclen > mi->size ) return;
+	}
+	r = mi->buffer + mi->fill;
+	r[0] = (WORD)reclen;
+	r[1] = S->fPatchN;
+	memcpy(r+2,&ordinal,sizeof(LONG));
+	memcpy(r+MIPOS,position,sizeof(POSITION));
+	memcpy(r+MIHEAD,term,*term*sizeof(WORD));
+	mi->fill += reclen;
+	*AR.CompressPointer = 0;
+}
+
+/*
+ 			#] AddMergeIndex : 
+*/
+#ifdef WITHMERGEPROCESSES
+/*
+ 			#[ MergeSampleCompare :		int MergeSampleCompare(a,b)
+*/
+/**
+ *	Comparison for qsort. Puts the sampled terms in the output order.
+ */
+
+static int MergeSampleCompare(const void *a, const void *b)
+{
+	return(-CompareTerms(BHEAD *((WORD **)a),*((WORD **)b),(WORD)0));
+}
+
+/*
+ 			#] MergeSampleCompare : 
+ 			#[ MergeHelper :			int MergeHelper(low,high,piece)
+*/
+/**
+ *	The work of a helper process of ForkMergePatches.
+ *	Each patch is read from the last sample that comes before low,
+ *	and the merge writes only the terms from low up to, but not including,
+ *	high to the file piece, without compression.
+ *
+ *	@param low    The first term of the range. Zero means no lower bound.
+ *	@param high   The first term after the range. Zero means no upper bound.
+ *	@param piece  The file that receives the output.
+ *	@return  The exit code for the process (0 is OK).
+ */
+
+static int MergeHelper(WORD *low, WORD *high, FILEHANDLE *piece)
+{
+	SORTING *S = AT.SS;
+	MERGEINDEX *mi = S->mindex;
+	FILEHANDLE *fin = &(S->file);
+	WORD *r, *rstop = mi->buffer + mi->fill;
+	if ( ( fin->handle = OpenFile(fin->name) ) < 0 ) return(1);
+	if ( low ) {
+		for ( r = mi->buffer; r < rstop; r += *r ) {
+			if ( CompareTerms(BHEAD r+MIHEAD,low,(WORD)0) <= 0 ) continue;
+			memcpy(&(S->fPatches[r[1]]),r+MIPOS,sizeof(POSITION));
+		}
+	}
+	if ( ( piece->handle = CreateFile(piece->name) ) < 0 ) return(1);
+	PUTZERO(piece->filesize);
+	PUTZERO(piece->POposition);
+	mi->low = low;
+	mi->high = high;
+	mi->helper = 1;
+	AR.outfile = piece;
+	AR.NoCompress = 1;
+	if ( MergePatches(0) ) return(1);
+	CloseFile(piece->handle);
+	return(0);
+}
+
+/*
+ 			#] MergeHelper : 
+ 			#[ ForkMergePatches :		WORD ForkMergePatches()
+*/
+/**
+ *	The final merge of the sort file of the main sort, done by
+ *	AM.MergeProcesses helper processes (setup parameter MergeProcesses).
+ *	The sample of the sort file (see AddMergeIndex) gives splitters that
+ *	cut the output into ranges of about equal size. Each helper is a
+ *	forked copy of FORM that merges all patches but writes only its own
+ *	range to a file of its own. Because equal terms fall in the same
+ *	range their coefficients are added as usual inside one helper.
+ *	Afterwards the pieces are copied in order to the output.
+ *	If anything goes wrong with the helpers the sort file is still intact
+ *	and we fall back on the regular MergePatches. A helper that runs into
+ *	an error leaves via Terminate without any cleanup (AM.MergeChild).
+ *	Compressed patches can only be read from their start. Then each helper
+ *	would read everything and we merge ourselves.
+ */
+
+WORD ForkMergePatches()
+{
+	SORTING *S = AT.SS;
+	MERGEINDEX *mi = S->mindex;
+	FILEHANDLE *fin = &(S->file), *fout = AR.outfile, **pieces;
+	WORD **samples, **split, *r, *rstop, *t, *top;
+	LONG nsamples, size, fill, nterms = 0;
+	int nh = AM.MergeProcesses, i, j, handle, status, failed = 0;
+	pid_t *pids;
+	POSITION position;
+#ifdef WITHZLIB
+	int oldgzipCompress = AR.gzipCompress;
+#endif
+
+	if ( nh < 2 || mi == 0 || mi->helper || S != AT.S0 || AR.sLevel != 0
+	|| S->stage4 || S->fPatchN < 2 ) return(MergePatches(0));
+	rstop = mi->buffer + mi->fill;
+	nsamples = 0;
+	for ( r = mi->buffer; r < rstop; r += *r ) nsamples++;
+	if ( nsamples < 4*nh ) return(MergePatches(0));
+#ifdef WITHZLIB
+	for ( i = 0; i < S->fPatchN; i++ ) {
+		if ( S->fpcompressed[i] ) return(MergePatches(0));
+	}
+#endif
+
+	samples = (WORD **)Malloc1(nsamples*sizeof(WORD *)+nh*sizeof(WORD *),"MergeSamples");
+	split = samples + nsamples;
+	pieces = (FILEHANDLE **)Malloc1(nh*sizeof(FILEHANDLE *),"MergePieces");
+	pids = (pid_t *)Malloc1(nh*sizeof(pid_t),"MergePids");
+	i = 0;
+	for ( r = mi->buffer; r < rstop; r += *r ) samples[i++] = r + MIHEAD;
+	qsort(samples,nsamples,sizeof(WORD *),&MergeSampleCompare);
+	split[0] = 0;
+	for ( j = 1; j < nh; j++ ) split[j] = samples[(j*nsamples)/nh];
+	for ( j = 0; j < nh; j++ ) pieces[j] = AllocFileHandle(0,(char *)"");
+/*
+	Start the helpers and wait for them.
+*/
+	for ( j = 0; j < nh; j++ ) {
+		if ( ( pids[j] = fork() ) == 0 ) {
+			AM.MergeChild = 1;
+#ifdef TRAPSIGNALS
+			resetSignalHandlers();
+#endif
+			_exit(MergeHelper(split[j],j+1 < nh ? split[j+1] : 0,pieces[j]));
+		}
+		if ( pids[j] < 0 ) { failed = 1; break; }
+	}
+	for ( i = 0; i < j; i++ ) {
+		if ( waitpid(pids[i],&status,0) != pids[i]
+		|| !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) failed = 1;
+	}
+	if ( failed ) goto Cleanup;
+/*
+	Copy the pieces to the output.
+*/
+#ifdef WITHZLIB
+	AR.gzipCompress = 0;
+#endif
+	if ( fout->handle >= 0 ) {
+		PUTZERO(position);
+		SeekFile(fout->handle,&position,SEEK_END);
+		ADDPOS(position,((fout->POfill-fout->PObuffer)*sizeof(WORD)));
+	}
+	else {
+		SETBASEPOSITION(position,(fout->POfill-fout->PObuffer)*sizeof(WORD));
+	}
+	*AR.CompressPointer = 0;
+	for ( j = 0; j < nh && failed == 0; j++ ) {
+		if ( ( handle = OpenFile(pieces[j]->name) ) < 0 ) { failed = 2; break; }
+		fill = 0;
+		for ( ;; ) {
+			if ( ( size = ReadFile(handle,(UBYTE *)(S->sBuffer+fill),
+					(S->SmallEsize-fill)*sizeof(WORD)) ) < 0 ) { failed = 2; break; }
+			top = S->sBuffer + fill + size/sizeof(WORD);
+			t = S->sBuffer;
+			while ( t < top && *t > 0 && t + *t <= top ) {
+				if ( ( i = PutOut(BHEAD t,&position,fout,1) ) < 0 ) { failed = 2; break; }
+				ADDPOS(S->SizeInFile[0],i);
+				nterms++;
+				t += *t;
+			}
+			if ( failed || ( t < top && *t == 0 ) ) break;
+			if ( size == 0 ) { failed = 2; break; }
+			fill = top - t;
+			r = S->sBuffer;
+			while ( t < top ) *r++ = *t++;
+		}
+		CloseFile(handle);
+	}
+#ifdef WITHZLIB
+	AR.gzipCompress = oldgzipCompress;
+#endif
+	if ( failed == 0 ) {
+		if ( FlushOut(&position,fout,1) ) failed = 2;
+		ADDPOS(S->SizeInFile[0],1);
+		S->TermsLeft = nterms;
+		UpdateMaxSize();
+#ifdef WITHZLIB
+		ClearSortGZIP(fin);
+#endif
+		CloseFile(fin->handle);
+		remove(fin->name);
+		fin->handle = -1;
+	}
+Cleanup:
+	for ( j = nh-1; j >= 0; j-- ) {
+		remove(pieces[j]->name);
+		DeAllocFileHandle(pieces[j]);
+	}
+	M_free(pids,"MergePids");
+	M_free(pieces,"MergePieces");
+	M_free(samples,"MergeSamples");
+	if ( failed == 1 ) return(MergePatches(0));
+	if ( failed ) {
+		MLOCK(ErrorMessageLock);
+		MesPrint("Error while collecting the output of the merge processes");
+		MesCall("ForkMergePatches");
+		MUNLOCK(ErrorMessageLock);
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+ 			#] ForkMergePatches : 
+*/
+#endif
+/*
+ 		#] MergeIndex : 
+ 		#[ GrowTermsInSmall :
+*/
+/**
+ *	Used with the setup parameter SortMemory when the small buffer is
+ *	full. If it was the number of terms that ran out rather than the
+ *	space, the terms are smaller than was assumed and the next time we
+ *	allow more of them, up to the number of pointers that was allocated.
+ *	The maximum number of terms can only grow and the buffers themselves
+ *	are never shrunk or reallocated: the memory that SortMemory gives
+ *	is allocated once at startup.
+ *
+ *	@param S The sort of which the small buffer is full
+ */
+
+static VOID GrowTermsInSmall(SORTING *S)
+{
+	LONG used = S->sFill - S->sBuffer, terms;
+	if ( S->sTerms < S->TermsInSmall || used <= 0 ) return;
+	terms = (LONG)(((double)(S->sTerms))*S->SmallSize/used);
+	if ( terms > S->Terms2InSmall/2 ) terms = S->Terms2InSmall/2;
+	terms &= -16L;
+	if ( terms > S->TermsInSmall ) S->TermsInSmall = terms;
+}
+
+/*
+ 		#] GrowTermsInSmall : 
  		#[ StoreTerm :				WORD StoreTerm(term)
 */
 /**
@@ -4349,6 +5519,9 @@ WORD StoreTerm(PHEAD WORD *term)
 	WORD **ss, *lfill, j, *t;
 	POSITION pp;
 	LONG lSpace, sSpace, RetCode, over, tover;
+#ifdef WITHPTHREADS
+	int profile;
+#endif
 
 	if ( ( ( AP.PreDebug & DUMPTOSORT ) == DUMPTOSORT ) && AR.sLevel == 0 ) {
 #ifdef WITHPTHREADS
@@ -4364,13 +5537,17 @@ WORD StoreTerm(PHEAD WORD *term)
 /*
 	The small buffer is full. It has to be sorted and written.
 */
+#ifdef WITHPTHREADS
+		profile = ProfileSwitch(AT.identity,PROFSORT);
+#endif
+		if ( AM.SortMemory > 0 ) GrowTermsInSmall(S);
 		tover = over = S->sTerms;
 		ss = S->sPointer;
 		ss[over] = 0;
 /*
 		PrintTime();
 */
-		ss[SplitMerge(BHEAD ss,over)] = 0;
+		ss[SortSmallBuffer(BHEAD ss,over)] = 0;
 		sSpace = 0;
 		if ( over > 0 ) {
 			sSpace = ComPress(ss,&RetCode);
@@ -4432,6 +5609,9 @@ WORD StoreTerm(PHEAD WORD *term)
 		S->sTerms = 0;
 		S->PoinFill = S->sPointer;
 		*(S->PoinFill) = S->sFill = S->sBuffer;
+#ifdef WITHPTHREADS
+		ProfileSwitch(AT.identity,profile);
+#endif
 	}
 	j = *term;
 	while ( --j >= 0 ) *S->sFill++ = *term++;
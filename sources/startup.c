@@ -923,6 +923,8 @@ VOID StartVariables()
 	AC.TableBaseList.size = sizeof(DBASE);
 	AC.TestValue = 0;
 	AC.InnerTest = 0;
+	AC.KeyedSortFlag = 0;
+	AC.HashSortFlag = 0;
 
 	AC.AutoSymbolList.message = "autosymbol";
 	AC.AutoSymbolList.size = sizeof(struct SyMbOl);
@@ -980,6 +982,7 @@ VOID StartVariables()
 #ifndef WITHPTHREADS
 	AT.ebufnum = inicbufs();		/* Buffer for extras during execution */
 	AT.fbufnum = inicbufs();		/* Buffer for caching in factorization */
+	AT.rfbufnum = inicbufs();		/* Buffer for caching PolyRatFun results */
 	AT.allbufnum = inicbufs();		/* Buffer for id,all */
 	AT.aebufnum = inicbufs();		/* Buffer for id,all */
 	AN.tryterm = 0;
@@ -1154,6 +1157,12 @@ VOID StartVariables()
 	AC.StatsFlag = AM.gStatsFlag = AM.ggStatsFlag = 1;
 	AC.ThreadsFlag = AM.gThreadsFlag = AM.ggThreadsFlag = 1;
 	AC.ThreadBalancing = AM.gThreadBalancing = AM.ggThreadBalancing = 1;
+	AC.ThreadWorkStealing = AM.gThreadWorkStealing = AM.ggThreadWorkStealing = 1;
+	AC.ThreadHandoffStats = 0;
+	AC.ThreadSortHelp = 1;
+	AC.ThreadGcdHelp = 1;
+	AC.ThreadProfile = 0;
+	AC.ThreadBucketAutotune = AM.gThreadBucketAutotune = AM.ggThreadBucketAutotune = 1;
 	AC.ThreadSortFileSynch = AM.gThreadSortFileSynch = AM.ggThreadSortFileSynch = 0;
 	AC.ProcessStats = AM.gProcessStats = AM.ggProcessStats = 1;
 	AC.OldParallelStats = AM.gOldParallelStats = AM.ggOldParallelStats = 0;
@@ -1432,6 +1441,10 @@ WORD IniVars()
 	AN.SplitScratchSize = AN.InScratch = 0;
 	AN.SplitScratch1 = 0;
 	AN.SplitScratchSize1 = AN.InScratch1 = 0;
+	AN.SortKeys = AN.SplitScratchKeys = 0;
+	AN.SortKeysSize = AN.SplitScratchKeysSize = 0;
+	AN.SortHashes = 0;
+	AN.SortHashesSize = 0;
 	AN.idfunctionflag = 0;
 #endif
 	AO.OutputLine = AO.OutFill = BufferForOutput;
@@ -1514,6 +1527,38 @@ VOID setSignalHandlers()
 /*	setNewSig(SIGPROF,onErrSig); */  /* Why did Tentukov forbid profilers?? */
 }
 
+/*
+	Sets the signals that were trapped by setSignalHandlers back to their
+	default behaviour. For child processes that should not clean up.
+*/
+
+static VOID resetSig(int i)
+{
+	if(! (i<NSIG) )
+		return;
+	if ( signal(i,SIG_DFL) == SIG_IGN )
+		signal(i,SIG_IGN);
+}
+
+VOID resetSignalHandlers()
+{
+	resetSig(SIGSEGV);
+	resetSig(SIGFPE);
+	resetSig(SIGILL);
+	resetSig(SIGEMT);
+	resetSig(SIGSYS);
+	resetSig(SIGPIPE);
+	resetSig(SIGLOST);
+	resetSig(SIGXCPU);
+	resetSig(SIGXFSZ);
+	resetSig(SIGTERM);
+	resetSig(SIGINT);
+	resetSig(SIGQUIT);
+	resetSig(SIGHUP);
+	resetSig(SIGALRM);
+	resetSig(SIGVTALRM);
+}
+
 #endif
 /*:[28apr2004 mt]*/
 /*
@@ -1596,7 +1641,8 @@ int main(int argc, char **argv)
 	IniFbufs();
 #else
 	ReserveTempFiles(0);
-	IniFbuffer(AT.fbufnum);
+	IniFbuffer(AT.fbufnum,AM.fbuffersize);
+	IniFbuffer(AT.rfbufnum,AM.rfbuffersize);
 #endif
 	PrintHeader(1);
 	IniVars();
@@ -1697,6 +1743,13 @@ static int firstterminate = 1;
 
 VOID Terminate(int errorcode)
 {
+/*
+	A helper process of the merge shares the files with its parent and
+	should not remove them. The parent sees the exit code.
+*/
+#ifdef UNIX
+	if ( AM.MergeChild ) _exit(errorcode ? 1 : 0);
+#endif
 	if ( errorcode && firstterminate ) {
 		firstterminate = 0;
 #ifdef WITHPTHREADS
@@ -1745,6 +1798,7 @@ VOID Terminate(int errorcode)
 		if ( AM.PrintTotalSize ) {
 			MesPrint("Max. space for expressions: %19p bytes",&(AS.MaxExprSize));
 		}
+		if ( errorcode == 0 ) PrintRatFunCache();
 		PrintRunningTime();
 	}
 #ifdef WITHMPI
@@ -1814,6 +1868,39 @@ VOID PrintRunningTime()
 
 /*
  		#] PrintRunningTime : 
+ 		#[ PrintRatFunCache :
+*/
+/**
+ *	Prints how often the PolyRatFun cache (see poly_ratfun_add and
+ *	poly_ratfun_normalize in polywrap.cc) had the result, summed over
+ *	all threads. Nothing is printed when the cache has not been used.
+ *	Terminate calls it only when the program ends without an error.
+ */
+
+VOID PrintRatFunCache()
+{
+	LONG hits = 0, misses = 0;
+#ifdef WITHPTHREADS
+	int i;
+	if ( AB[0] == 0 ) return;
+	for ( i = 0; i < AM.totalnumberofthreads; i++ ) {
+		hits += AB[i]->T.rfcachehits;
+		misses += AB[i]->T.rfcachemisses;
+	}
+#else
+#ifdef WITHMPI
+	if ( PF.me != MASTER ) return;
+#endif
+	hits = AT.rfcachehits;
+	misses = AT.rfcachemisses;
+#endif
+	if ( hits+misses > 0 && !AM.silent ) {
+		MesPrint("PolyRatFun cache: %l hits, %l misses",hits,misses);
+	}
+}
+
+/*
+ 		#] PrintRatFunCache : 
  		#[ GetRunningTime :
 */
 
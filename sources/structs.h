@@ -516,7 +516,7 @@ typedef struct DoLlArS {
 	WORD	*where;				/* A pointer(!) to the object */
 	FACDOLLAR *factors;			/* an array of factors. nfactors elements */
 #ifdef WITHPTHREADS
-	pthread_mutex_t	pthreadslockread;
+	pthread_rwlock_t	pthreadslockread;	/* Shared by readers, exclusive for writers */
 	pthread_mutex_t	pthreadslockwrite;
 #endif
 	LONG	size;				/* The number of words */
@@ -528,7 +528,7 @@ typedef struct DoLlArS {
 	WORD	numdummies;
 	WORD	nfactors;
 #ifdef WITHPTHREADS
-	PADPOINTER(2,0,6,sizeof(pthread_mutex_t)*2);
+	PADPOINTER(2,0,6,sizeof(pthread_rwlock_t)+sizeof(pthread_mutex_t));
 #else
 	PADPOINTER(2,0,6,0);
 #endif
@@ -1057,6 +1057,44 @@ typedef struct PaRtI {
     PADPOINTER(0,0,3,0);
 } PARTI;
 
+/**
+ *  The struct MERGEINDEX keeps a sample of the terms that are written to
+ *  the sort file of the main sort (see the MergeProcesses setup parameter).
+ *  Each record is (length, patch, ordinal, position, term) and the sampled
+ *  terms are written uncompressed, so that reading a patch can start there.
+ *  The helper processes of the final merge use low and high to restrict
+ *  their output to a range of terms.
+ */
+
+typedef struct MeRgEiNdEx {
+    WORD *buffer;               /* The records */
+    WORD *low;                  /* First term of the range of a helper */
+    WORD *high;                 /* First term after the range of a helper */
+    LONG size;                  /* Size of the buffer in words */
+    LONG fill;                  /* Words in use */
+    LONG stride;                /* One in stride terms is sampled */
+    LONG count;                 /* Terms written to the sort file */
+    int helper;                 /* Are we inside a helper process? */
+    PADPOSITION(3,4,1,0,0);
+} MERGEINDEX;
+
+/**
+ *  The struct SORTSTATS collects the numbers for the records that are
+ *  written when the setup parameter SortStatistics is used. Only the
+ *  main sort (AT.S0) has one. All values refer to the current sort.
+ */
+
+typedef struct SoRtStAtS {
+    POSITION rawbytes;          /* Bytes of the terms for the sort file */
+    POSITION filebytes;         /* Bytes on the sort file after gzip etc. */
+    LONG cputime;               /* CPU time at the start of the sort */
+    LONG walltime;              /* Wall clock time at the start of the sort */
+    LONG patches;               /* Patches written to the sort file */
+    LONG stages;                /* Merges of the sort file into a new one */
+    int maxfanin;               /* Largest number of patches in one merge */
+    PADPOSITION(0,4,1,0,0);
+} SORTSTATS;
+
 /**
  *  The struct SORTING is used to control a sort operation.
  *  It includes a small and a large buffer and arrays for keeping track
@@ -1086,6 +1124,7 @@ typedef struct sOrT {
     WORD **pStop;               /* Ends of patches in the large buffer */
     WORD **poina;               /*  auxiliary during actual sort */
     WORD **poin2a;              /*  auxiliary during actual sort */
+    ULONG *pkeys;               /*  keys of the terms in poina (keyedsort) */
     WORD *ktoi;                 /*  auxiliary during actual sort */
     WORD *tree;                 /*  auxiliary during actual sort */
 #ifdef WITHZLIB
@@ -1099,6 +1138,8 @@ typedef struct sOrT {
     POSITION *iPatches;         /* Input file patches, Points to fPatches or inPatches */
     FILEHANDLE *f;              /* The actual output file */
     FILEHANDLE **ff;            /* Handles for a staged sort */
+    MERGEINDEX *mindex;         /* Sample of the sort file (MergeProcesses) */
+    SORTSTATS *stats;           /* Counts for the SortStatistics records */
     LONG sTerms;                /* Terms in small buffer */
     LONG LargeSize;             /* Size of large buffer (in words) */
     LONG SmallSize;             /* Size of small buffer (in words) */
@@ -1127,9 +1168,9 @@ typedef struct sOrT {
     WORD inNum;                 /* Number of patches on file (input) */
     WORD stage4;                /* Are we using stage4? */
 #ifdef WITHZLIB
-    PADPOSITION(28,12,12,3,0);
+    PADPOSITION(31,12,12,3,0);
 #else
-    PADPOSITION(25,12,12,3,0);
+    PADPOSITION(28,12,12,3,0);
 #endif
 } SORTING;
 
@@ -1177,15 +1218,91 @@ typedef struct ThReAdBuCkEt {
     LONG firstterm;             /* The number of the first term in the bucket */
     LONG firstbracket;          /* When doing complete brackets */
     LONG lastbracket;           /* When doing complete brackets */
+    LONG sendtime;              /* When the master sent it, for the autotuning */
     pthread_mutex_t lock;       /* For the load balancing phase */
     int  free;                  /* Status of the bucket */
     int  totnum;                /* Total number of primary terms */
     int  usenum;                /* Which is the term being used at the moment */
     int  busy;                  /*  */
     int  type;                  /* Doing brackets? */
-    PADPOINTER(5,5,0,sizeof(pthread_mutex_t));
+    PADPOINTER(6,5,0,sizeof(pthread_mutex_t));
 } THREADBUCKET;
 
+/**
+ *  The HANDOFF struct keeps for each thread of TFORM how it received its
+ *  work (see the ThreadSpin setup parameter and the threadhandoffstats
+ *  option) and the current adaptive spin budget.
+ */
+
+typedef struct HaNdOfF {
+    LONG spinwakeups;           /* Signals caught while spinning */
+    LONG parkedwakeups;         /* Signals that needed a sleep on the condition */
+    LONG stolen;                /* Buckets taken by the worker itself */
+    LONG sent;                  /* Buckets sent by the master */
+    LONG missed;                /* Claims on a bucket that someone else got */
+    LONG sortparts;             /* Parts of sorts done for other workers */
+    LONG gcdimages;             /* Images of gcds done for other workers */
+    LONG mctsexpansions;        /* Expansions of the MCTS tree of Optimize */
+    LONG spinbudget;            /* Current number of spins before sleeping */
+} HANDOFF;
+
+/**
+ *  The THREADPROFILE struct accumulates for each thread of TFORM the time
+ *  spent in each of the PROFITEMS categories of ftypes.h during the current
+ *  module (see the threadprofile option). Only the thread itself writes
+ *  in it while the module runs, and only when the profile is on.
+ */
+
+typedef struct ThReAdPrOfIlE {
+    LONG time[PROFITEMS];       /* Nanoseconds per category */
+    LONG stamp;                 /* When the current category started */
+    int category;               /* The category that is running now */
+    int dummy;
+    LONG fill[14-PROFITEMS];    /* 128 bytes: no shared cache lines */
+} THREADPROFILE;
+
+/**
+ *  A SORTHELP describes a part of the small buffer of a worker that
+ *  another worker sorts for it (see HelpedSplitMerge). The state is one of
+ *  the SORTHELP values in ftypes.h and it is protected by the
+ *  wakeupmasterlock until the part is taken, and by lock afterwards.
+ */
+
+typedef struct SoRtHeLp {
+    WORD **Pointer;             /* The part of the array of pointers */
+    WORD **scratch;             /* Space for the helper */
+    LONG number;                /* Number of pointers in the part */
+    LONG scratchsize;           /* Allocated size of scratch */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int owner;                  /* The worker that asked for help */
+    int state;
+} SORTHELP;
+
+/**
+ *  A GCDHELP is the image modulo a prime of a polynomial gcd that
+ *  another worker calculates for the worker that is doing the gcd (see
+ *  gcd_modular_images in polygcd.cc). The polynomials are in the notation
+ *  of poly.h and belong to the owner. The state is as for SORTHELP.
+ */
+
+typedef struct GcDhElP {
+    WORD *a;                    /* The polynomials of the gcd */
+    WORD *b;
+    WORD *g;                    /* The leading coefficient of the gcd */
+    WORD *d;                    /* The shape from the previous images */
+    WORD *result;               /* The image, made by the helper */
+    int *x;                     /* The variables */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int owner;                  /* The worker that asked for help */
+    int state;
+    int status;                 /* The outcome of gcd_modular_image */
+    int numx;                   /* The number of variables in x */
+    WORD prime;
+    WORD numvars;               /* AN.poly_num_vars of the owner */
+} GCDHELP;
+
 #endif
 
 /**
@@ -1327,6 +1444,7 @@ struct M_const {
     UBYTE   *Path;                 /* (M) */
     UBYTE   *SetupDir;             /* (M) Directory with setup file */
     UBYTE   *SetupFile;            /* (M) Name of setup file */
+    UBYTE   *SortStatsFile;        /* (M) File for the records of the sorts */
     UBYTE   *gFortran90Kind;
 	UBYTE   *gextrasym;
 	UBYTE   *ggextrasym;
@@ -1338,6 +1456,7 @@ struct M_const {
 	pthread_mutex_t	sbuflock;      /* (M) Lock for writing in the AM.sbuffer */
     LONG    ThreadScratSize;       /* (M) Size of Fscr[0/2] buffers of the workers */
     LONG    ThreadScratOutSize;    /* (M) Size of Fscr[1] buffers of the workers */
+    LONG    ThreadSpin;            /* (M) Max spins before a thread sleeps */
 #endif
     LONG    MaxTer;                /* (M) Maximum term size. Fixed at setup. In Bytes!!!*/
     LONG    CompressSize;          /* (M) Size of Compress buffer */
@@ -1350,6 +1469,7 @@ struct M_const {
     LONG    SSmallEsize;           /* (M) */
     LONG    SSmallSize;            /* (M) */
     LONG    STermsInSmall;         /* (M) */
+    LONG    SortMemory;            /* (M) Budget for all sort buffers (0: off) */
     LONG    MaxBracketBufferSize;  /* (M) Max Size for B+ or AB+ per expression */
     LONG    hProcessBucketSize;    /* (M) */
     LONG    gProcessBucketSize;    /* (M) */
@@ -1389,6 +1509,8 @@ struct M_const {
     int     hparallelflag;         /* (M) */
     int     gparallelflag;         /* (M) */
     int     totalnumberofthreads;  /* (M) */
+    int     ThreadNuma;            /* (M) Place the threads on the NUMA nodes */
+    int     ThreadNumaNodes;       /* (M) Nodes for the merge tree only, no binding */
     int     gSizeCommuteInSet;
     int     gThreadStats;
     int     ggThreadStats;
@@ -1398,6 +1520,10 @@ struct M_const {
     int     ggThreadsFlag;
     int     gThreadBalancing;
     int     ggThreadBalancing;
+    int     gThreadWorkStealing;
+    int     ggThreadWorkStealing;
+    int     gThreadBucketAutotune;
+    int     ggThreadBucketAutotune;
     int     gThreadSortFileSynch;
     int     ggThreadSortFileSynch;
     int     gProcessStats;
@@ -1413,6 +1539,7 @@ struct M_const {
     int     gIsFortran90;
 	int		PrintTotalSize;
     int     fbuffersize;           /* Size for the AT.fbufnum factorization caches */
+    int     rfbuffersize;          /* Size for the AT.rfbufnum PolyRatFun caches */
     int     gOldFactArgFlag;
     int     ggOldFactArgFlag;
     int     gnumextrasym;
@@ -1423,6 +1550,10 @@ struct M_const {
     int     ggOldGCDflag;
     int     gWTimeStatsFlag;
     int     ggWTimeStatsFlag;
+    int     MergeProcesses;        /* (M) Helpers for the final merge of a sort file */
+    int     SortCodec;             /* (M) Compression method of the sort file patches */
+    int     SortStatsHandle;       /* (M) Handle of AM.SortStatsFile */
+    int     MergeChild;            /* (M) We are a helper process of ForkMergePatches */
     WORD    MaxTal;                /* (M) Maximum number of words in a number */
     WORD    IndDum;                /* (M) Basis value for dummy indices */
     WORD    DumInd;                /* (M) */
@@ -1481,9 +1612,9 @@ struct M_const {
     WORD    havesortdir;
     WORD    BracketFactors[8];
 #ifdef WITHPTHREADS
-	PADPOSITION(17,25,61,81,sizeof(pthread_rwlock_t)+sizeof(pthread_mutex_t)*2);
+	PADPOSITION(18,27,72,81,sizeof(pthread_rwlock_t)+sizeof(pthread_mutex_t)*2);
 #else
-	PADPOSITION(17,23,61,81,0);
+	PADPOSITION(18,24,72,81,0);
 #endif
 };
 /*
@@ -1641,6 +1772,7 @@ struct C_const {
     WORD    *IfSumCheck;           /**< [D] Keeps track of if-nesting */
     WORD    *CommuteInSet;         /* groups of noncommuting functions that can commute */
     UBYTE   *TestValue;            /* For debugging */
+    UBYTE   *ThreadProfileName;    /* File for On threadprofile */
 #ifdef PARALLELCODE
     LONG    *inputnumbers;         /**< [D] For redefine */
     WORD    *pfirstnum;            /**< For redefine. Points into inputnumbers memory */
@@ -1701,6 +1833,12 @@ struct C_const {
     int     OldParallelStats;      /* (C) */
     int     ThreadsFlag;
     int     ThreadBalancing;
+    int     ThreadWorkStealing;    /* (C) Workers take filled buckets themselves */
+    int     ThreadHandoffStats;    /* (C) Print the HANDOFF counters at the end */
+    int     ThreadSortHelp;        /* (C) Idle workers help with InParallel sorts */
+    int     ThreadGcdHelp;         /* (C) Idle workers calculate images of big gcds */
+    int     ThreadProfile;         /* (C) Write the times of the threads per module */
+    int     ThreadBucketAutotune;  /* (C) Adapt the bucket size to the cost of the terms */
     int     ThreadSortFileSynch;
     int     ProcessStats;          /* (C) */
     int     BracketNormalize;      /* (C) Indicates whether the bracket st is normalized */
@@ -1726,6 +1864,8 @@ struct C_const {
     int     MemDebugFlag;          /* Only used when MALLOCDEBUG in tools.c */
     int     OldGCDflag;
     int     WTimeStatsFlag;
+    int     KeyedSortFlag;         /* On keyedsort: prefix keys in SplitMerge */
+    int     HashSortFlag;          /* On hashsort: add equal terms before sorting */
 	int     doloopstacksize;
 	int     dolooplevel;
     int     CheckpointFlag;        /**< Tells preprocessor whether checkpoint code must executed.
@@ -1791,11 +1931,11 @@ struct C_const {
     UBYTE   Commercial[COMMERCIALSIZE+2]; /* (C) Message to be printed in statistics */
     UBYTE   debugFlags[MAXFLAGS+2];    /* On/Off Flag number(s) */
 #if defined(WITHPTHREADS)
-	PADPOSITION(47,8+3*MAXNEST,72,45+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17+sizeof(pthread_mutex_t));
+	PADPOSITION(48,8+3*MAXNEST,80,45+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17+sizeof(pthread_mutex_t));
 #elif defined(WITHMPI)
-	PADPOSITION(47,8+3*MAXNEST,72,46+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17);
+	PADPOSITION(48,8+3*MAXNEST,80,46+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17);
 #else
-	PADPOSITION(45,8+3*MAXNEST,70,45+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17);
+	PADPOSITION(46,8+3*MAXNEST,78,45+3*MAXNEST+MAXREPEAT,COMMERCIALSIZE+MAXFLAGS+4+sizeof(LIST)*17);
 #endif
 };
 /*
@@ -1990,10 +2130,13 @@ struct T_const {
     LONG    lWorkPointer;          /* (R) Offset-pointer in lWorkSpace */
     LONG    posWorkPointer;        /* (R) Offset-pointer in posWorkSpace */
     LONG    InNumMem;
+    LONG    rfcachehits;           /* Lookups in the PolyRatFun cache that were found */
+    LONG    rfcachemisses;         /* and that were not found */
     int     sfact;                 /* (T) size of the factorials buffer */
     int     mfac;                  /* (T) size of the pfac array. */
     int     ebufnum;               /* (R) extra compiler buffer */
     int     fbufnum;               /* extra compiler buffer for factorization cache */
+    int     rfbufnum;              /* extra compiler buffer for PolyRatFun cache */
     int     allbufnum;             /* extra compiler buffer for id,all */
     int     aebufnum;              /* extra compiler buffer for id,all */
     int     idallflag;             /* indicates use of id,all buffers */
@@ -2048,12 +2191,12 @@ struct T_const {
     WORD    fromindex;             /* Tells the compare routine whether call from index */
 #ifdef WITHPTHREADS
 #ifdef WITHSORTBOTS
-	PADPOINTER(5,27,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
+	PADPOINTER(7,28,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
 #else
-	PADPOINTER(5,25,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
+	PADPOINTER(7,26,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
 #endif
 #else
-	PADPOINTER(5,23,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
+	PADPOINTER(7,24,100+SUBEXPSIZE*4+FUNHEAD*2+ARGHEAD*2,0);
 #endif
 };
 /*
@@ -2102,6 +2245,7 @@ struct N_const {
 #ifdef WITHZLIB
 	Bytef	**ziobufnum;           /* () Used in compress.c */
 	Bytef	*ziobuffers;           /* () Used in compress.c */
+	Bytef	*zfastbuffers;         /* () Used in compress.c */
 #endif
 	WORD	*dummyrenumlist;       /* () Used in execute.c and store.c */
 	int		*funargs;              /* () Used in lus.c */
@@ -2119,6 +2263,9 @@ struct N_const {
 	FUN_INFO *FunInfo;             /* () Used in smart.c */
 	WORD	**SplitScratch;        /* () Used in sort.c */
 	WORD	**SplitScratch1;       /* () Used in sort.c */
+	ULONG	*SortKeys;             /* () Used in sort.c (keyedsort) */
+	ULONG	*SplitScratchKeys;     /* () Used in sort.c (keyedsort) */
+	ULONG	*SortHashes;           /* () Used in sort.c (hashsort) */
 	SORTING **FunSorts;            /* () Used in sort.c */
 	UWORD	*SoScratC;             /* () Used in sort.c */
 	WORD	*listinprint;          /* () Used in proces.c and message.c */
@@ -2142,6 +2289,9 @@ struct N_const {
 	LONG	SplitScratchSize;      /* () Used in sort.c */
 	LONG	InScratch1;            /* () Used in sort.c */
 	LONG	SplitScratchSize1;     /* () Used in sort.c */
+	LONG	SortKeysSize;          /* () Used in sort.c */
+	LONG	SplitScratchKeysSize;  /* () Used in sort.c */
+	LONG	SortHashesSize;        /* () Used in sort.c */
 	LONG	ninterms;              /* () Used in proces.c and sort.c */
 #ifdef WITHPTHREADS
 	LONG	inputnumber;           /* () For use in redefine */
@@ -2152,6 +2302,7 @@ struct N_const {
 	LONG	last3;                 /* () Used in proces.c */
 #endif
 	LONG	SHcombisize;
+	LONG	numcompares;           /* () Calls of Compare1 in the main sort */
     int     NumTotWildArgs;        /* (N) Used in pattern matching */
     int     UseFindOnly;           /* (N) Controls pattern routines */
     int     UsedOtherFind;         /* (N) Controls pattern routines */
@@ -2208,29 +2359,29 @@ struct N_const {
 #ifdef WITHPTHREADS
 #ifdef WHICHSUBEXPRESSION
 #ifdef WITHZLIB
-	PADPOSITION(55,11,23,28,sizeof(SHvariables));
+	PADPOSITION(59,15,23,28,sizeof(SHvariables));
 #else
-	PADPOSITION(53,11,23,28,sizeof(SHvariables));
+	PADPOSITION(56,15,23,28,sizeof(SHvariables));
 #endif
 #else
 #ifdef WITHZLIB
-	PADPOSITION(54,9,23,26,sizeof(SHvariables));
+	PADPOSITION(58,13,23,26,sizeof(SHvariables));
 #else
-	PADPOSITION(52,9,23,26,sizeof(SHvariables));
+	PADPOSITION(55,13,23,26,sizeof(SHvariables));
 #endif
 #endif
 #else
 #ifdef WHICHSUBEXPRESSION
 #ifdef WITHZLIB
-	PADPOSITION(53,9,23,28,sizeof(SHvariables));
+	PADPOSITION(57,13,23,28,sizeof(SHvariables));
 #else
-	PADPOSITION(51,9,23,28,sizeof(SHvariables));
+	PADPOSITION(54,13,23,28,sizeof(SHvariables));
 #endif
 #else
 #ifdef WITHZLIB
-	PADPOSITION(52,7,23,26,sizeof(SHvariables));
+	PADPOSITION(56,11,23,26,sizeof(SHvariables));
 #else
-	PADPOSITION(50,7,23,26,sizeof(SHvariables));
+	PADPOSITION(53,11,23,26,sizeof(SHvariables));
 #endif
 #endif
 #endif
@@ -62,6 +62,10 @@
 */
  
 #include "form3.h"
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <errno.h>
+#endif
  
 static int numberofthreads;
 static int numberofworkers;
@@ -88,9 +92,37 @@ static LONG *timerinfo;
 static LONG *sumtimerinfo;
 static int numberclaimed;
 
-static THREADBUCKET **threadbuckets, **freebuckets;
+static THREADBUCKET **threadbuckets, **freebuckets, **stealbuckets;
 static int numthreadbuckets;
 static int numberoffullbuckets;
+static HANDOFF *handoffs;
+static THREADPROFILE *threadprofiles = 0;
+STATIC_ASSERT(sizeof(THREADPROFILE) == 128 || sizeof(LONG) < 8);
+static int numthreadprofiles = 0;
+static UBYTE *threadprofilefile = 0;
+static LONG autobucketterms, autobucketwork, autobucketwait, autobucketwaits;
+static LONG autobucketcount, autobucketsizes, autobuckettunes;
+static LONG autobucketsmallest = -1, autobucketlargest = 0;
+
+#define MAXNUMANODES 64
+static int numberofnodes = 0;
+static int nodenumbers[MAXNUMANODES];
+static int nodemaskwords = 0;
+static unsigned long *nodecpumasks = 0;
+static int *threadnodes = 0;
+#ifdef WITHSORTBOTS
+static int *sortbotinputs = 0;
+#endif
+
+static SORTHELP *sorthelps = 0;
+static SORTHELP **sorthelpqueue = 0;
+static SORTHELP **sorthelpgiven = 0;
+static int numsorthelpqueue = 0;
+static int sorthelpactive = 0;
+static GCDHELP *gcdhelps = 0;
+static GCDHELP **gcdhelpqueue = 0;
+static GCDHELP **gcdhelpgiven = 0;
+static int numgcdhelpqueue = 0;
 
 /* static int numberbusy = 0; */
 
@@ -278,8 +310,17 @@ int StartAllThreads(int number)
 	wakeupmasterthreadlocks = (pthread_mutex_t *)Malloc1(sizeof(pthread_mutex_t)*number*mul,"wakeupmasterthreadlocks");
 	wakeupmasterthreadconditions = (pthread_cond_t *)Malloc1(sizeof(pthread_cond_t)*number*mul,"wakeupmasterthread");
 
+	handoffs = (HANDOFF *)Malloc1(sizeof(HANDOFF)*number*mul,"handoffs");
+	IniHandoffs(number*mul);
+	threadprofiles = (THREADPROFILE *)Malloc1(sizeof(THREADPROFILE)*number*mul,"threadprofiles");
+	numthreadprofiles = number*mul;
+	for ( j = 0; j < numthreadprofiles; j++ ) threadprofiles[j].category = PROFOTHER;
+	StartThreadProfile();
+
 	numberofthreads = number;
 	numberofworkers = number - 1;
+	IniNumaPlacement(number*mul);
+	IniSortHelps();
 	threadpointers[identity] = pthread_self();
 	topofavailables = 0;
 	for ( j = 1; j < number; j++ ) {
@@ -309,6 +350,7 @@ int StartAllThreads(int number)
 #ifdef WITHSORTBOTS
 	if ( numberofworkers > 2 ) {
 		numberofsortbots = numberofworkers-2;
+		PlanSortBotTree();
 		for ( j = numberofworkers+1; j < 2*numberofworkers-1; j++ ) {
 			if ( pthread_create(&thethread,NULL,RunSortBot,(void *)(&dummy)) )
 				goto failure;
@@ -482,6 +524,10 @@ ALLPRIVATES *InitializeOneThread(int identity)
 		AN.SplitScratchSize = AN.InScratch = 0;
 		AN.SplitScratch1 = 0;
 		AN.SplitScratchSize1 = AN.InScratch1 = 0;
+		AN.SortKeys = AN.SplitScratchKeys = 0;
+		AN.SortKeysSize = AN.SplitScratchKeysSize = 0;
+		AN.SortHashes = 0;
+		AN.SortHashesSize = 0;
 
 		AN.FunSorts = (SORTING **)Malloc1((AN.NumFunSorts+1)*sizeof(SORTING *),"FunSort pointers");
 		for ( i = 0; i <= AN.NumFunSorts; i++ ) AN.FunSorts[i] = 0;
@@ -589,9 +635,11 @@ ALLPRIVATES *InitializeOneThread(int identity)
 	LOCK(availabilitylock);
 	AT.ebufnum = inicbufs();		/* Buffer for extras during execution */
 	AT.fbufnum = inicbufs();		/* Buffer for caching in factorization */
+	AT.rfbufnum = inicbufs();		/* Buffer for caching PolyRatFun results */
 	AT.allbufnum = inicbufs();		/* Buffer for id,all */
 	AT.aebufnum = inicbufs();		/* Buffer for id,all */
 	UNLOCK(availabilitylock);
+	AT.rfcachehits = AT.rfcachemisses = 0;
 
 	AT.RepCount = (int *)Malloc1((LONG)((AM.RepMax+3)*sizeof(int)),"repeat buffers");
 	AN.RepPoint = AT.RepCount;
@@ -711,6 +759,10 @@ ALLPRIVATES *InitializeOneThread(int identity)
 	AN.SplitScratchSize = AN.InScratch = 0;
 	AN.SplitScratch1 = 0;
 	AN.SplitScratchSize1 = AN.InScratch1 = 0;
+	AN.SortKeys = AN.SplitScratchKeys = 0;
+	AN.SortKeysSize = AN.SplitScratchKeysSize = 0;
+	AN.SortHashes = 0;
+	AN.SortHashesSize = 0;
 /*
 	Now the sort buffers. They depend on which thread. The master
 	inherits the sortbuffer from AM.S0
@@ -726,11 +778,12 @@ ALLPRIVATES *InitializeOneThread(int identity)
 		AT.S0 = AllocSort(AM.S0->LargeSize*sizeof(WORD)/numberofworkers
 						 ,AM.S0->SmallSize*sizeof(WORD)/numberofworkers
 						 ,AM.S0->SmallEsize*sizeof(WORD)/numberofworkers
-						 ,AM.S0->TermsInSmall
+						 ,SortMemoryAdapts(0) ? AM.S0->Terms2InSmall/(2*numberofworkers)
+						                      : AM.S0->TermsInSmall
 						 ,AM.S0->MaxPatches
 /*						 ,AM.S0->MaxPatches/numberofworkers  */
 						 ,AM.S0->MaxFpatches/numberofworkers
-						 ,AM.S0->file.POsize);
+						 ,AM.S0->file.POsize,SortMemoryAdapts(0));
 	}
 	AR.CompressPointer = AR.CompressBuffer;
 /*
@@ -824,6 +877,7 @@ VOID ClearAllThreads()
 VOID TerminateAllThreads()
 {
 	int i;
+	if ( AC.ThreadHandoffStats && !AM.silent ) PrintHandoffs();
 	for ( i = 1; i <= numberofworkers; i++ ) {
 		GetThread(i);
 		WakeupThread(i,TERMINATETHREAD);
@@ -845,6 +899,482 @@ VOID TerminateAllThreads()
 
 /*
   	#] TerminateAllThreads : 
+  	#[ IniHandoffs :
+*/
+/**
+ *	Sets the counters of the handoffs to zero and gives each thread its
+ *	initial spin budget. When there are more threads than processors
+ *	spinning only takes time away from the thread that we are waiting
+ *	for and hence we do not spin, unless ThreadSpin was set explicitly.
+ *
+ *	@param number The number of threads, including the master and the
+ *	              sortbots.
+ */
+
+void IniHandoffs(int number)
+{
+	int i;
+	LONG budget = AM.ThreadSpin;
+#ifdef _SC_NPROCESSORS_ONLN
+	if ( GetSetupPar((UBYTE *)"threadspin")->flags != USEDFLAG
+	&& sysconf(_SC_NPROCESSORS_ONLN) < AM.totalnumberofthreads ) budget = 0;
+#endif
+	for ( i = 0; i < number; i++ ) {
+		handoffs[i].spinwakeups = handoffs[i].parkedwakeups = 0;
+		handoffs[i].stolen = handoffs[i].sent = handoffs[i].missed = 0;
+		handoffs[i].sortparts = handoffs[i].gcdimages = 0;
+		handoffs[i].mctsexpansions = 0;
+		handoffs[i].spinbudget = budget;
+	}
+}
+
+/*
+  	#] IniHandoffs : 
+  	#[ SpinForSignal :
+*/
+/**
+ *	Spins for a while on a wakeup flag before the caller goes to sleep on
+ *	the corresponding condition variable. When the terms are cheap, the
+ *	next bucket or the next worker is usually there within a few
+ *	microseconds and the sleep and the wakeup in the kernel would cost
+ *	more than the work itself.
+ *
+ *	The budget adapts: if the signal came while spinning we allow twice as
+ *	many spins the next time, if it did not we allow half as many. It
+ *	never goes below 1/64 of the ThreadSpin setup parameter, to be able
+ *	to recover.
+ *
+ *	@param flag     The flag to watch. It is read without the lock.
+ *	@param identity The thread that is waiting.
+ *	@return 1 if the flag was set while spinning, 0 otherwise.
+ */
+
+int SpinForSignal(int *flag, int identity)
+{
+	HANDOFF *h = handoffs + identity;
+	LONG n, budget = h->spinbudget;
+	for ( n = 0; n < budget; n++ ) {
+		if ( *(volatile int *)flag != 0 ) {
+			if ( 2*budget <= AM.ThreadSpin ) h->spinbudget = 2*budget;
+			return(1);
+		}
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+		__builtin_ia32_pause();
+#endif
+	}
+	if ( budget/2 >= AM.ThreadSpin/64 ) h->spinbudget = budget/2;
+	return(0);
+}
+
+/*
+  	#] SpinForSignal : 
+  	#[ PrintHandoffs :
+*/
+/**
+ *	Prints for each thread how it got its work (On threadhandoffstats).
+ *	A wakeup without sleep is one in which the signal was there already
+ *	or came while spinning. The wakeups of the master are the ones in
+ *	which it waited for a worker to become available. With the autotuning
+ *	of the buckets also the range of the sizes that were used is printed,
+ *	and when idle workers helped with sorts or gcds the number of parts
+ *	and images they did. After an Optimize with MCTS it prints how many
+ *	expansions of the tree were done and by how many threads. Finally the merge tree of the sortbots, with the
+ *	NUMA node of each sortbot when the threads are placed on nodes.
+ */
+
+void PrintHandoffs(VOID)
+{
+	int i;
+	LONG sortparts = 0, gcdimages = 0, mctsexpansions = 0;
+	int mctsthreads = 0;
+	HANDOFF *h;
+	MLOCK(ErrorMessageLock);
+	MesPrint("Thread  Without sleep  After sleep  Buckets stolen  Buckets sent  Missed");
+	for ( i = 0; i <= numberofworkers; i++ ) {
+		h = handoffs + i;
+		MesPrint("%6d %14l %12l %15l %13l %7l",i,h->spinwakeups,h->parkedwakeups
+			,h->stolen,h->sent,h->missed);
+		sortparts += h->sortparts;
+		gcdimages += h->gcdimages;
+		mctsexpansions += h->mctsexpansions;
+		if ( h->mctsexpansions > 0 ) mctsthreads++;
+	}
+	if ( sortparts > 0 ) {
+		MesPrint("Parts of sorts done for other workers: %l",sortparts);
+	}
+	if ( gcdimages > 0 ) {
+		MesPrint("Images of gcds done for other workers: %l",gcdimages);
+	}
+	if ( mctsexpansions > 0 ) {
+		MesPrint("Expansions of the Optimize tree: %l by %d threads"
+			,mctsexpansions,mctsthreads);
+	}
+	if ( autobucketsmallest >= 0 ) {
+		MesPrint("Autotuned buckets: %l terms on average, from %l to %l"
+			,autobucketsizes/autobuckettunes+1,autobucketsmallest+1,autobucketlargest+1);
+	}
+#ifdef WITHSORTBOTS
+	if ( numberofsortbots > 0 && sortbotinputs ) {
+		for ( i = numberofworkers+1; i <= numberofworkers+numberofsortbots; i++ ) {
+			if ( threadnodes[i] >= 0 )
+				MesPrint("Sortbot %d merges %d and %d on node %d",i
+					,sortbotinputs[2*i],sortbotinputs[2*i+1],threadnodes[i]);
+			else
+				MesPrint("Sortbot %d merges %d and %d",i
+					,sortbotinputs[2*i],sortbotinputs[2*i+1]);
+		}
+		MesPrint("Master merges %d and %d",sortbotinputs[0],sortbotinputs[1]);
+	}
+#endif
+	MUNLOCK(ErrorMessageLock);
+}
+
+/*
+  	#] PrintHandoffs : 
+  	#[ ProfileClock :
+*/
+/**
+ *	The clock of the thread profile in nanoseconds. It has to be cheap,
+ *	because it is read at every switch of category.
+ */
+
+LONG ProfileClock(VOID)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return((LONG)t.tv_sec*1000000000L+(LONG)t.tv_nsec);
+}
+
+/*
+  	#] ProfileClock : 
+  	#[ ProfileSwitch :
+*/
+/**
+ *	Books the time since the last switch on the current category of the
+ *	thread and makes category the current one. The caller restores the
+ *	old category afterwards, hence nested activities are booked only once:
+ *	the time of a Normalize inside the Generator goes to PROFNORMALIZE and
+ *	not also to PROFGENERATOR. When the profile is off nothing is written,
+ *	and StartThreadProfile sets the categories again when it is switched on.
+ *
+ *	@param identity The thread.
+ *	@param category One of the PROF values of ftypes.h.
+ *	@return The previous category.
+ */
+
+int ProfileSwitch(int identity, int category)
+{
+	THREADPROFILE *p;
+	LONG now;
+	int old;
+	if ( AC.ThreadProfile == 0 || threadprofiles == 0 ) return(PROFOTHER);
+	p = threadprofiles + identity;
+	old = p->category;
+	p->category = category;
+	now = ProfileClock();
+	p->time[old] += now - p->stamp;
+	p->stamp = now;
+	return(old);
+}
+
+/*
+  	#] ProfileSwitch : 
+  	#[ LockProfiled :
+*/
+/**
+ *	The LOCK macro comes here when the thread profile is on. Only when the
+ *	lock is taken by someone else do we need to know who we are and to
+ *	read the clock.
+ *
+ *	@param lock The lock to wait for.
+ */
+
+void LockProfiled(pthread_mutex_t *lock)
+{
+	int identity, old;
+	if ( pthread_mutex_trylock(lock) == 0 ) return;
+	if ( threadprofiles == 0 ) {
+		pthread_mutex_lock(lock);
+		return;
+	}
+	identity = WhoAmI();
+	old = ProfileSwitch(identity,PROFLOCK);
+	pthread_mutex_lock(lock);
+	ProfileSwitch(identity,old);
+}
+
+/*
+  	#] LockProfiled : 
+  	#[ StartThreadProfile :
+*/
+/**
+ *	Sets the times of all threads to zero. To be called by the master at
+ *	the start of a module, when the workers and the sortbots are waiting.
+ *	Because the categories are not kept while the profile is off, they are
+ *	set here as well.
+ */
+
+void StartThreadProfile(VOID)
+{
+	int i, j;
+	LONG now = ProfileClock();
+	for ( i = 0; i < numthreadprofiles; i++ ) {
+		for ( j = 0; j < PROFITEMS; j++ ) threadprofiles[i].time[j] = 0;
+		threadprofiles[i].stamp = now;
+		threadprofiles[i].category = i == 0 ? PROFOTHER : PROFWAIT;
+	}
+}
+
+/*
+  	#] StartThreadProfile : 
+  	#[ WriteThreadProfile :
+*/
+/**
+ *	Appends for each thread a line with the times of the current module
+ *	to the file of On threadprofile. The first line of the file gives the
+ *	names of the columns. The times are in seconds, thread 0 is the
+ *	master and the threads after the workers are the sortbots.
+ *	To be called by the master at the end of the module, when the workers
+ *	and the sortbots are waiting.
+ *
+ *	@return Standard return conventions (OK -> 0)
+ */
+
+int WriteThreadProfile(VOID)
+{
+	int i, j, handle, number;
+	LONG now = ProfileClock();
+	UBYTE *name, *s, buffer[300];
+	THREADPROFILE *p;
+	if ( threadprofiles == 0 ) return(0);
+	if ( ( name = AC.ThreadProfileName ) == 0 ) {
+		if ( AM.InputFileName ) {
+			name = strDup1(AM.InputFileName,"ThreadProfile");
+			s = name; while ( *s ) s++;
+			s[-3] = 't'; s[-2] = 'p'; s[-1] = 'f';
+		}
+		else name = strDup1((UBYTE *)"formsession.tpf","ThreadProfile");
+		AC.ThreadProfileName = name;
+	}
+	if ( threadprofilefile && StrCmp(threadprofilefile,name) == 0 ) {
+		handle = OpenAddFile((char *)name);
+	}
+	else {
+		if ( threadprofilefile ) M_free(threadprofilefile,"ThreadProfile");
+		threadprofilefile = strDup1(name,"ThreadProfile");
+		if ( ( handle = CreateFile((char *)name) ) >= 0 ) {
+			s = (UBYTE *)"module\tthread\tgenerator\tnormalize\tmatch\tsort\twait\tlock\tother\n";
+			WriteFile(handle,s,(LONG)strlen((char *)s));
+		}
+	}
+	if ( handle < 0 ) {
+		MLOCK(ErrorMessageLock);
+		MesPrint("Cannot write the thread profile to %s",name);
+		MUNLOCK(ErrorMessageLock);
+		return(-1);
+	}
+#ifdef WITHSORTBOTS
+	number = numberofworkers+numberofsortbots+1;
+#else
+	number = numberofworkers+1;
+#endif
+	for ( i = 0; i < number; i++ ) {
+		p = threadprofiles + i;
+		p->time[p->category] += now - p->stamp;
+		p->stamp = now;
+		sprintf((char *)buffer,"%ld\t%d\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\n"
+			,(long)AC.CModule,i
+			,p->time[PROFGENERATOR]*1e-9,p->time[PROFNORMALIZE]*1e-9
+			,p->time[PROFMATCH]*1e-9,p->time[PROFSORT]*1e-9
+			,p->time[PROFWAIT]*1e-9,p->time[PROFLOCK]*1e-9,p->time[PROFOTHER]*1e-9);
+		WriteFile(handle,buffer,(LONG)strlen((char *)buffer));
+		for ( j = 0; j < PROFITEMS; j++ ) p->time[j] = 0;
+	}
+	CloseFile(handle);
+	return(0);
+}
+
+/*
+  	#] WriteThreadProfile : 
+  	#[ IniNumaPlacement :
+*/
+/**
+ *	Reads which processors belong to which NUMA node and distributes the
+ *	workers over the nodes in contiguous ranges: the workers 1..W/N go to
+ *	the first node etc. The master stays where the system put it and the
+ *	sortbots get their node in PlanSortBotTree. A value of -1 in
+ *	threadnodes means that the thread is not bound.
+ *
+ *	Nothing is done when ThreadNUMA is off, when the topology cannot be
+ *	read, or when there is only one node. When the process has been
+ *	restricted to some of the processors already (taskset, numactl or a
+ *	cpuset) we leave that alone as well.
+ *
+ *	With the setup parameter ThreadNUMANodes the workers are divided over
+ *	that many nodes for the merge tree only, and nothing is bound.
+ *
+ *	@param number The number of threads, including the master and the
+ *	              sortbots.
+ */
+
+void IniNumaPlacement(int number)
+{
+	int i, node, first, last, c;
+	long ncpu;
+	char name[64];
+	FILE *f;
+	unsigned long *mask;
+	threadnodes = (int *)Malloc1(sizeof(int)*number,"threadnodes");
+	for ( i = 0; i < number; i++ ) threadnodes[i] = -1;
+	numberofnodes = 0;
+	if ( AM.ThreadNuma == 0 ) return;
+	if ( AM.ThreadNumaNodes > 1 ) {
+		numberofnodes = AM.ThreadNumaNodes < MAXNUMANODES ? AM.ThreadNumaNodes : MAXNUMANODES;
+		goto Distribute;
+	}
+#ifdef _SC_NPROCESSORS_CONF
+	ncpu = sysconf(_SC_NPROCESSORS_CONF);
+#else
+	ncpu = 0;
+#endif
+	if ( ncpu <= 0 ) return;
+	nodemaskwords = (ncpu+8*sizeof(unsigned long)-1)/(8*sizeof(unsigned long));
+	nodecpumasks = (unsigned long *)Malloc1(sizeof(unsigned long)*nodemaskwords*MAXNUMANODES,"nodecpumasks");
+	for ( node = 0; node < MAXNUMANODES; node++ ) {
+		sprintf(name,"/sys/devices/system/node/node%d/cpulist",node);
+		if ( ( f = fopen(name,"r") ) == 0 ) continue;
+		mask = nodecpumasks + nodemaskwords*numberofnodes;
+		for ( i = 0; i < nodemaskwords; i++ ) mask[i] = 0;
+		while ( fscanf(f,"%d",&first) == 1 ) {
+			last = first;
+			c = fgetc(f);
+			if ( c == '-' ) {
+				if ( fscanf(f,"%d",&last) != 1 ) break;
+				c = fgetc(f);
+			}
+			for ( i = first; i <= last && i < ncpu; i++ )
+				mask[i/(8*sizeof(unsigned long))] |= 1UL << (i%(8*sizeof(unsigned long)));
+			if ( c != ',' ) break;
+		}
+		fclose(f);
+		for ( i = 0; i < nodemaskwords; i++ ) { if ( mask[i] ) break; }
+		if ( i < nodemaskwords ) nodenumbers[numberofnodes++] = node;
+	}
+	if ( numberofnodes < 2 || AffinityIsRestricted() ) {
+		numberofnodes = 0;
+		M_free(nodecpumasks,"nodecpumasks");
+		nodecpumasks = 0;
+		return;
+	}
+Distribute:
+	for ( i = 1; i <= numberofworkers; i++ )
+		threadnodes[i] = ((i-1)*numberofnodes)/numberofworkers;
+}
+
+/*
+  	#] IniNumaPlacement : 
+  	#[ AffinityIsRestricted :
+*/
+/**
+ *	Checks whether the process may run on all processors of the nodes.
+ *	If not, the user has restricted it already (taskset, numactl or a
+ *	cpuset) and binding a thread to a whole node would widen or replace
+ *	that mask.
+ *
+ *	@return 1 if the process was restricted already or its mask cannot be
+ *	        read, in which case nothing should be bound. 0 otherwise.
+ */
+
+int AffinityIsRestricted(VOID)
+{
+#if defined(__linux__) && defined(SYS_sched_getaffinity)
+	int words = nodemaskwords, i, node, restricted = 0;
+	unsigned long *allowed, *mask;
+/*
+	The kernel wants a buffer for all the processors it could have.
+*/
+	for ( ;; ) {
+		allowed = (unsigned long *)Malloc1(sizeof(unsigned long)*words,"affinity");
+		if ( syscall(SYS_sched_getaffinity,0,sizeof(unsigned long)*words,allowed) > 0 ) break;
+		M_free(allowed,"affinity");
+		if ( errno != EINVAL || words >= 1024 ) return(1);
+		words *= 2;
+	}
+	for ( node = 0; node < numberofnodes; node++ ) {
+		mask = nodecpumasks + nodemaskwords*node;
+		for ( i = 0; i < nodemaskwords; i++ ) {
+			if ( mask[i] & ~allowed[i] ) restricted = 1;
+		}
+	}
+	M_free(allowed,"affinity");
+	return(restricted);
+#else
+	return(0);
+#endif
+}
+
+/*
+  	#] AffinityIsRestricted : 
+  	#[ BindThreadToNode :
+*/
+/**
+ *	Restricts the calling thread to the processors of its NUMA node. It
+ *	should be called before the thread allocates its buffers, because
+ *	the pages of a buffer go to the node of the thread that touches them
+ *	first.
+ *
+ *	@param identity The number of the calling thread.
+ */
+
+void BindThreadToNode(int identity)
+{
+#if defined(__linux__) && defined(SYS_sched_setaffinity)
+	if ( numberofnodes > 1 && nodecpumasks && threadnodes[identity] >= 0 ) {
+		syscall(SYS_sched_setaffinity,0,sizeof(unsigned long)*nodemaskwords
+			,nodecpumasks+nodemaskwords*threadnodes[identity]);
+	}
+#else
+	DUMMYUSE(identity);
+#endif
+}
+
+/*
+  	#] BindThreadToNode : 
+  	#[ BindMemoryToNode :
+*/
+/**
+ *	Asks the system to keep the pages of [start,stop) on the given node.
+ *	This is used for the blocks of the sort buffer of the master through
+ *	which a worker or a sortbot passes its terms, because that buffer has
+ *	been allocated (and touched) by the master.
+ *	It is only a preference: when it fails nothing is lost.
+ */
+
+void BindMemoryToNode(WORD *start, WORD *stop, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long nodemask[(MAXNUMANODES+8*sizeof(unsigned long)-1)/(8*sizeof(unsigned long))];
+	long pagesize = sysconf(_SC_PAGESIZE);
+	unsigned long a = (unsigned long)start, b = (unsigned long)stop;
+	int i;
+	if ( node < 0 || nodecpumasks == 0 || pagesize <= 0 ) return;
+	a = ((a+pagesize-1)/pagesize)*pagesize;
+	b = (b/pagesize)*pagesize;
+	if ( b <= a ) return;
+	for ( i = 0; i < (int)(sizeof(nodemask)/sizeof(unsigned long)); i++ ) nodemask[i] = 0;
+	i = nodenumbers[node];
+	nodemask[i/(8*sizeof(unsigned long))] |= 1UL << (i%(8*sizeof(unsigned long)));
+/*
+	1 = MPOL_PREFERRED, 2 = MPOL_MF_MOVE. We do not want to depend on numaif.h
+*/
+	syscall(SYS_mbind,a,b-a,1,nodemask,MAXNUMANODES+1,2);
+#else
+	DUMMYUSE(start); DUMMYUSE(stop); DUMMYUSE(node);
+#endif
+}
+
+/*
+  	#] BindMemoryToNode : 
   	#[ MakeThreadBuckets :
 */
 /**
@@ -893,6 +1423,7 @@ int MakeThreadBuckets(int number, int par)
 		numthreadbuckets = 2*(number-1);
 		threadbuckets = (THREADBUCKET **)Malloc1(numthreadbuckets*sizeof(THREADBUCKET *),"threadbuckets");
 		freebuckets = (THREADBUCKET **)Malloc1(numthreadbuckets*sizeof(THREADBUCKET *),"threadbuckets");
+		stealbuckets = (THREADBUCKET **)Malloc1(numthreadbuckets*sizeof(THREADBUCKET *),"threadbuckets");
 	}
 	if ( par > 0 ) {
 		if ( sizethreadbuckets <= threadbuckets[0]->threadbuffersize ) return(0);
@@ -905,6 +1436,7 @@ int MakeThreadBuckets(int number, int par)
 		for ( i = 0; i < numthreadbuckets; i++ ) {
 			threadbuckets[i] = (THREADBUCKET *)Malloc1(sizeof(THREADBUCKET),"threadbuckets");
 			threadbuckets[i]->lock = dummylock;
+			stealbuckets[i] = threadbuckets[i];
 		}
 	}
 	for ( i = 0; i < numthreadbuckets; i++ ) {
@@ -1250,7 +1782,8 @@ void SetWorkerFiles()
 void *RunThread(void *dummy)
 {
 	WORD *term, *ttin, *tt, *ttco, *oldwork;
-	int identity, wakeupsignal, identityretv, i, tobereleased, errorcode;
+	int identity, wakeupsignal, identityretv, i, tobereleased, errorcode, profile;
+	LONG bucketstart = 0, bucketsent = 0, bucketterms;
 	ALLPRIVATES *B;
 	THREADBUCKET *thr;
 	POSITION *ppdef;
@@ -1258,6 +1791,7 @@ void *RunThread(void *dummy)
 	DUMMYUSE(dummy);
 	identity = SetIdentity(&identityretv);
 	threadpointers[identity] = pthread_self();
+	BindThreadToNode(identity);
 	B = InitializeOneThread(identity);
 	while ( ( wakeupsignal = ThreadWait(identity) ) > 0 ) {
 		switch ( wakeupsignal ) {
@@ -1305,6 +1839,7 @@ void *RunThread(void *dummy)
 #endif
 				e = Expressions + AR.CurExpr;
 				thr = AN.threadbuck;
+nextbucket:;
 				ppdef = thr->deferbuffer;
 				ttin = thr->threadbuffer;
 				ttco = thr->compressbuffer;
@@ -1313,8 +1848,18 @@ void *RunThread(void *dummy)
 				tobereleased = 0;
 				AN.inputnumber = thr->firstterm;
 				AN.ninterms = thr->firstterm;
+/*
+				Once the bucket is released the master may fill it again,
+				so for the autotuning we keep what we need here.
+*/
+				if ( AC.ThreadBucketAutotune ) {
+					bucketsent = thr->sendtime;
+					bucketstart = ProfileClock();
+				}
+				bucketterms = 0;
 				do {
 				  thr->usenum++;	/* For if the master wants to steal the bucket */
+				  bucketterms++;
 				  tt = term; i = *ttin;
 				  NCOPY(tt,ttin,i);
 				  AT.WorkPointer = tt;
@@ -1383,6 +1928,7 @@ void *RunThread(void *dummy)
 						&& ( e->status == LOCALEXPRESSION || e->status == GLOBALEXPRESSION ) ) {
 						PolyFunClean(BHEAD term);
 				  }
+				  profile = ProfileSwitch(identity,PROFGENERATOR);
 				  if ( Generator(BHEAD term,0) ) {
 					LowerSortLevel();
 					MLOCK(ErrorMessageLock);
@@ -1390,6 +1936,7 @@ void *RunThread(void *dummy)
 					MUNLOCK(ErrorMessageLock);
 					Terminate(-1);
 				  }
+				  ProfileSwitch(identity,profile);
 				  AN.ninterms++;
 				  }
 /*				  if ( AT.LoadBalancing ) { */
@@ -1413,6 +1960,9 @@ void *RunThread(void *dummy)
 				  }
 				  if ( tobereleased ) goto bucketstolen;
 				} while ( *ttin );
+				if ( AC.ThreadBucketAutotune )
+					BookBucket(bucketterms,ProfileClock()-bucketstart
+						,bucketsent > 0 ? bucketstart-bucketsent : -1);
 				thr->free = BUCKETCOMINGFREE;
 bucketstolen:;
 /*				if ( AT.LoadBalancing ) { */
@@ -1425,6 +1975,19 @@ bucketstolen:;
 				}
 */
 				AT.WorkPointer = term;
+/*
+				Work stealing: take the next filled bucket ourselves rather
+				than waiting for the master to send it.
+*/
+				if ( AC.ThreadWorkStealing && AR.DeferFlag == 0
+				&& ( thr = StealBucket(identity) ) != 0 ) {
+					AN.threadbuck = thr;
+					AR.CompressPointer = AR.CompressBuffer;
+					AR.TePos = 0;
+					AN.TeInFun = 0;
+					AN.PolyFunTodo = 0;
+					goto nextbucket;
+				}
 				break;
 /*
 			#] LOWESTLEVELGENERATION : 
@@ -1461,7 +2024,9 @@ bucketstolen:;
 				}
 				AT.SB.FillBlock = 1;
 				AT.SB.MasterFill[1] = AT.SB.MasterStart[1];
+				profile = ProfileSwitch(identity,PROFSORT);
 				errorcode = EndSort(BHEAD AT.S0->sBuffer,0);
+				ProfileSwitch(identity,profile);
 				UNLOCK(AT.SB.MasterBlockLock[AT.SB.FillBlock]);
 				UpdateMaxSize();
 				if ( errorcode ) {
@@ -1520,6 +2085,7 @@ bucketstolen:;
 				This should only be needed in a second level load balancing
 */
 				term = AT.WorkSpace; AT.WorkPointer = term + *term;
+				profile = ProfileSwitch(identity,PROFGENERATOR);
 				if ( Generator(BHEAD term,AR.level) ) {
 					LowerSortLevel();
 					MLOCK(ErrorMessageLock);
@@ -1527,6 +2093,7 @@ bucketstolen:;
 					MUNLOCK(ErrorMessageLock);
 					Terminate(-1);
 				}
+				ProfileSwitch(identity,profile);
 				AT.WorkPointer = term;
 				break;
 /*
@@ -1654,9 +2221,11 @@ bucketstolen:;
 						&& ( e->status == LOCALEXPRESSION || e->status == GLOBALEXPRESSION ) ) {
 						PolyFunClean(BHEAD term);
 				  }
+				  profile = ProfileSwitch(identity,PROFGENERATOR);
 				  if ( Generator(BHEAD term,0) ) {
 					LowerSortLevel(); goto ProcErr;
 				  }
+				  ProfileSwitch(identity,profile);
 				 }
 				}
 				else {
@@ -1692,9 +2261,11 @@ bucketstolen:;
 						&& ( e->status == LOCALEXPRESSION || e->status == GLOBALEXPRESSION ) ) {
 						PolyFunClean(BHEAD term);
 				  }
+				  profile = ProfileSwitch(identity,PROFGENERATOR);
 				  if ( Generator(BHEAD term,0) ) {
 					LowerSortLevel(); goto ProcErr;
 				  }
+				  ProfileSwitch(identity,profile);
 				  AN.ninterms += dd;
 				  }
 				  SetScratch(fi,&position);
@@ -1709,7 +2280,9 @@ bucketstolen:;
 				 }
 				}
 				AN.ninterms += dd;
+				profile = ProfileSwitch(identity,PROFSORT);
 				if ( EndSort(BHEAD AT.S0->sBuffer,0) < 0 ) goto ProcErr;
+				ProfileSwitch(identity,profile);
 				e->numdummies = AR.MaxDum - AM.IndDum;
 				AR.BracketOn = oldBracketOn;
 				AT.BrackBuf = oldBrackBuf;
@@ -1828,6 +2401,7 @@ bucketstolen:;
 						MUNLOCK(ErrorMessageLock);
 					}
 					AT.WorkPointer = term + *term;
+					profile = ProfileSwitch(identity,PROFGENERATOR);
 					if ( Generator(BHEAD term,0) ) {
 						LowerSortLevel();
 						MLOCK(ErrorMessageLock);
@@ -1835,6 +2409,7 @@ bucketstolen:;
 						MUNLOCK(ErrorMessageLock);
 						Terminate(-1);
 					}
+					ProfileSwitch(identity,profile);
 					AN.ninterms++;
 					SetScratch(fi,&(where));
 					if ( ISGEPOS(where,stoppos) ) break;
@@ -1860,8 +2435,7 @@ bucketstolen:;
 			#[ MCTSEXPANDTREE :
 */
 			case MCTSEXPANDTREE:
-				AT.optimtimes = AB[0]->T.optimtimes;
-				find_Horner_MCTS_expand_tree();
+				handoffs[identity].mctsexpansions += find_Horner_MCTS_expand_tree_loop();
 				break;
 /*
 			#] MCTSEXPANDTREE : 
@@ -1872,6 +2446,30 @@ bucketstolen:;
 				break;
 /*
 			#] OPTIMIZEEXPRESSION : 
+			#[ HELPSORT :
+
+				Sort a part of the small buffer of a worker that does an
+				expression of an InParallel statement.
+*/
+			case HELPSORT:
+				profile = ProfileSwitch(identity,PROFSORT);
+				DoSortHelp(identity);
+				ProfileSwitch(identity,profile);
+				break;
+/*
+			#] HELPSORT : 
+			#[ HELPGCD :
+
+				Calculate an image modulo a prime of a polynomial gcd of
+				another worker.
+*/
+			case HELPGCD:
+				profile = ProfileSwitch(identity,PROFNORMALIZE);
+				DoGcdHelp(identity);
+				ProfileSwitch(identity,profile);
+				break;
+/*
+			#] HELPGCD : 
 */
 			default:
 				MLOCK(ErrorMessageLock);
@@ -1910,11 +2508,12 @@ ProcErr:
 
 void *RunSortBot(void *dummy)
 {
-	int identity, wakeupsignal, identityretv;
+	int identity, wakeupsignal, identityretv, profile;
 	ALLPRIVATES *B, *BB;
 	DUMMYUSE(dummy);
 	identity = SetIdentity(&identityretv);
 	threadpointers[identity] = pthread_self();
+	BindThreadToNode(identity);
 	B = InitializeOneThread(identity);
 	while ( ( wakeupsignal = SortBotWait(identity) ) > 0 ) {
 		switch ( wakeupsignal ) {
@@ -1939,6 +2538,7 @@ void *RunSortBot(void *dummy)
 				}
 				AT.SS->PolyWise = 0;
 				AN.ncmod = AC.ncmod;
+				AN.numcompares = 0;
 				LOCK(AT.SB.MasterBlockLock[1]);
 				BB = AB[AT.SortBotIn1];
 				LOCK(BB->T.SB.MasterBlockLock[BB->T.SB.MasterNumBlocks]);
@@ -1953,7 +2553,9 @@ void *RunSortBot(void *dummy)
 			#[ RUNSORTBOT :
 */
 			case RUNSORTBOT:
+				profile = ProfileSwitch(identity,PROFSORT);
 				SortBotMerge(B);
+				ProfileSwitch(identity,profile);
 				break;
 /*
 			#] RUNSORTBOT : 
@@ -2134,7 +2736,7 @@ int GetThread(int identity)
 
 int ThreadWait(int identity)
 {
-	int retval, top, j;
+	int retval, top, j, profile = ProfileSwitch(identity,PROFWAIT);
 	LOCK(wakeuplocks[identity]);
 	LOCK(availabilitylock);
 	top = topofavailables;
@@ -2152,12 +2754,26 @@ int ThreadWait(int identity)
 	else {
 		UNLOCK(availabilitylock);
 	}
+/*
+	We are in the list of available threads now. Rather than going to
+	sleep immediately, we spin a bit. The lock must be free for this,
+	because WakeupThread needs it.
+*/
+	if ( wakeup[identity] == 0 && handoffs[identity].spinbudget > 0 ) {
+		UNLOCK(wakeuplocks[identity]);
+		j = SpinForSignal(wakeup+identity,identity);
+		LOCK(wakeuplocks[identity]);
+	}
+	else j = ( wakeup[identity] != 0 );
+	if ( j ) handoffs[identity].spinwakeups++;
+	else     handoffs[identity].parkedwakeups++;
 	while ( wakeup[identity] == 0 ) {
 		pthread_cond_wait(&(wakeupconditions[identity]),&(wakeuplocks[identity]));
 	}
 	retval = wakeup[identity];
 	wakeup[identity] = 0;
 	UNLOCK(wakeuplocks[identity]);
+	ProfileSwitch(identity,profile);
 	return(retval);
 }
 
@@ -2178,7 +2794,7 @@ int ThreadWait(int identity)
 
 int SortBotWait(int identity)
 {
-	int retval;
+	int retval, profile = ProfileSwitch(identity,PROFWAIT);
 	LOCK(wakeuplocks[identity]);
 	LOCK(availabilitylock);
 	topsortbotavailables++;
@@ -2198,6 +2814,7 @@ int SortBotWait(int identity)
 	retval = wakeup[identity];
 	wakeup[identity] = 0;
 	UNLOCK(wakeuplocks[identity]);
+	ProfileSwitch(identity,profile);
 	return(retval);
 }
 
@@ -2247,7 +2864,12 @@ int ThreadClaimedBlock(int identity)
 
 int MasterWait()
 {
-	int retval;
+	int retval, spun, profile = ProfileSwitch(0,PROFWAIT);
+	if ( wakeupmaster == 0 && handoffs[0].spinbudget > 0 )
+		spun = SpinForSignal(&wakeupmaster,0);
+	else spun = ( wakeupmaster != 0 );
+	if ( spun ) handoffs[0].spinwakeups++;
+	else        handoffs[0].parkedwakeups++;
 	LOCK(wakeupmasterlock);
 	while ( wakeupmaster == 0 ) {
 		pthread_cond_wait(&wakeupmasterconditions,&wakeupmasterlock);
@@ -2255,6 +2877,7 @@ int MasterWait()
 	retval = wakeupmaster;
 	wakeupmaster = 0;
 	UNLOCK(wakeupmasterlock);
+	ProfileSwitch(0,profile);
 	return(retval);
 }
 
@@ -2270,7 +2893,7 @@ int MasterWait()
 
 int MasterWaitThread(int identity)
 {
-	int retval;
+	int retval, profile = ProfileSwitch(0,PROFWAIT);
 	LOCK(wakeupmasterthreadlocks[identity]);
 	while ( wakeupmasterthread[identity] == 0 ) {
 		pthread_cond_wait(&(wakeupmasterthreadconditions[identity])
@@ -2279,6 +2902,7 @@ int MasterWaitThread(int identity)
 	retval = wakeupmasterthread[identity];
 	wakeupmasterthread[identity] = 0;
 	UNLOCK(wakeupmasterthreadlocks[identity]);
+	ProfileSwitch(0,profile);
 	return(retval);
 }
 
@@ -2294,16 +2918,71 @@ int MasterWaitThread(int identity)
 
 void MasterWaitAll()
 {
+	int profile = ProfileSwitch(0,PROFWAIT);
 	LOCK(wakeupmasterlock);
 	while ( topofavailables < numberofworkers ) {
 		pthread_cond_wait(&wakeupmasterconditions,&wakeupmasterlock);
 	}
 	UNLOCK(wakeupmasterlock);
+	ProfileSwitch(0,profile);
 	return;
 }
 
 /*
   	#] MasterWaitAll : 
+  	#[ MasterWaitAllHelping :
+*/
+/**
+ *	As MasterWaitAll, but while waiting the master gives the parts of
+ *	sorts that are put in the sorthelpqueue by HelpedSplitMerge, and the
+ *	images of gcds that are put in the gcdhelpqueue by PostGcdHelps, to
+ *	the workers that have become available.
+ *	ThreadWait wakes the master when the first worker becomes available,
+ *	HelpedSplitMerge or PostGcdHelps when there is a new part. That covers
+ *	the only situation in which a part has to wait: no available workers.
+ */
+
+void MasterWaitAllHelping()
+{
+	SORTHELP *h;
+	GCDHELP *g;
+	int id, profile = ProfileSwitch(0,PROFWAIT);
+	LOCK(wakeupmasterlock);
+	while ( topofavailables < numberofworkers ) {
+		if ( numsorthelpqueue > 0 && topofavailables > 0 ) {
+			h = sorthelpqueue[0];
+			numsorthelpqueue--;
+			for ( id = 0; id < numsorthelpqueue; id++ )
+				sorthelpqueue[id] = sorthelpqueue[id+1];
+			h->state = SORTHELPTAKEN;
+			UNLOCK(wakeupmasterlock);
+			id = GetAvailableThread();
+			sorthelpgiven[id] = h;
+			WakeupThread(id,HELPSORT);
+			LOCK(wakeupmasterlock);
+		}
+		else if ( numgcdhelpqueue > 0 && topofavailables > 0 ) {
+			g = gcdhelpqueue[0];
+			numgcdhelpqueue--;
+			for ( id = 0; id < numgcdhelpqueue; id++ )
+				gcdhelpqueue[id] = gcdhelpqueue[id+1];
+			g->state = SORTHELPTAKEN;
+			UNLOCK(wakeupmasterlock);
+			id = GetAvailableThread();
+			gcdhelpgiven[id] = g;
+			WakeupThread(id,HELPGCD);
+			LOCK(wakeupmasterlock);
+		}
+		else {
+			pthread_cond_wait(&wakeupmasterconditions,&wakeupmasterlock);
+		}
+	}
+	UNLOCK(wakeupmasterlock);
+	ProfileSwitch(0,profile);
+}
+
+/*
+  	#] MasterWaitAllHelping : 
   	#[ MasterWaitAllSortBots :
 */
  
@@ -2316,11 +2995,13 @@ void MasterWaitAll()
 
 void MasterWaitAllSortBots()
 {
+	int profile = ProfileSwitch(0,PROFWAIT);
 	LOCK(wakeupsortbotlock);
 	while ( topsortbotavailables < numberofsortbots ) {
 		pthread_cond_wait(&wakeupsortbotconditions,&wakeupsortbotlock);
 	}
 	UNLOCK(wakeupsortbotlock);
+	ProfileSwitch(0,profile);
 	return;
 }
 
@@ -2338,11 +3019,13 @@ void MasterWaitAllSortBots()
 
 void MasterWaitAllBlocks()
 {
+	int profile = ProfileSwitch(0,PROFWAIT);
 	LOCK(wakeupmasterlock);
 	while ( numberclaimed < numberofworkers ) {
 		pthread_cond_wait(&wakeupmasterconditions,&wakeupmasterlock);
 	}
 	UNLOCK(wakeupmasterlock);
+	ProfileSwitch(0,profile);
 	return;
 }
 
@@ -2400,6 +3083,192 @@ void WakeupMasterFromThread(int identity, int signalnumber)
 
 /*
   	#] WakeupMasterFromThread : 
+  	#[ MarkBucketFilled :
+*/
+/**
+ *	Marks a bucket as ready to be executed. With work stealing also the
+ *	workers take filled buckets (see StealBucket) and hence the transitions
+ *	from and to BUCKETFILLED are atomic operations. The memory barrier
+ *	makes sure that the contents of the bucket are visible to the worker
+ *	that takes it. The counter goes up first: at worst a claim finds no
+ *	bucket for a moment, but numberoffullbuckets never goes negative.
+ *
+ *	@param thr  The bucket. It should have been filled completely.
+ *	@param type BUCKETDOINGTERMS or BUCKETDOINGBRACKET.
+ */
+
+void MarkBucketFilled(THREADBUCKET *thr, int type)
+{
+	thr->type = type;
+	__sync_fetch_and_add(&numberoffullbuckets,1);
+	__sync_synchronize();
+	thr->free = BUCKETFILLED;
+}
+
+/*
+  	#] MarkBucketFilled : 
+  	#[ ClaimBucket :
+*/
+/**
+ *	Claims a filled bucket for execution. Only one party can succeed:
+ *	either the master in SendOneBucket or ThreadsProcessor or a worker
+ *	in StealBucket. This is a compare-and-swap on thr->free, so there is
+ *	no lock to wait for.
+ *
+ *	@param thr      The bucket.
+ *	@param identity The thread that claims it.
+ *	@return 1 if the bucket is ours now, 0 if it was taken by someone else.
+ */
+
+int ClaimBucket(THREADBUCKET *thr, int identity)
+{
+	if ( __sync_bool_compare_and_swap(&(thr->free),BUCKETFILLED,BUCKETINUSE) ) {
+		__sync_fetch_and_sub(&numberoffullbuckets,1);
+		thr->sendtime = 0;
+		LOCK(thr->lock);
+		thr->busy = BUCKETASSIGNED;
+		UNLOCK(thr->lock);
+		return(1);
+	}
+	handoffs[identity].missed++;
+	return(0);
+}
+
+/*
+  	#] ClaimBucket : 
+  	#[ StealBucket :
+*/
+/**
+ *	Called by a worker that has finished its bucket (On threadworkstealing).
+ *	Rather than going to sleep and waiting for the master to find it in the
+ *	list of available threads, to load it and to wake it up again, the
+ *	worker takes the oldest filled bucket by itself. This removes two signals
+ *	and a wait for the master per bucket. The master only has to read the
+ *	input and fill the buckets, which is what limits the scaling when
+ *	there are many workers. The input itself is still read by the master
+ *	only: the workers claim filled buckets, not ranges of the input.
+ *
+ *	Buckets with complete brackets and buckets with keep brackets active
+ *	(they need the position of the input, which is private to the master)
+ *	are left to the master.
+ *
+ *	@param identity The worker.
+ *	@return The bucket that has been claimed or zero if there is none.
+ */
+
+THREADBUCKET *StealBucket(int identity)
+{
+	THREADBUCKET *thr, *t;
+	int j;
+	while ( numberoffullbuckets > 0 ) {
+/*
+		The master moves the buckets around in threadbuckets without a lock.
+		Hence we look in stealbuckets, which does not change after
+		MakeThreadBuckets. The state of a bucket is read without a lock, but
+		ClaimBucket checks it again.
+*/
+		thr = 0;
+		for ( j = 0; j < numthreadbuckets; j++ ) {
+			t = stealbuckets[j];
+			if ( t->free == BUCKETFILLED && t->type == BUCKETDOINGTERMS ) {
+				if ( thr == 0 || t->firstterm < thr->firstterm ) thr = t;
+			}
+		}
+		if ( thr == 0 ) break;
+		if ( ClaimBucket(thr,identity) ) {
+			handoffs[identity].stolen++;
+			return(thr);
+		}
+	}
+	return(0);
+}
+
+/*
+  	#] StealBucket : 
+  	#[ BookBucket :
+*/
+/**
+ *	A worker reports a bucket that it has completed (On threadbucketautotune).
+ *	Buckets that were taken back by the load balancing are not reported:
+ *	their terms were not all done by the same worker.
+ *
+ *	@param terms The number of terms in the bucket.
+ *	@param work  The time the worker spent on them, in nanoseconds.
+ *	@param wait  The time from the moment the master started to load the
+ *	             worker with the bucket until the worker started on it:
+ *	             the cost of handing out a bucket, including the wakeup.
+ *	             It is -1 for a bucket that the worker took itself.
+ *	             Such a bucket cost only a compare-and-swap, so it tells
+ *	             nothing about the handoff.
+ */
+
+void BookBucket(LONG terms, LONG work, LONG wait)
+{
+	__sync_fetch_and_add(&autobucketterms,terms);
+	__sync_fetch_and_add(&autobucketwork,work);
+	if ( wait >= 0 ) {
+		__sync_fetch_and_add(&autobucketwait,wait);
+		__sync_fetch_and_add(&autobucketwaits,1);
+	}
+	__sync_fetch_and_add(&autobucketcount,1);
+}
+
+/*
+  	#] BookBucket : 
+  	#[ TuneBucketSize :
+*/
+/**
+ *	Computes the size of the next bucket from what the workers reported
+ *	with BookBucket since the last call. The bucket should be big enough
+ *	that handing it out costs at most 1/AUTOBUCKETOVERHEAD of its work.
+ *	The handoff cost is the average over the buckets the master sent.
+ *	When the workers took all buckets themselves there is no new estimate
+ *	and the size stays. The new estimate is averaged with the old size to
+ *	damp the noise. This is the steady size. threadhandoffstats reports its
+ *	average and range.
+ *	Towards the end of the expression the buckets become smaller again,
+ *	so that the last terms are spread over all workers.
+ *	The sizes are as in ThreadsProcessor: one less than the number of terms.
+ *
+ *	@param size      The current steady size.
+ *	@param maxsize   The largest size that is allowed.
+ *	@param remaining The estimated number of terms that still have to go.
+ *	@param next      Here the size of the next bucket is put.
+ *	@return The new steady size.
+ */
+
+LONG TuneBucketSize(LONG size, LONG maxsize, LONG remaining, LONG *next)
+{
+	LONG terms, work, wait, waits, newsize;
+	if ( autobucketcount >= numberofworkers ) {
+		__sync_fetch_and_and(&autobucketcount,0);
+		terms = __sync_fetch_and_and(&autobucketterms,0);
+		work  = __sync_fetch_and_and(&autobucketwork,0);
+		wait  = __sync_fetch_and_and(&autobucketwait,0);
+		waits = __sync_fetch_and_and(&autobucketwaits,0);
+		if ( waits > 0 && terms > 0 ) {
+			if ( work <= 0 ) newsize = maxsize;
+			else newsize = (LONG)(((double)AUTOBUCKETOVERHEAD*(double)wait
+					*(double)terms)/((double)waits*(double)work)) - 1;
+			if ( newsize > maxsize ) newsize = maxsize;
+			size = ( size + newsize ) / 2;
+			if ( size < 0 ) size = 0;
+			if ( autobucketsmallest < 0 || size < autobucketsmallest ) autobucketsmallest = size;
+			if ( size > autobucketlargest ) autobucketlargest = size;
+			autobucketsizes += size;
+			autobuckettunes++;
+		}
+	}
+	*next = size;
+	if ( remaining > 0 && *next > remaining / ( numberofworkers * 5 ) )
+		*next = remaining / ( numberofworkers * 5 );
+	if ( *next > maxsize ) *next = maxsize;
+	if ( *next < 0 ) *next = 0;
+	return(size);
+}
+
+/*
+  	#] TuneBucketSize : 
   	#[ SendOneBucket :
 */
 /**
@@ -2413,7 +3282,8 @@ int SendOneBucket(int type)
 	THREADBUCKET *thr = 0;
 	int j, k, id;
 	for ( j = 0; j < numthreadbuckets; j++ ) {
-		if ( threadbuckets[j]->free == BUCKETFILLED ) {
+		if ( threadbuckets[j]->free == BUCKETFILLED
+		&& ClaimBucket(threadbuckets[j],0) ) {
 			thr = threadbuckets[j];
 			for ( k = j+1; k < numthreadbuckets; k++ )
 				threadbuckets[k-1] = threadbuckets[k];
@@ -2421,15 +3291,18 @@ int SendOneBucket(int type)
 			break;
 		}
 	}
-	AN0.ninterms++;
+/*
+	A worker may have taken the last bucket itself.
+*/
+	if ( thr == 0 ) return(0);
+	if ( thr->type == BUCKETDOINGBRACKET ) AN0.ninterms++;
 	while ( ( id = GetAvailableThread() ) < 0 ) { MasterWait(); }
 /*
 	Prepare the thread. Give it the term and variables.
 */
+	if ( AC.ThreadBucketAutotune ) thr->sendtime = ProfileClock();
 	LoadOneThread(0,id,thr,0);
-	thr->busy = BUCKETASSIGNED;
-	thr->free = BUCKETINUSE;
-	numberoffullbuckets--;
+	handoffs[id].sent++;
 /*
 	And signal the thread to run.
 	Form now on we may only interfere with this bucket
@@ -2472,6 +3345,7 @@ int InParallelProcessor()
 	EXPRESSIONS e;
 	if ( numberofworkers >= 2 ) {
 		SetWorkerFiles();
+		sorthelpactive = 1;
 		for ( i = 0; i < NumExpressions; i++ ) {
 			e = Expressions+i;
 			if ( e->partodo <= 0 ) continue;
@@ -2497,9 +3371,11 @@ int InParallelProcessor()
 			num++;
 		}
 /*
-		Now we have to wait for all workers to finish
+		Now we have to wait for all workers to finish. In the meantime
+		the idle workers can help the others with their sorts.
 */
-		if ( num > 0 ) MasterWaitAll();
+		if ( num > 0 ) MasterWaitAllHelping();
+		sorthelpactive = 0;
 
 		if ( AC.CollectFun ) AR.DeferFlag = 0;
 	}
@@ -2513,6 +3389,289 @@ int InParallelProcessor()
 
 /*
   	#] InParallelProcessor : 
+  	#[ IniSortHelps :
+*/
+/**
+ *	Allocates the administration for HelpedSplitMerge. Each worker has
+ *	MAXSORTHELPPARTS parts. The scratch space is allocated when needed.
+ *	The same for the images of gcds (GcdHelpParts) with MAXGCDHELPPARTS.
+ */
+
+void IniSortHelps()
+{
+	int i, n = (numberofworkers+1)*MAXSORTHELPPARTS;
+	sorthelps = (SORTHELP *)Malloc1(sizeof(SORTHELP)*n,"sorthelps");
+	sorthelpqueue = (SORTHELP **)Malloc1(sizeof(SORTHELP *)*n,"sorthelpqueue");
+	sorthelpgiven = (SORTHELP **)Malloc1(sizeof(SORTHELP *)*(numberofworkers+1),"sorthelpgiven");
+	for ( i = 0; i < n; i++ ) {
+		sorthelps[i].Pointer = sorthelps[i].scratch = 0;
+		sorthelps[i].number = sorthelps[i].scratchsize = 0;
+		pthread_mutex_init(&(sorthelps[i].lock),NULL);
+		pthread_cond_init(&(sorthelps[i].cond),NULL);
+		sorthelps[i].owner = i/MAXSORTHELPPARTS;
+		sorthelps[i].state = SORTHELPDONE;
+	}
+	for ( i = 0; i <= numberofworkers; i++ ) sorthelpgiven[i] = 0;
+	numsorthelpqueue = 0;
+	n = (numberofworkers+1)*MAXGCDHELPPARTS;
+	gcdhelps = (GCDHELP *)Malloc1(sizeof(GCDHELP)*n,"gcdhelps");
+	gcdhelpqueue = (GCDHELP **)Malloc1(sizeof(GCDHELP *)*n,"gcdhelpqueue");
+	gcdhelpgiven = (GCDHELP **)Malloc1(sizeof(GCDHELP *)*(numberofworkers+1),"gcdhelpgiven");
+	for ( i = 0; i < n; i++ ) {
+		gcdhelps[i].result = 0;
+		pthread_mutex_init(&(gcdhelps[i].lock),NULL);
+		pthread_cond_init(&(gcdhelps[i].cond),NULL);
+		gcdhelps[i].owner = i/MAXGCDHELPPARTS;
+		gcdhelps[i].state = SORTHELPDONE;
+	}
+	for ( i = 0; i <= numberofworkers; i++ ) gcdhelpgiven[i] = 0;
+	numgcdhelpqueue = 0;
+}
+
+/*
+  	#] IniSortHelps : 
+  	#[ HelpedSplitMerge :
+*/
+/**
+ *	Replaces SplitMerge for the small buffer of a worker at the moments
+ *	that other workers may be idle: when it does a complete expression of
+ *	an InParallel statement, or at the end of the terms of an expression.
+ *	When one expression is much bigger than the others, or when one term
+ *	gives a huge argument or $-variable, its worker would be sorting alone
+ *	while the others have nothing to do. This holds for all sort levels:
+ *	sorts of arguments and $-variables use the buffers of AN.FunSorts
+ *	(subsmallsize etc.) and their small buffers are split the same way.
+ *
+ *	The array of pointers is cut in a power of two number of parts. All
+ *	but the first part are put in the queue of sorthelpqueue, from which
+ *	the master gives them to idle workers (MasterWaitAllHelping). The
+ *	owner sorts the first part itself and then takes back the parts that
+ *	nobody has started with. The helpers only compare terms (SortPointers)
+ *	because the addition of equal terms may need the extension of the
+ *	small buffer and may even cause a garbage collection. Hence that is
+ *	done by the owner after all parts have been sorted (AddNeighbours),
+ *	after which the parts are merged pairwise with MergeRuns.
+ *
+ *	@param  Pointer The array of pointers to the terms to be sorted.
+ *	@param  number  The number of pointers in Pointer.
+ *	@return The number of terms after sorting and adding.
+ */
+
+LONG HelpedSplitMerge(PHEAD WORD **Pointer, LONG number)
+{
+	SORTHELP *h;
+	LONG start[MAXSORTHELPPARTS+1], count[MAXSORTHELPPARTS];
+	int parts, i, j, step;
+	if ( sorthelpactive == 0 || AC.ThreadSortHelp == 0
+	|| AT.identity > numberofworkers )
+		return(SplitMerge(BHEAD Pointer,number));
+	for ( parts = 1; 2*parts <= numberofworkers && 2*parts <= MAXSORTHELPPARTS
+		&& 2*parts*SORTHELPMINTERMS <= number; parts *= 2 ) {}
+	if ( parts < 2 ) return(SplitMerge(BHEAD Pointer,number));
+	h = sorthelps + AT.identity*MAXSORTHELPPARTS;
+	for ( i = 0; i <= parts; i++ ) start[i] = (number*i)/parts;
+	for ( i = 0; i < parts; i++ ) {
+		h[i].Pointer = Pointer + start[i];
+		h[i].number = start[i+1] - start[i];
+		if ( h[i].number/2+1 > h[i].scratchsize ) {
+			if ( h[i].scratch ) M_free(h[i].scratch,"sort help scratch");
+			h[i].scratchsize = h[i].number/2+1;
+			h[i].scratch = (WORD **)Malloc1(sizeof(WORD *)*h[i].scratchsize,"sort help scratch");
+		}
+	}
+	LOCK(wakeupmasterlock);
+	for ( i = 1; i < parts; i++ ) {
+		h[i].state = SORTHELPPOSTED;
+		sorthelpqueue[numsorthelpqueue++] = h+i;
+	}
+	pthread_cond_signal(&wakeupmasterconditions);
+	UNLOCK(wakeupmasterlock);
+
+	SortPointers(BHEAD h[0].Pointer,h[0].scratch,h[0].number);
+/*
+	The master hands out the parts from the bottom of the list, hence we
+	take back from the top.
+*/
+	for ( i = parts-1; i >= 1; i-- ) {
+		LOCK(wakeupmasterlock);
+		if ( h[i].state == SORTHELPPOSTED ) {
+			for ( j = 0; sorthelpqueue[j] != h+i; j++ ) {}
+			for ( ; j < numsorthelpqueue-1; j++ ) sorthelpqueue[j] = sorthelpqueue[j+1];
+			numsorthelpqueue--;
+			h[i].state = SORTHELPWITHDRAWN;
+		}
+		UNLOCK(wakeupmasterlock);
+		if ( h[i].state == SORTHELPWITHDRAWN ) {
+			SortPointers(BHEAD h[i].Pointer,h[i].scratch,h[i].number);
+			h[i].state = SORTHELPDONE;
+		}
+		else {
+			int profile = ProfileSwitch(AT.identity,PROFWAIT);
+			LOCK(h[i].lock);
+			while ( h[i].state != SORTHELPDONE )
+				pthread_cond_wait(&(h[i].cond),&(h[i].lock));
+			UNLOCK(h[i].lock);
+			ProfileSwitch(AT.identity,profile);
+		}
+	}
+	for ( i = 0; i < parts; i++ )
+		count[i] = AddNeighbours(BHEAD h[i].Pointer,h[i].number);
+	for ( step = 1; step < parts; step *= 2 ) {
+		for ( i = 0; i < parts; i += 2*step ) {
+			count[i] = MergeRuns(BHEAD Pointer+start[i],count[i]
+					,start[i+step]-start[i],count[i+step]);
+		}
+	}
+	return(count[0]);
+}
+
+/*
+  	#] HelpedSplitMerge : 
+  	#[ DoSortHelp :
+*/
+/**
+ *	Executed by an idle worker that has been given a part of the sort of
+ *	another worker. It compares with the settings of the owner.
+ *
+ *	@param identity The helping worker.
+ */
+
+void DoSortHelp(int identity)
+{
+	ALLPRIVATES *B = AB[identity], *BB;
+	SORTHELP *h = sorthelpgiven[identity];
+	SORTING *oldSS = AT.SS;
+	VOID *oldcompare = AR.CompareRoutine;
+	WORD oldsorttype = AR.SortType, oldfromindex = AT.fromindex;
+	WORD oldpolyflag = AT.S0->PolyFlag;
+	BB = AB[h->owner];
+	AR.CompareRoutine = BB->R.CompareRoutine;
+	AR.SortType = BB->R.SortType;
+	AT.fromindex = BB->T.fromindex;
+	AT.SS = AT.S0;
+	AT.SS->PolyFlag = 0;
+	SortPointers(BHEAD h->Pointer,h->scratch,h->number);
+	handoffs[identity].sortparts++;
+	AT.S0->PolyFlag = oldpolyflag;
+	AT.SS = oldSS;
+	AT.fromindex = oldfromindex;
+	AR.SortType = oldsorttype;
+	AR.CompareRoutine = oldcompare;
+	LOCK(h->lock);
+	h->state = SORTHELPDONE;
+	pthread_cond_signal(&(h->cond));
+	UNLOCK(h->lock);
+}
+
+/*
+  	#] DoSortHelp : 
+  	#[ GcdHelpParts :
+*/
+/**
+ *	Gives the parts for the images of a polynomial gcd (gcd_modular_images
+ *	in polygcd.cc) of a worker, at the same moments at which
+ *	HelpedSplitMerge asks for help: when other workers may be idle.
+ *	Each part is the image modulo another prime. Small gcds are done alone.
+ *
+ *	@param  size   The number of words of the two polynomials.
+ *	@param  want   The number of images the gcd can use.
+ *	@param  parts  Returns the number of parts.
+ *	@return The parts, or zero when the worker should work alone.
+ */
+
+GCDHELP *GcdHelpParts(PHEAD LONG size, int want, int *parts)
+{
+	if ( sorthelpactive == 0 || AC.ThreadGcdHelp == 0
+	|| AT.identity > numberofworkers || numberofworkers < 2
+	|| size < GCDHELPMINSIZE || want < 2 ) return(0);
+	*parts = numberofworkers < MAXGCDHELPPARTS ? numberofworkers : MAXGCDHELPPARTS;
+	if ( *parts > want ) *parts = want;
+	return(gcdhelps + AT.identity*MAXGCDHELPPARTS);
+}
+
+/*
+  	#] GcdHelpParts : 
+  	#[ PostGcdHelps :
+*/
+/**
+ *	Puts all but the first part in the gcdhelpqueue, from which the master
+ *	gives them to idle workers (MasterWaitAllHelping). The owner does the
+ *	first part itself.
+ */
+
+void PostGcdHelps(GCDHELP *h, int parts)
+{
+	int i;
+	LOCK(wakeupmasterlock);
+	for ( i = 1; i < parts; i++ ) {
+		h[i].state = SORTHELPPOSTED;
+		gcdhelpqueue[numgcdhelpqueue++] = h+i;
+	}
+	pthread_cond_signal(&wakeupmasterconditions);
+	UNLOCK(wakeupmasterlock);
+}
+
+/*
+  	#] PostGcdHelps : 
+  	#[ CollectGcdHelps :
+*/
+/**
+ *	Takes back the parts that nobody has started with and waits for the
+ *	others. Contrary to the parts of a sort, the parts that are taken back
+ *	are not done at all: the gcd just continues with other primes. They
+ *	can be recognized by the absence of a result.
+ */
+
+void CollectGcdHelps(PHEAD GCDHELP *h, int parts)
+{
+	int i, j, withdrawn;
+	for ( i = parts-1; i >= 1; i-- ) {
+		withdrawn = 0;
+		LOCK(wakeupmasterlock);
+		if ( h[i].state == SORTHELPPOSTED ) {
+			for ( j = 0; gcdhelpqueue[j] != h+i; j++ ) {}
+			for ( ; j < numgcdhelpqueue-1; j++ ) gcdhelpqueue[j] = gcdhelpqueue[j+1];
+			numgcdhelpqueue--;
+			h[i].state = SORTHELPDONE;
+			withdrawn = 1;
+		}
+		UNLOCK(wakeupmasterlock);
+		if ( withdrawn == 0 ) {
+			int profile = ProfileSwitch(AT.identity,PROFWAIT);
+			LOCK(h[i].lock);
+			while ( h[i].state != SORTHELPDONE )
+				pthread_cond_wait(&(h[i].cond),&(h[i].lock));
+			UNLOCK(h[i].lock);
+			ProfileSwitch(AT.identity,profile);
+		}
+	}
+}
+
+/*
+  	#] CollectGcdHelps : 
+  	#[ DoGcdHelp :
+*/
+/**
+ *	Executed by an idle worker that has been given an image of a gcd of
+ *	another worker.
+ *
+ *	@param identity The helping worker.
+ */
+
+void DoGcdHelp(int identity)
+{
+	ALLPRIVATES *B = AB[identity];
+	GCDHELP *h = gcdhelpgiven[identity];
+	poly_gcd_image(BHEAD h);
+	handoffs[identity].gcdimages++;
+	LOCK(h->lock);
+	h->state = SORTHELPDONE;
+	pthread_cond_signal(&(h->cond));
+	UNLOCK(h->lock);
+}
+
+/*
+  	#] DoGcdHelp : 
   	#[ ThreadsProcessor :
 */
 /**
@@ -2543,7 +3702,9 @@ int ThreadsProcessor(EXPRESSIONS e, WORD LastExpression, WORD fromspectator)
 {
 	ALLPRIVATES *B0 = AB[0], *B = B0;
 	int id, oldgzipCompress, endofinput = 0, j, still, k, defcount = 0, bra = 0, first = 1;
-	LONG dd = 0, ddd, thrbufsiz, thrbufsiz0, thrbufsiz2, numbucket = 0, numpasses;
+	int profile;
+	LONG dd = 0, ddd, thrbufsiz, thrbufsiz0, thrbufsiz2, thrbufmax, numbucket = 0, numpasses;
+	LONG thrbufsteady;
 	LONG num, i;
 	WORD *oldworkpointer = AT0.WorkPointer, *tt, *ttco = 0, *t1 = 0, ter, *tstop = 0, *t2;
 	THREADBUCKET *thr = 0;
@@ -2592,6 +3753,15 @@ int ThreadsProcessor(EXPRESSIONS e, WORD LastExpression, WORD fromspectator)
 	thrbufsiz0 = thrbufsiz;
 	numpasses = 5; /* this is just for trying */
 	thrbufsiz = thrbufsiz0 / (2 << numpasses);
+/*
+	With the autotuning the buckets may grow beyond the ThreadBucketSize,
+	but not with keep brackets: the deferbuffer has no room for that.
+*/
+	if ( AR0.DeferFlag ) thrbufmax = AC.ThreadBucketSize-1;
+	else                 thrbufmax = AUTOBUCKETGROWTH*AC.ThreadBucketSize-1;
+	thrbufsteady = thrbufsiz0;
+	autobucketterms = autobucketwork = autobucketwait = autobucketwaits = 0;
+	autobucketcount = 0;
 /*
 	Mark all buckets as free and take the first.
 */
@@ -2644,14 +3814,12 @@ Found1:;
 */
 					thr->firstbracket = n;
 					thr->lastbracket = n + num - 1;
-					thr->type = BUCKETDOINGBRACKET;
-					thr->free = BUCKETFILLED;
 					thr->firstterm = AN0.ninterms;
 					for ( j = n; j < n+num; j++ ) {
 						AN0.ninterms += e->bracketinfo->indexbuffer[j].termsinbracket;
 					}
 					n += num-1;
-					numberoffullbuckets++;
+					MarkBucketFilled(thr,BUCKETDOINGBRACKET);
 					if ( topofavailables > 0 ) {
 						SendOneBucket(DOBRACKETS);
 					}
@@ -2806,6 +3974,11 @@ Found2:;
 			}
 			thrbufsiz2 = thrbufsiz + thrbufsiz/5; /* for completing brackets */
 		}
+		else if ( AC.ThreadBucketAutotune ) {
+			thrbufsteady = TuneBucketSize(thrbufsteady,thrbufmax
+				,e->counter-AN0.ninterms,&thrbufsiz);
+			thrbufsiz2 = thrbufsiz + thrbufsiz/5;
+		}
 /*
 		we have already 1+dd terms
 */
@@ -2887,11 +4060,9 @@ Found2:;
 		}
 		thr->ddterms = dd; /* total number of terms including keep brackets */
 		thr->firstterm = AN0.ninterms;
-		AN0.ninterms += dd;
+		AN0.ninterms += dd+1;
 		*tt = 0;           /* mark end of bucket */
-		thr->free = BUCKETFILLED;
-		thr->type = BUCKETDOINGTERMS;
-		numberoffullbuckets++;
+		MarkBucketFilled(thr,BUCKETDOINGTERMS);
 		if ( topofavailables <= 0 && endofinput == 0 ) {
 /*
 			Problem: topofavailables may already be > 0, but the
@@ -2958,17 +4129,18 @@ Found2:;
 		The bucket we are going to use is in thr.
 */
 DoBucket:;
-		AN0.ninterms++;
+/*
+		With work stealing a worker may have taken the bucket already.
+*/
+		if ( ClaimBucket(thr,0) == 0 ) goto NoBucket;
+		if ( thr->type == BUCKETDOINGBRACKET ) AN0.ninterms++;
 		while ( ( id = GetAvailableThread() ) < 0 ) { MasterWait(); }
 /*
 		Prepare the thread. Give it the term and variables.
 */
+		if ( AC.ThreadBucketAutotune ) thr->sendtime = ProfileClock();
 		LoadOneThread(0,id,thr,0);
-		LOCK(thr->lock);
-		thr->busy = BUCKETASSIGNED;
-		UNLOCK(thr->lock);
-		thr->free = BUCKETINUSE;
-		numberoffullbuckets--;
+		handoffs[id].sent++;
 /*
 		And signal the thread to run.
 		Form now on we may only interfere with this bucket
@@ -2981,6 +4153,7 @@ DoBucket:;
 /*
 		Now look whether there is another bucket filled and a worker available
 */
+NoBucket:;
 		if ( topofavailables > 0 ) {  /* there is a worker */
 			for ( j = 0; j < numthreadbuckets; j++ ) {
 				if ( threadbuckets[j]->free == BUCKETFILLED ) {
@@ -3106,7 +4279,13 @@ NextBucket:;
 */
 		AS.Balancing = 0;
 	}
-	MasterWaitAll();
+/*
+	The workers that are done can help the ones that still work on big
+	terms with their sorts, including the sorts of arguments and $-variables.
+*/
+	sorthelpactive = 1;
+	MasterWaitAllHelping();
+	sorthelpactive = 0;
 	AS.Balancing = 0;
 /*
 	When we deal with the last expression we can now remove the input
@@ -3134,11 +4313,13 @@ NextBucket:;
 	oldgzipCompress = AR0.gzipCompress;
 	AR0.gzipCompress = 0;
 	if ( AR0.outtohide ) AR0.outfile = AR0.hidefile;
+	profile = ProfileSwitch(0,PROFSORT);
 	if ( MasterMerge() < 0 ) {
 		if ( AR0.outtohide ) AR0.outfile = oldoutfile;
 		AR0.gzipCompress = oldgzipCompress;
 		goto ProcErr;
 	}
+	ProfileSwitch(0,profile);
 	if ( AR0.outtohide ) AR0.outfile = oldoutfile;
 	AR0.gzipCompress = oldgzipCompress;
 /*
@@ -3308,8 +4489,6 @@ intercepted:;
 			thrtogo = freebuckets[i];
 			t2 = thrtogo->threadbuffer;
 			c2 = thrtogo->compressbuffer;
-			thrtogo->free = BUCKETFILLED;
-			thrtogo->type = BUCKETDOINGTERMS;
 			thrtogo->totnum = nperbucket+1;
 			thrtogo->ddterms = 0;
 			thrtogo->usenum = 0;
@@ -3322,6 +4501,7 @@ intercepted:;
 				thrtogo->deferbuffer[n] = thr->deferbuffer[u++];
 			}
 			*t2 = *c2 = 0;
+			MarkBucketFilled(thrtogo,BUCKETDOINGTERMS);
 		  }
 		}
 		if ( nperbucket > 0 ) {
@@ -3329,8 +4509,6 @@ intercepted:;
 			thrtogo = freebuckets[i];
 			t2 = thrtogo->threadbuffer;
 			c2 = thrtogo->compressbuffer;
-			thrtogo->free = BUCKETFILLED;
-			thrtogo->type = BUCKETDOINGTERMS;
 			thrtogo->totnum = nperbucket;
 			thrtogo->ddterms = 0;
 			thrtogo->usenum = 0;
@@ -3343,6 +4521,7 @@ intercepted:;
 				thrtogo->deferbuffer[n] = thr->deferbuffer[u++];
 			}
 			*t2 = *c2 = 0;
+			MarkBucketFilled(thrtogo,BUCKETDOINGTERMS);
 		  }
 		}
 	}
@@ -3354,8 +4533,6 @@ intercepted:;
 		  for ( i = 0; i < extra; i++ ) {
 			thrtogo = freebuckets[i];
 			t2 = thrtogo->threadbuffer;
-			thrtogo->free = BUCKETFILLED;
-			thrtogo->type = BUCKETDOINGTERMS;
 			thrtogo->totnum = nperbucket+1;
 			thrtogo->ddterms = 0;
 			thrtogo->usenum = 0;
@@ -3366,14 +4543,13 @@ intercepted:;
 				j = *t1; NCOPY(t2,t1,j);
 			}
 			*t2 = 0;
+			MarkBucketFilled(thrtogo,BUCKETDOINGTERMS);
 		  }
 		}
 		if ( nperbucket > 0 ) {
 		  for ( i = extra; i < numfree; i++ ) {
 			thrtogo = freebuckets[i];
 			t2 = thrtogo->threadbuffer;
-			thrtogo->free = BUCKETFILLED;
-			thrtogo->type = BUCKETDOINGTERMS;
 			thrtogo->totnum = nperbucket;
 			thrtogo->ddterms = 0;
 			thrtogo->usenum = 0;
@@ -3384,6 +4560,7 @@ intercepted:;
 				j = *t1; NCOPY(t2,t1,j);
 			}
 			*t2 = 0;
+			MarkBucketFilled(thrtogo,BUCKETDOINGTERMS);
 		  }
 		}
 	}
@@ -3977,6 +5154,7 @@ EndOfMerge:
 		S->GenTerms += AB[j]->T.SS->GenTerms;
 	}
 	WriteStats(&position,2);
+	if ( S->stats ) SortStatsEnd(B0,&position);
 	Expressions[AR0.CurExpr].counter = S->TermsLeft;
 	Expressions[AR0.CurExpr].size = position;
 /*
@@ -4119,6 +5297,7 @@ int SortBotMasterMerge()
 	}
 	S->TermsLeft = numberofterms;
 	WriteStats(&position,2);
+	if ( S->stats ) SortStatsEnd(B,&position);
 	Expressions[AR.CurExpr].counter = S->TermsLeft;
 	Expressions[AR.CurExpr].size = position;
 	AS.MasterSort = 0;
@@ -4622,6 +5801,7 @@ int IniSortBlocks(int numworkers)
 	if ( w == 0 ) w = S->sBuffer;
 	for ( id = 1; id <= numparts; id++ ) {
 		B = AB[id];
+		if ( numberofnodes > 1 ) BindMemoryToNode(w,w+maxter+numberofblocks*blocksize,threadnodes[id]);
 		AT.SB.MasterBlockLock = (pthread_mutex_t *)Malloc1(
 			sizeof(pthread_mutex_t)*(numberofblocks+1),"MasterBlockLock");
 		AT.SB.MasterStart = (WORD **)Malloc1(sizeof(WORD *)*(numberofblocks+1)*3,"MasterBlock");
@@ -4658,28 +5838,88 @@ int IniSortBlocks(int numworkers)
 /**
  *	To be used in a sortbot merge. It initializes the whole sortbot
  *	system by telling the sortbot which threads provide their input.
+ *	The tree has been made by PlanSortBotTree.
  */
 
 void DefineSortBotTree()
 {
 	ALLPRIVATES *B;
-	int n, i, from;
+	int i;
 	if ( numberofworkers <= 2 ) return;
-	n = numberofworkers*2-2;
-	for ( i = numberofworkers+1, from = 1; i <= n; i++ ) {
+	for ( i = numberofworkers+1; i <= numberofworkers*2-2; i++ ) {
 		B = AB[i];
-		AT.SortBotIn1 = from++;
-		AT.SortBotIn2 = from++;
+		AT.SortBotIn1 = sortbotinputs[2*i];
+		AT.SortBotIn2 = sortbotinputs[2*i+1];
 	}
 	B = AB[0];
-	AT.SortBotIn1 = from++;
-	AT.SortBotIn2 = from++;
+	AT.SortBotIn1 = sortbotinputs[0];
+	AT.SortBotIn2 = sortbotinputs[1];
+}
+
+/*
+  	#] DefineSortBotTree : 
+  	#[ PlanSortBotTree :
+*/
+/**
+ *	Makes the merge tree of the sortbots, before they are started, and
+ *	decides on which NUMA node each sortbot will run. Each node has a
+ *	queue of streams, initially its workers. As long as there are more
+ *	than two streams, the node with the most streams merges its two oldest
+ *	ones in the next sortbot, which is placed on that node. Only when each
+ *	node has a single stream left the streams of two nodes are merged.
+ *	This way all but numberofnodes-1 merges stay inside a node.
+ *	The master merges the last two streams.
+ *
+ *	With a single node this is the old tree: sortbot numberofworkers+1
+ *	merges workers 1 and 2, the next one 3 and 4 etc.
+ */
+
+void PlanSortBotTree()
+{
+	int *queues, *head, *tail, nq, k, kk, i, sb, total, a, b, node;
+	nq = numberofnodes > 1 ? numberofnodes : 1;
+	sortbotinputs = (int *)Malloc1(sizeof(int)*4*numberofworkers,"sortbotinputs");
+	queues = (int *)Malloc1(sizeof(int)*(2*numberofworkers*nq+2*nq),"sortbot queues");
+	head = queues + 2*numberofworkers*nq;
+	tail = head + nq;
+	for ( k = 0; k < nq; k++ ) head[k] = tail[k] = 0;
+	for ( i = 1; i <= numberofworkers; i++ ) {
+		k = threadnodes[i] < 0 ? 0 : threadnodes[i];
+		queues[2*numberofworkers*k+tail[k]++] = i;
+	}
+	total = numberofworkers;
+	for ( sb = numberofworkers+1; total > 2; sb++, total-- ) {
+		k = 0;
+		for ( kk = 1; kk < nq; kk++ ) {
+			if ( tail[kk]-head[kk] > tail[k]-head[k] ) k = kk;
+		}
+		if ( tail[k]-head[k] >= 2 ) {
+			a = queues[2*numberofworkers*k+head[k]++];
+			b = queues[2*numberofworkers*k+head[k]++];
+			node = k;
+		}
+		else {
+			for ( k = 0; tail[k] == head[k]; k++ ) {}
+			for ( kk = k+1; tail[kk] == head[kk]; kk++ ) {}
+			a = queues[2*numberofworkers*k+head[k]++];
+			b = queues[2*numberofworkers*kk+head[kk]++];
+			node = k;
+		}
+		sortbotinputs[2*sb] = a;
+		sortbotinputs[2*sb+1] = b;
+		threadnodes[sb] = numberofnodes > 1 ? node : -1;
+		queues[2*numberofworkers*node+tail[node]++] = sb;
+	}
+	for ( k = 0, i = 0; k < nq; k++ ) {
+		while ( head[k] < tail[k] ) sortbotinputs[i++] = queues[2*numberofworkers*k+head[k]++];
+	}
+	M_free(queues,"sortbot queues");
 }
 
 #endif
 
 /*
-  	#] DefineSortBotTree : 
+  	#] PlanSortBotTree : 
   	#[ GetTerm2 :
 
 	Routine does a GetTerm but only when a bracket index is involved and
@@ -4867,7 +6107,8 @@ void IniFbufs(VOID)
 {
 	int i;
 	for ( i = 0; i < AM.totalnumberofthreads; i++ ) {
-		IniFbuffer(AB[i]->T.fbufnum);
+		IniFbuffer(AB[i]->T.fbufnum,AM.fbuffersize);
+		IniFbuffer(AB[i]->T.rfbufnum,AM.rfbuffersize);
 	}
 }
 
@@ -4911,11 +6152,20 @@ void UnSetMods()
   	#[ find_Horner_MCTS_expand_tree_threaded :
 */
  
+/**
+ *	Wakes up all workers to expand the MCTS tree of Optimize together
+ *	(see find_Horner_MCTS_expand_tree_loop in optimize.cc) and joins
+ *	them. They stop by themselves when there is nothing left to do.
+ */
+
 void find_Horner_MCTS_expand_tree_threaded() {
-	int id;
-	while (( id = GetAvailableThread() ) < 0)
-		MasterWait();	
-	WakeupThread(id,MCTSEXPANDTREE);
+	int id, i;
+	for ( i = 0; i < numberofworkers; i++ ) {
+		while (( id = GetAvailableThread() ) < 0)
+			MasterWait();	
+		WakeupThread(id,MCTSEXPANDTREE);
+	}
+	handoffs[0].mctsexpansions += find_Horner_MCTS_expand_tree_loop();
 }
 
 /*
@@ -1406,6 +1406,39 @@ VOID SynchFile(int handle)
 
 /*
  		#] SynchFile : 
+ 		#[ PrefetchFile :
+
+		Tells the system that we will soon read size bytes at position.
+		When the patches of a sort file are merged the streams are
+		refilled one after the other, each at its own place in the file.
+		The readahead of the system does not recognize this pattern and
+		each refill would wait for the disk. With this hint the system may
+		read the next block of a stream while we are still merging the
+		current one.
+
+		This is only a hint. The refill itself is still a plain read in
+		PutIn or FillInputGZIP, and there is no second buffer and no I/O
+		thread of our own. A real double buffer would need an I/O thread
+		also in the sequential version, which has no pthreads. It would
+		also need a second buffer per stream behind PObuffer, and that
+		buffer is read directly in too many places to swap it safely.
+		When the hint is not supported or the data is not in the cache
+		yet, the refill waits for the disk as before.
+*/
+
+VOID PrefetchFile(int handle, POSITION *position, LONG size)
+{
+	FILES *f;
+	if ( handle >= 0 && size > 0 ) {
+		RWLOCKR(AM.handlelock);
+		f = filelist[handle];
+		UNRWLOCK(AM.handlelock);
+		Uprefetch(f,(off_t)BASEPOSITION(*position),(off_t)size);
+	}
+}
+
+/*
+ 		#] PrefetchFile : 
  		#[ TruncateFile :
 
 		It may be that when we use many sort files at the same time there
@@ -2074,6 +2074,9 @@ WORD RunPermute(PHEAD WORD *fun, WORD *args, WORD *info)
 	WORD *tt, totarg, *tstop, arg1, arg2, n, num, i, *f, *f1, *f2, *infostop;
 	WORD *in, *iw, withdollar;
 	DOLLARS d;
+#ifdef WITHPTHREADS
+	int nummodopt, dtype, numdollar;
+#endif
 	if ( *args != ARGRANGE ) {
 		MLOCK(ErrorMessageLock);
 		MesPrint("Illegal range encountered in RunPermute");
@@ -2114,33 +2117,41 @@ WORD RunPermute(PHEAD WORD *fun, WORD *args, WORD *info)
 			if ( *in < 0 ) { /* Dollar variable -(number+1) */
 				d = Dollars - *in - 1;
 #ifdef WITHPTHREADS
-				{
-					int nummodopt, dtype = -1, numdollar = -*in-1;
-					if ( AS.MultiThreaded && ( AC.mparallelflag == PARALLELFLAG ) ) {
-						for ( nummodopt = 0; nummodopt < NumModOptdollars; nummodopt++ ) {
-							if ( numdollar == ModOptdollars[nummodopt].number ) break;
+				dtype = -1; numdollar = -*in-1;
+				if ( AS.MultiThreaded && ( AC.mparallelflag == PARALLELFLAG ) ) {
+					for ( nummodopt = 0; nummodopt < NumModOptdollars; nummodopt++ ) {
+						if ( numdollar == ModOptdollars[nummodopt].number ) break;
+					}
+					if ( nummodopt < NumModOptdollars ) {
+						dtype = ModOptdollars[nummodopt].type;
+						if ( dtype == MODLOCAL ) {
+							d = ModOptdollars[nummodopt].dstruct+AT.identity;
 						}
-						if ( nummodopt < NumModOptdollars ) {
-							dtype = ModOptdollars[nummodopt].type;
-							if ( dtype == MODLOCAL ) {
-								d = ModOptdollars[nummodopt].dstruct+AT.identity;
-							}
-							else {
-								LOCK(d->pthreadslockread);
-							}
+						else {
+							RWLOCKR(d->pthreadslockread);
 						}
 					}
 				}
 #endif
 				if ( ( d->type == DOLNUMBER || d->type == DOLTERMS )
 				 && d->where[0] == 4 && d->where[4] == 0 ) {
-					if ( d->where[3] < 0 || d->where[2] != 1 || d->where[1] > totarg ) return(0);
+					if ( d->where[3] < 0 || d->where[2] != 1 || d->where[1] > totarg ) {
+#ifdef WITHPTHREADS
+						if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
+#endif
+						return(0);
+					}
 				}
 				else if ( d->type == DOLWILDARGS ) {
 					iw = d->where+1;
 					while ( *iw ) {
 						if ( *iw == -SNUMBER ) {
-							if ( iw[1] <= 0 || iw[1] > totarg ) return(0);
+							if ( iw[1] <= 0 || iw[1] > totarg ) {
+#ifdef WITHPTHREADS
+								if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
+#endif
+								return(0);
+							}
 						}
 						else goto IllType;
 						iw += 2;
@@ -2153,6 +2164,9 @@ IllType:
 					MUNLOCK(ErrorMessageLock);
 					Terminate(-1);
 				}
+#ifdef WITHPTHREADS
+				if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
+#endif
 				withdollar++;
 			}
 			else if ( *in > totarg ) return(0);
@@ -2166,8 +2180,7 @@ IllType:
 				if ( *in < 0 ) {
 					d = Dollars - *in - 1;
 #ifdef WITHPTHREADS
-				{
-					int nummodopt, dtype = -1, numdollar = -*in-1;
+					dtype = -1; numdollar = -*in-1;
 					if ( AS.MultiThreaded && ( AC.mparallelflag == PARALLELFLAG ) ) {
 						for ( nummodopt = 0; nummodopt < NumModOptdollars; nummodopt++ ) {
 							if ( numdollar == ModOptdollars[nummodopt].number ) break;
@@ -2178,11 +2191,10 @@ IllType:
 								d = ModOptdollars[nummodopt].dstruct+AT.identity;
 							}
 							else {
-								LOCK(d->pthreadslockread);
+								RWLOCKR(d->pthreadslockread);
 							}
 						}
 					}
-				}
 #endif
 					if ( d->type == DOLNUMBER || d->type == DOLTERMS ) {
 						*tocopy++ = d->where[1] - 1;
@@ -2194,6 +2206,9 @@ IllType:
 							iw += 2;
 						}
 					}
+#ifdef WITHPTHREADS
+					if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
+#endif
 					in++;
 				}
 				else *tocopy++ = *in++;
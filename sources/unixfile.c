@@ -231,5 +231,22 @@ void Usetbuf(FILES *f, char *ptr) { DUMMYUSE(f); DUMMYUSE(ptr); }
 
 /*
   	#] Usetbuf : 
+  	#[ Uprefetch :
+
+	Asks the system to start reading size bytes at offset in the
+	background. It is only a hint: nothing happens when it is not supported.
+*/
+
+void Uprefetch(FILES *f, off_t offset, off_t size)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+	if ( f ) posix_fadvise(f->descriptor,offset,size,POSIX_FADV_WILLNEED);
+#else
+	DUMMYUSE(f); DUMMYUSE(offset); DUMMYUSE(size);
+#endif
+}
+
+/*
+  	#] Uprefetch : 
 */
 #endif
@@ -68,6 +68,7 @@ extern char *setupfilename;
 EXTERNLOCK(ErrorMessageLock)
 EXTERNLOCK(FileReadLock)
 EXTERNLOCK(dummylock)
+EXTERNRWLOCK(dummyrwlock)
 
 #ifdef VMS
 #include <stdio.h>
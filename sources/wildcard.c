@@ -1377,7 +1377,7 @@ WORD ResolveSet(PHEAD WORD *from, WORD *to, WORD *subs)
 						d = ModOptdollars[nummodopt].dstruct+AT.identity;
 					}
 					else {
-						LOCK(d->pthreadslockread);
+						RWLOCKR(d->pthreadslockread);
 					}
 				}
 			}
@@ -1412,7 +1412,7 @@ WORD ResolveSet(PHEAD WORD *from, WORD *to, WORD *subs)
 				}
 			}
 #ifdef WITHPTHREADS
-			if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+			if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 			MLOCK(ErrorMessageLock);
 			MesPrint("Unusable type of variable $%s in set substitution",
@@ -1422,7 +1422,7 @@ WORD ResolveSet(PHEAD WORD *from, WORD *to, WORD *subs)
 		}
 GotOne:;
 #ifdef WITHPTHREADS
-		if ( dtype > 0 && dtype != MODLOCAL ) { UNLOCK(d->pthreadslockread); }
+		if ( dtype > 0 && dtype != MODLOCAL ) { UNRWLOCK(d->pthreadslockread); }
 #endif
 		ii = m[*w];
 		if ( ii >= 2*MAXPOWER ) i3 = ii - 2*MAXPOWER;